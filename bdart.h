@@ -0,0 +1,821 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Adaptive radix tree (ART) of pointers to objects keyed by byte strings,
+see "The Adaptive Radix Tree: ARTful Indexing for Main-Memory Databases",
+Leis, Kemper, Neumann.
+
+Inner nodes hold 4, 16, 48 or 256 children, and grow and shrink as
+children are added and removed. Chains of nodes with a single child are
+collapsed into a prefix of the node below, the first max_prefix bytes of a
+prefix are stored in the node, longer prefixes are checked against the key
+of an object in the subtree.
+
+Leaves are the objects themselves, a child pointer with the low bit set
+points to an object, so objects must be at least 2 byte aligned. A leaf may
+be at any depth, lookups compare the whole key of the object found.
+Keys may contain any byte value, including 0, and a key may be a prefix of
+another key, the object whose key ends at an inner node is held in the
+terminal field of the node.
+
+Keys are ordered lexicographically by unsigned byte value, shorter keys
+first, so objects can be traversed in order.
+
+Not thread safe, access must be serialised by the caller.
+*/
+#ifndef BENEDIAS_ART_H_INCLUDED
+#define BENEDIAS_ART_H_INCLUDED
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+
+#include "bdbytes.h"
+
+namespace benedias {
+
+struct art_key
+{
+    const unsigned char* bytes;
+    std::size_t length;
+};
+
+// @a KeyOf is a functor returning the art_key of an object, given a pointer
+// to it.
+template <typename T, typename KeyOf> class art_tree
+{
+    private:
+        static const unsigned max_prefix = 16;
+
+        enum node_type : uint8_t { node4_type, node16_type, node48_type, node256_type };
+
+        struct node
+        {
+            node_type type;
+            // Number of children.
+            uint16_t count;
+            // Length of the prefix, which may be longer than max_prefix.
+            uint32_t prefix_len;
+            unsigned char prefix[max_prefix];
+            // The object whose key ends at this node.
+            T* terminal;
+        };
+
+        // Children are ordered by key.
+        struct node4:node
+        {
+            unsigned char keys[4];
+            node* children[4];
+        };
+
+        struct node16:node
+        {
+            unsigned char keys[16];
+            node* children[16];
+        };
+
+        // index[byte] is 1 + the position of the child in children, 0 for
+        // none.
+        struct node48:node
+        {
+            unsigned char index[256];
+            node* children[48];
+        };
+
+        struct node256:node
+        {
+            node* children[256];
+        };
+
+        node* root = nullptr;
+        std::size_t count = 0;
+        KeyOf key_of;
+
+        static_assert(alignof(T) >= 2, "art_tree leaves are tagged in the low bit");
+
+        static inline bool is_leaf(const node* ptr)
+        {
+            return reinterpret_cast<uintptr_t>(ptr) & 1;
+        }
+
+        static inline T* leaf_of(const node* ptr)
+        {
+            return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(1));
+        }
+
+        static inline node* make_leaf(const T* obj)
+        {
+            return reinterpret_cast<node*>(reinterpret_cast<uintptr_t>(obj) | 1);
+        }
+
+        template <typename N> static N* new_node(node_type type)
+        {
+            N* n = new N();
+            n->type = type;
+            n->count = 0;
+            n->prefix_len = 0;
+            n->terminal = nullptr;
+            return n;
+        }
+
+        static void copy_header(node* dst, const node* src)
+        {
+            dst->count = src->count;
+            dst->prefix_len = src->prefix_len;
+            memcpy(dst->prefix, src->prefix, max_prefix);
+            dst->terminal = src->terminal;
+        }
+
+        static void free_node(node* n)
+        {
+            switch(n->type)
+            {
+                case node4_type: delete static_cast<node4*>(n); break;
+                case node16_type: delete static_cast<node16*>(n); break;
+                case node48_type: delete static_cast<node48*>(n); break;
+                case node256_type: delete static_cast<node256*>(n); break;
+            }
+        }
+
+        static void destroy(node* ptr)
+        {
+            if (nullptr == ptr || is_leaf(ptr))
+                return;
+            for(unsigned b = 0; b < 256; ++b)
+            {
+                node** slot = find_child(ptr, b);
+                if (slot)
+                    destroy(*slot);
+            }
+            free_node(ptr);
+        }
+
+        static std::size_t node_size(const node* n)
+        {
+            switch(n->type)
+            {
+                case node4_type: return sizeof(node4);
+                case node16_type: return sizeof(node16);
+                case node48_type: return sizeof(node48);
+                default: return sizeof(node256);
+            }
+        }
+
+        // Adds the bytes of the inner nodes under @a ptr to @a bytes, returns
+        // the height of @a ptr, a leaf has height 1.
+        static std::size_t measure(const node* ptr, std::size_t& bytes)
+        {
+            if (is_leaf(ptr))
+                return 1;
+            bytes += node_size(ptr);
+            std::size_t height = 0;
+            for(unsigned b = 0; b < 256; ++b)
+            {
+                node** slot = find_child(const_cast<node*>(ptr), b);
+                if (slot)
+                    height = std::max(height, measure(*slot, bytes));
+            }
+            // The terminal object is compared at this node.
+            if (ptr->terminal)
+                height = std::max<std::size_t>(height, 1);
+            return 1 + height;
+        }
+
+        // Returns the location of the child of @a n for @a b, or nullptr.
+        static node** find_child(node* n, unsigned char b)
+        {
+            switch(n->type)
+            {
+                case node4_type:
+                    {
+                        node4* n4 = static_cast<node4*>(n);
+                        for(unsigned ix = 0; ix < n4->count; ++ix)
+                        {
+                            if (n4->keys[ix] == b)
+                                return &n4->children[ix];
+                        }
+                        return nullptr;
+                    }
+                case node16_type:
+                    {
+                        node16* n16 = static_cast<node16*>(n);
+                        unsigned char* pos = std::lower_bound(n16->keys, n16->keys + n16->count, b);
+                        if (pos != n16->keys + n16->count && *pos == b)
+                            return &n16->children[pos - n16->keys];
+                        return nullptr;
+                    }
+                case node48_type:
+                    {
+                        node48* n48 = static_cast<node48*>(n);
+                        return n48->index[b] ? &n48->children[n48->index[b] - 1] : nullptr;
+                    }
+                default:
+                    {
+                        node256* n256 = static_cast<node256*>(n);
+                        return n256->children[b] ? &n256->children[b] : nullptr;
+                    }
+            }
+        }
+
+        // Returns the child of @a n with the smallest key byte not less than
+        // @a from, or nullptr.
+        static node* child_from(const node* n, unsigned from)
+        {
+            switch(n->type)
+            {
+                case node4_type:
+                    {
+                        const node4* n4 = static_cast<const node4*>(n);
+                        for(unsigned ix = 0; ix < n4->count; ++ix)
+                        {
+                            if (n4->keys[ix] >= from)
+                                return n4->children[ix];
+                        }
+                        return nullptr;
+                    }
+                case node16_type:
+                    {
+                        const node16* n16 = static_cast<const node16*>(n);
+                        for(unsigned ix = 0; ix < n16->count; ++ix)
+                        {
+                            if (n16->keys[ix] >= from)
+                                return n16->children[ix];
+                        }
+                        return nullptr;
+                    }
+                case node48_type:
+                    {
+                        const node48* n48 = static_cast<const node48*>(n);
+                        for(unsigned b = from; b < 256; ++b)
+                        {
+                            if (n48->index[b])
+                                return n48->children[n48->index[b] - 1];
+                        }
+                        return nullptr;
+                    }
+                default:
+                    {
+                        const node256* n256 = static_cast<const node256*>(n);
+                        for(unsigned b = from; b < 256; ++b)
+                        {
+                            if (n256->children[b])
+                                return n256->children[b];
+                        }
+                        return nullptr;
+                    }
+            }
+        }
+
+        // Add @a child for @a b to @a n, which is at @a ref, growing the node
+        // if it is full.
+        static void add_child(node*& ref, node* n, unsigned char b, node* child)
+        {
+            switch(n->type)
+            {
+                case node4_type:
+                    {
+                        node4* n4 = static_cast<node4*>(n);
+                        if (n4->count < 4)
+                        {
+                            unsigned ix = 0;
+                            while(ix < n4->count && n4->keys[ix] < b)
+                                ++ix;
+                            std::copy_backward(n4->keys + ix, n4->keys + n4->count, n4->keys + n4->count + 1);
+                            std::copy_backward(n4->children + ix, n4->children + n4->count, n4->children + n4->count + 1);
+                            n4->keys[ix] = b;
+                            n4->children[ix] = child;
+                            ++n4->count;
+                            return;
+                        }
+                        node16* n16 = new_node<node16>(node16_type);
+                        copy_header(n16, n4);
+                        std::copy(n4->keys, n4->keys + 4, n16->keys);
+                        std::copy(n4->children, n4->children + 4, n16->children);
+                        ref = n16;
+                        delete n4;
+                        add_child(ref, n16, b, child);
+                        return;
+                    }
+                case node16_type:
+                    {
+                        node16* n16 = static_cast<node16*>(n);
+                        if (n16->count < 16)
+                        {
+                            unsigned ix = std::lower_bound(n16->keys, n16->keys + n16->count, b) - n16->keys;
+                            std::copy_backward(n16->keys + ix, n16->keys + n16->count, n16->keys + n16->count + 1);
+                            std::copy_backward(n16->children + ix, n16->children + n16->count, n16->children + n16->count + 1);
+                            n16->keys[ix] = b;
+                            n16->children[ix] = child;
+                            ++n16->count;
+                            return;
+                        }
+                        node48* n48 = new_node<node48>(node48_type);
+                        copy_header(n48, n16);
+                        for(unsigned ix = 0; ix < 16; ++ix)
+                        {
+                            n48->children[ix] = n16->children[ix];
+                            n48->index[n16->keys[ix]] = ix + 1;
+                        }
+                        ref = n48;
+                        delete n16;
+                        add_child(ref, n48, b, child);
+                        return;
+                    }
+                case node48_type:
+                    {
+                        node48* n48 = static_cast<node48*>(n);
+                        if (n48->count < 48)
+                        {
+                            unsigned ix = 0;
+                            while(n48->children[ix])
+                                ++ix;
+                            n48->children[ix] = child;
+                            n48->index[b] = ix + 1;
+                            ++n48->count;
+                            return;
+                        }
+                        node256* n256 = new_node<node256>(node256_type);
+                        copy_header(n256, n48);
+                        for(unsigned kb = 0; kb < 256; ++kb)
+                        {
+                            if (n48->index[kb])
+                                n256->children[kb] = n48->children[n48->index[kb] - 1];
+                        }
+                        ref = n256;
+                        delete n48;
+                        add_child(ref, n256, b, child);
+                        return;
+                    }
+                default:
+                    {
+                        node256* n256 = static_cast<node256*>(n);
+                        n256->children[b] = child;
+                        ++n256->count;
+                        return;
+                    }
+            }
+        }
+
+        // Remove the child of @a n for @a b, @a n is at @a ref, shrinking the
+        // node if it becomes sparse.
+        static void remove_child(node*& ref, node* n, unsigned char b)
+        {
+            switch(n->type)
+            {
+                case node4_type:
+                    {
+                        node4* n4 = static_cast<node4*>(n);
+                        unsigned ix = std::find(n4->keys, n4->keys + n4->count, b) - n4->keys;
+                        std::copy(n4->keys + ix + 1, n4->keys + n4->count, n4->keys + ix);
+                        std::copy(n4->children + ix + 1, n4->children + n4->count, n4->children + ix);
+                        --n4->count;
+                        return;
+                    }
+                case node16_type:
+                    {
+                        node16* n16 = static_cast<node16*>(n);
+                        unsigned ix = std::lower_bound(n16->keys, n16->keys + n16->count, b) - n16->keys;
+                        std::copy(n16->keys + ix + 1, n16->keys + n16->count, n16->keys + ix);
+                        std::copy(n16->children + ix + 1, n16->children + n16->count, n16->children + ix);
+                        if (--n16->count > 3)
+                            return;
+                        node4* n4 = new_node<node4>(node4_type);
+                        copy_header(n4, n16);
+                        std::copy(n16->keys, n16->keys + n16->count, n4->keys);
+                        std::copy(n16->children, n16->children + n16->count, n4->children);
+                        ref = n4;
+                        delete n16;
+                        return;
+                    }
+                case node48_type:
+                    {
+                        node48* n48 = static_cast<node48*>(n);
+                        n48->children[n48->index[b] - 1] = nullptr;
+                        n48->index[b] = 0;
+                        if (--n48->count > 12)
+                            return;
+                        node16* n16 = new_node<node16>(node16_type);
+                        copy_header(n16, n48);
+                        unsigned ix = 0;
+                        for(unsigned kb = 0; kb < 256; ++kb)
+                        {
+                            if (n48->index[kb])
+                            {
+                                n16->keys[ix] = kb;
+                                n16->children[ix++] = n48->children[n48->index[kb] - 1];
+                            }
+                        }
+                        ref = n16;
+                        delete n48;
+                        return;
+                    }
+                default:
+                    {
+                        node256* n256 = static_cast<node256*>(n);
+                        n256->children[b] = nullptr;
+                        if (--n256->count > 37)
+                            return;
+                        node48* n48 = new_node<node48>(node48_type);
+                        copy_header(n48, n256);
+                        unsigned ix = 0;
+                        for(unsigned kb = 0; kb < 256; ++kb)
+                        {
+                            if (n256->children[kb])
+                            {
+                                n48->children[ix] = n256->children[kb];
+                                n48->index[kb] = ++ix;
+                            }
+                        }
+                        ref = n48;
+                        delete n256;
+                        return;
+                    }
+            }
+        }
+
+        // Replace the node at @a ref by its terminal if it has no children,
+        // or merge it with its child if it has one child and no terminal.
+        static void collapse(node*& ref)
+        {
+            node* n = ref;
+            if (0 == n->count)
+            {
+                ref = n->terminal ? make_leaf(n->terminal) : nullptr;
+                free_node(n);
+                return;
+            }
+            if (1 != n->count || n->terminal)
+                return;
+            unsigned b = 0;
+            while(nullptr == find_child(n, b))
+                ++b;
+            node* child = *find_child(n, b);
+            if (!is_leaf(child))
+            {
+                // The prefix of the child follows the prefix of the node and
+                // the key byte of the child.
+                unsigned char prefix[max_prefix];
+                unsigned len = std::min<uint32_t>(n->prefix_len, max_prefix);
+                memcpy(prefix, n->prefix, len);
+                if (len < max_prefix)
+                    prefix[len++] = b;
+                if (len < max_prefix)
+                {
+                    unsigned tail = std::min<unsigned>(child->prefix_len, max_prefix - len);
+                    memcpy(prefix + len, child->prefix, tail);
+                }
+                memcpy(child->prefix, prefix, max_prefix);
+                child->prefix_len += n->prefix_len + 1;
+            }
+            ref = child;
+            free_node(n);
+        }
+
+        static T* minimum(const node* ptr)
+        {
+            while(ptr && !is_leaf(ptr))
+            {
+                if (ptr->terminal)
+                    return ptr->terminal;
+                ptr = child_from(ptr, 0);
+            }
+            return ptr ? leaf_of(ptr) : nullptr;
+        }
+
+        static int compare(const art_key& lhs, const art_key& rhs)
+        {
+            int rv = memcmp(lhs.bytes, rhs.bytes, std::min(lhs.length, rhs.length));
+            if (0 == rv && lhs.length != rhs.length)
+                rv = lhs.length < rhs.length ? -1 : 1;
+            return rv;
+        }
+
+        // Returns the prefix bytes of @a n, which is at @a depth.
+        const unsigned char* prefix_of(const node* n, std::size_t depth) const
+        {
+            if (n->prefix_len <= max_prefix)
+                return n->prefix;
+            return key_of(minimum(n)).bytes + depth;
+        }
+
+        // Returns the number of bytes of the prefix of @a n, which is at
+        // @a depth, matching @a key, which is less than the prefix length if
+        // @a key ends within the prefix.
+        std::size_t prefix_match(const node* n, const art_key& key, std::size_t depth) const
+        {
+            std::size_t len = std::min<std::size_t>(n->prefix_len, key.length - depth);
+            const unsigned char* prefix = prefix_of(n, depth);
+            std::size_t ix = 0;
+            while(ix < len && prefix[ix] == key.bytes[depth + ix])
+                ++ix;
+            return ix;
+        }
+
+        // Place @a obj with @a key in the new node @a n, which is at depth.
+        static void place(node*& ref, T* obj, const art_key& key, std::size_t depth)
+        {
+            if (depth == key.length)
+                ref->terminal = obj;
+            else
+                add_child(ref, ref, key.bytes[depth], make_leaf(obj));
+        }
+
+        bool erase(node*& ref, const T* obj, const art_key& key, std::size_t depth)
+        {
+            node* ptr = ref;
+            if (nullptr == ptr)
+                return false;
+            if (is_leaf(ptr))
+            {
+                if (leaf_of(ptr) != obj)
+                    return false;
+                ref = nullptr;
+                return true;
+            }
+            depth += ptr->prefix_len;
+            if (depth > key.length)
+                return false;
+            if (depth == key.length)
+            {
+                if (ptr->terminal != obj)
+                    return false;
+                ptr->terminal = nullptr;
+                collapse(ref);
+                return true;
+            }
+            node** slot = find_child(ptr, key.bytes[depth]);
+            if (nullptr == slot || !erase(*slot, obj, key, depth + 1))
+                return false;
+            if (nullptr == *slot)
+                remove_child(ref, ptr, key.bytes[depth]);
+            collapse(ref);
+            return true;
+        }
+
+        // Returns the object with the smallest key greater than @a key in
+        // the subtree at @a ptr, at @a depth, or nullptr.
+        T* next_after(const node* ptr, const art_key& key, std::size_t depth) const
+        {
+            if (nullptr == ptr)
+                return nullptr;
+            if (is_leaf(ptr))
+            {
+                T* obj = leaf_of(ptr);
+                return compare(key_of(obj), key) > 0 ? obj : nullptr;
+            }
+            if (ptr->prefix_len)
+            {
+                std::size_t len = std::min<std::size_t>(ptr->prefix_len, key.length - depth);
+                int rv = memcmp(prefix_of(ptr, depth), key.bytes + depth, len);
+                // If the key ends within the prefix the keys of the subtree
+                // are longer.
+                if (rv > 0 || (0 == rv && len < ptr->prefix_len))
+                    return minimum(ptr);
+                if (rv < 0)
+                    return nullptr;
+                depth += ptr->prefix_len;
+            }
+            // The terminal is not greater than the key.
+            if (depth == key.length)
+                return minimum(child_from(ptr, 0));
+            unsigned char b = key.bytes[depth];
+            node** slot = find_child(const_cast<node*>(ptr), b);
+            if (slot)
+            {
+                T* obj = next_after(*slot, key, depth + 1);
+                if (obj)
+                    return obj;
+            }
+            return minimum(child_from(ptr, b + 1u));
+        }
+
+        template <typename F> static void visit(const node* ptr, F& f)
+        {
+            if (nullptr == ptr)
+                return;
+            if (is_leaf(ptr))
+            {
+                f(leaf_of(ptr));
+                return;
+            }
+            if (ptr->terminal)
+                f(ptr->terminal);
+            for(unsigned b = 0; b < 256; ++b)
+            {
+                node** slot = find_child(const_cast<node*>(ptr), b);
+                if (slot)
+                    visit(*slot, f);
+            }
+        }
+
+    public:
+        art_tree() {}
+
+        ~art_tree()
+        {
+            clear();
+        }
+
+        // Non copyable
+        art_tree(const art_tree&) = delete;
+        art_tree& operator=(const art_tree&) = delete;
+
+        void clear()
+        {
+            destroy(root);
+            root = nullptr;
+            count = 0;
+        }
+
+        std::size_t size() const
+        {
+            return count;
+        }
+
+        //@brief    Returns the bytes used by the inner nodes, visits every
+        // node.
+        std::size_t memory() const
+        {
+            std::size_t bytes = 0;
+            if (root)
+                measure(root, bytes);
+            return bytes;
+        }
+
+        //@brief    Returns the most nodes visited by a lookup, including the
+        // leaf, visits every node.
+        std::size_t height() const
+        {
+            std::size_t bytes = 0;
+            return root ? measure(root, bytes) : 0;
+        }
+
+        //@brief    Returns the object with the key @a bytes, or nullptr.
+        T* find(const unsigned char* bytes, std::size_t length) const
+        {
+            const node* ptr = root;
+            std::size_t depth = 0;
+            while(ptr)
+            {
+                if (is_leaf(ptr))
+                {
+                    T* obj = leaf_of(ptr);
+                    art_key key = key_of(obj);
+                    if (key.length == length && bytes_equal(reinterpret_cast<const char*>(key.bytes),
+                                reinterpret_cast<const char*>(bytes), length))
+                        return obj;
+                    return nullptr;
+                }
+                if (ptr->prefix_len)
+                {
+                    if (depth + ptr->prefix_len > length)
+                        return nullptr;
+                    // Bytes beyond max_prefix are checked with the key of
+                    // the object found.
+                    std::size_t len = std::min<std::size_t>(ptr->prefix_len, max_prefix);
+                    if (0 != memcmp(ptr->prefix, bytes + depth, len))
+                        return nullptr;
+                    depth += ptr->prefix_len;
+                }
+                if (depth == length)
+                {
+                    T* obj = ptr->terminal;
+                    if (obj && bytes_equal(reinterpret_cast<const char*>(key_of(obj).bytes),
+                                reinterpret_cast<const char*>(bytes), length))
+                        return obj;
+                    return nullptr;
+                }
+                node** slot = find_child(const_cast<node*>(ptr), bytes[depth]);
+                if (nullptr == slot)
+                    return nullptr;
+                ptr = *slot;
+                ++depth;
+            }
+            return nullptr;
+        }
+
+        //@brief    Insert @a obj, there must be no object with the same key.
+        void insert(T* obj)
+        {
+            art_key key = key_of(obj);
+            node** ref = &root;
+            std::size_t depth = 0;
+            ++count;
+            while(true)
+            {
+                node* ptr = *ref;
+                if (nullptr == ptr)
+                {
+                    *ref = make_leaf(obj);
+                    return;
+                }
+                if (is_leaf(ptr))
+                {
+                    // Split the leaf into a node holding both objects.
+                    art_key other = key_of(leaf_of(ptr));
+                    std::size_t end = std::min(key.length, other.length);
+                    std::size_t ix = depth;
+                    while(ix < end && key.bytes[ix] == other.bytes[ix])
+                        ++ix;
+                    node* n = new_node<node4>(node4_type);
+                    n->prefix_len = uint32_t(ix - depth);
+                    memcpy(n->prefix, key.bytes + depth, std::min<std::size_t>(n->prefix_len, max_prefix));
+                    place(n, leaf_of(ptr), other, ix);
+                    place(n, obj, key, ix);
+                    *ref = n;
+                    return;
+                }
+                if (ptr->prefix_len)
+                {
+                    std::size_t match = prefix_match(ptr, key, depth);
+                    if (match < ptr->prefix_len)
+                    {
+                        // Split the prefix, the node keeps the bytes after
+                        // the mismatch.
+                        node* n = new_node<node4>(node4_type);
+                        n->prefix_len = uint32_t(match);
+                        memcpy(n->prefix, key.bytes + depth, std::min<std::size_t>(match, max_prefix));
+                        const unsigned char* prefix = prefix_of(ptr, depth);
+                        unsigned char b = prefix[match];
+                        ptr->prefix_len -= uint32_t(match + 1);
+                        memmove(ptr->prefix, prefix + match + 1, std::min<std::size_t>(ptr->prefix_len, max_prefix));
+                        add_child(n, n, b, ptr);
+                        place(n, obj, key, depth + match);
+                        *ref = n;
+                        return;
+                    }
+                    depth += ptr->prefix_len;
+                }
+                if (depth == key.length)
+                {
+                    ptr->terminal = obj;
+                    return;
+                }
+                node** slot = find_child(ptr, key.bytes[depth]);
+                if (nullptr == slot)
+                {
+                    add_child(*ref, ptr, key.bytes[depth], make_leaf(obj));
+                    return;
+                }
+                ref = slot;
+                ++depth;
+            }
+        }
+
+        //@brief    Erase @a obj, returns false if not present.
+        bool erase(const T* obj)
+        {
+            if (!erase(root, obj, key_of(obj), 0))
+                return false;
+            --count;
+            return true;
+        }
+
+        //@brief    Returns the object with the smallest key, or nullptr.
+        T* first() const
+        {
+            return minimum(root);
+        }
+
+        //@brief    Returns the object with the smallest key greater than the
+        // key of @a obj, or nullptr.
+        T* next(const T* obj) const
+        {
+            return next_after(root, key_of(obj), 0);
+        }
+
+        //@brief    Returns the object with the smallest key not less than
+        // @a bytes, or nullptr.
+        T* lower_bound(const unsigned char* bytes, std::size_t length) const
+        {
+            T* obj = find(bytes, length);
+            return obj ? obj : next_after(root, art_key{bytes, length}, 0);
+        }
+
+        //@brief    Call @a f for each object in key order.
+        template <typename F> void visit(F f) const
+        {
+            visit(root, f);
+        }
+};
+
+template <typename T, typename KeyOf> const unsigned art_tree<T, KeyOf>::max_prefix;
+
+} // namespace benedias
+
+#endif // BENEDIAS_ART_H_INCLUDED
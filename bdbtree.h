@@ -0,0 +1,410 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Counted B+ tree of pointers, ordered by a comparator on the objects pointed
+to, with no two equal objects.
+
+Each node records the number of objects in its subtree, so the position
+(rank) of an object, and the object at a position, are found in O(log n).
+Inner nodes record the smallest object of each child.
+
+Nodes which become sparse after erasures are merged with a neighbour when
+the objects of both fit in one node.
+
+The tree is not thread safe, access must be serialised by the caller.
+*/
+#ifndef BENEDIAS_BTREE_H_INCLUDED
+#define BENEDIAS_BTREE_H_INCLUDED
+
+#include <cstddef>
+#include <algorithm>
+
+namespace benedias {
+
+// @a Less is a functor comparing two objects, given pointers to them.
+template <typename T, typename Less> class counted_btree
+{
+    private:
+        static const unsigned fanout = 64;
+
+        struct node
+        {
+            bool leaf;
+            // Number of entries in the node.
+            unsigned count;
+            // Number of objects in the subtree.
+            std::size_t size;
+        };
+
+        struct leaf_node:node
+        {
+            T* items[fanout];
+        };
+
+        struct inner_node:node
+        {
+            // mins[i] is the smallest object in children[i].
+            T* mins[fanout];
+            node* children[fanout];
+        };
+
+        node* root = nullptr;
+        Less less;
+
+        static T* min_of(const node* n)
+        {
+            return n->leaf ? static_cast<const leaf_node*>(n)->items[0]
+                : static_cast<const inner_node*>(n)->mins[0];
+        }
+
+        static void destroy(node* n)
+        {
+            if (n->leaf)
+            {
+                delete static_cast<leaf_node*>(n);
+                return;
+            }
+            inner_node* in = static_cast<inner_node*>(n);
+            for(unsigned ix = 0; ix < in->count; ++ix)
+                destroy(in->children[ix]);
+            delete in;
+        }
+
+        // Index of the child of @a in which would hold @a obj.
+        unsigned child_for(const inner_node* in, const T* obj) const
+        {
+            unsigned ix = in->count - 1;
+            while(ix > 0 && less(obj, in->mins[ix]))
+                --ix;
+            return ix;
+        }
+
+        // Move the upper half of the entries of @a n to a new node.
+        static node* split(node* n)
+        {
+            unsigned half = n->count / 2;
+            if (n->leaf)
+            {
+                leaf_node* ln = static_cast<leaf_node*>(n);
+                leaf_node* right = new leaf_node();
+                right->leaf = true;
+                right->count = ln->count - half;
+                std::copy(ln->items + half, ln->items + ln->count, right->items);
+                right->size = right->count;
+                ln->count = half;
+                ln->size = half;
+                return right;
+            }
+            // Sizes are recounted by the caller.
+            inner_node* in = static_cast<inner_node*>(n);
+            inner_node* right = new inner_node();
+            right->leaf = false;
+            right->count = in->count - half;
+            std::copy(in->mins + half, in->mins + in->count, right->mins);
+            std::copy(in->children + half, in->children + in->count, right->children);
+            in->count = half;
+            return right;
+        }
+
+        // Insert @a obj into the subtree @a n, returns false if an equal
+        // object is present. If @a n is split the new right sibling is
+        // returned in @a sibling.
+        bool insert(node* n, T* obj, node*& sibling)
+        {
+            sibling = nullptr;
+            if (n->leaf)
+            {
+                leaf_node* ln = static_cast<leaf_node*>(n);
+                T** pos = std::upper_bound(ln->items, ln->items + ln->count, obj,
+                        [this](const T* lhs, const T* rhs) { return less(lhs, rhs); });
+                if (pos != ln->items && !less(*(pos - 1), obj))
+                    return false;
+                unsigned ix = pos - ln->items;
+                if (ln->count == fanout)
+                {
+                    sibling = split(ln);
+                    if (ix > ln->count)
+                    {
+                        ix -= ln->count;
+                        ln = static_cast<leaf_node*>(sibling);
+                    }
+                }
+                std::copy_backward(ln->items + ix, ln->items + ln->count, ln->items + ln->count + 1);
+                ln->items[ix] = obj;
+                ++ln->count;
+                ++ln->size;
+                return true;
+            }
+            inner_node* in = static_cast<inner_node*>(n);
+            unsigned ix = child_for(in, obj);
+            node* child_sibling;
+            if (!insert(in->children[ix], obj, child_sibling))
+                return false;
+            ++in->size;
+            in->mins[ix] = min_of(in->children[ix]);
+            if (nullptr == child_sibling)
+                return true;
+            // Add the new child after children[ix], its objects are already
+            // counted, unless this node is split as well.
+            inner_node* target = in;
+            if (in->count == fanout)
+            {
+                sibling = split(in);
+                if (ix >= in->count)
+                {
+                    ix -= in->count;
+                    target = static_cast<inner_node*>(sibling);
+                }
+            }
+            ++ix;
+            std::copy_backward(target->mins + ix, target->mins + target->count, target->mins + target->count + 1);
+            std::copy_backward(target->children + ix, target->children + target->count, target->children + target->count + 1);
+            target->mins[ix] = min_of(child_sibling);
+            target->children[ix] = child_sibling;
+            ++target->count;
+            if (sibling)
+            {
+                recount(in);
+                recount(static_cast<inner_node*>(sibling));
+            }
+            return true;
+        }
+
+        static void recount(inner_node* in)
+        {
+            in->size = 0;
+            for(unsigned ix = 0; ix < in->count; ++ix)
+                in->size += in->children[ix]->size;
+        }
+
+        // Merge children[ix + 1] of @a in into children[ix].
+        static void merge(inner_node* in, unsigned ix)
+        {
+            node* left = in->children[ix];
+            node* right = in->children[ix + 1];
+            unsigned left_count = left->count;
+            left->count += right->count;
+            left->size += right->size;
+            if (left->leaf)
+            {
+                leaf_node* ll = static_cast<leaf_node*>(left);
+                leaf_node* rl = static_cast<leaf_node*>(right);
+                std::copy(rl->items, rl->items + rl->count, ll->items + left_count);
+                delete rl;
+            }
+            else
+            {
+                inner_node* li = static_cast<inner_node*>(left);
+                inner_node* ri = static_cast<inner_node*>(right);
+                std::copy(ri->mins, ri->mins + ri->count, li->mins + left_count);
+                std::copy(ri->children, ri->children + ri->count, li->children + left_count);
+                delete ri;
+            }
+            std::copy(in->mins + ix + 2, in->mins + in->count, in->mins + ix + 1);
+            std::copy(in->children + ix + 2, in->children + in->count, in->children + ix + 1);
+            --in->count;
+        }
+
+        // Erase @a obj from the subtree @a n, returns false if not present.
+        bool erase(node* n, const T* obj)
+        {
+            if (n->leaf)
+            {
+                leaf_node* ln = static_cast<leaf_node*>(n);
+                T** pos = std::find(ln->items, ln->items + ln->count, obj);
+                if (pos == ln->items + ln->count)
+                    return false;
+                std::copy(pos + 1, ln->items + ln->count, pos);
+                --ln->count;
+                --ln->size;
+                return true;
+            }
+            inner_node* in = static_cast<inner_node*>(n);
+            unsigned ix = child_for(in, obj);
+            node* child = in->children[ix];
+            if (!erase(child, obj))
+                return false;
+            --in->size;
+            if (0 == child->count)
+            {
+                destroy(child);
+                std::copy(in->mins + ix + 1, in->mins + in->count, in->mins + ix);
+                std::copy(in->children + ix + 1, in->children + in->count, in->children + ix);
+                --in->count;
+                return true;
+            }
+            in->mins[ix] = min_of(child);
+            if (child->count < fanout / 4)
+            {
+                if (ix + 1 < in->count && child->count + in->children[ix + 1]->count <= fanout)
+                    merge(in, ix);
+                else if (ix > 0 && child->count + in->children[ix - 1]->count <= fanout)
+                    merge(in, ix - 1);
+            }
+            return true;
+        }
+
+        template <typename F> static bool visit(const node* n, std::size_t offset, std::size_t& count, F& f)
+        {
+            if (n->leaf)
+            {
+                const leaf_node* ln = static_cast<const leaf_node*>(n);
+                for(unsigned ix = offset; ix < ln->count && count; ++ix, --count)
+                {
+                    if (!f(ln->items[ix]))
+                        return false;
+                }
+                return true;
+            }
+            const inner_node* in = static_cast<const inner_node*>(n);
+            for(unsigned ix = 0; ix < in->count && count; ++ix)
+            {
+                const node* child = in->children[ix];
+                if (offset >= child->size)
+                {
+                    offset -= child->size;
+                    continue;
+                }
+                if (!visit(child, offset, count, f))
+                    return false;
+                offset = 0;
+            }
+            return true;
+        }
+
+    public:
+        counted_btree() {}
+        explicit counted_btree(const Less& less_in):less(less_in) {}
+
+        ~counted_btree()
+        {
+            clear();
+        }
+
+        // Non copyable
+        counted_btree(const counted_btree&) = delete;
+        counted_btree& operator=(const counted_btree&) = delete;
+
+        void clear()
+        {
+            if (root)
+                destroy(root);
+            root = nullptr;
+        }
+
+        std::size_t size() const
+        {
+            return root ? root->size : 0;
+        }
+
+        //@brief    Insert @a obj, returns false if an equal object is present.
+        bool insert(T* obj)
+        {
+            if (nullptr == root)
+            {
+                leaf_node* ln = new leaf_node();
+                ln->leaf = true;
+                ln->count = 0;
+                ln->size = 0;
+                root = ln;
+            }
+            node* sibling;
+            if (!insert(root, obj, sibling))
+                return false;
+            if (sibling)
+            {
+                inner_node* in = new inner_node();
+                in->leaf = false;
+                in->count = 2;
+                in->size = root->size + sibling->size;
+                in->mins[0] = min_of(root);
+                in->children[0] = root;
+                in->mins[1] = min_of(sibling);
+                in->children[1] = sibling;
+                root = in;
+            }
+            return true;
+        }
+
+        //@brief    Erase @a obj, the object itself is compared, not its value,
+        // returns false if not present.
+        bool erase(const T* obj)
+        {
+            if (nullptr == root || !erase(root, obj))
+                return false;
+            if (0 == root->count)
+                clear();
+            else if (!root->leaf && 1 == root->count)
+            {
+                inner_node* in = static_cast<inner_node*>(root);
+                root = in->children[0];
+                delete in;
+            }
+            return true;
+        }
+
+        //@brief    Returns the position of the first object for which @a pred
+        // is false, objects for which @a pred is true must precede those for
+        // which it is false.
+        template <typename Pred> std::size_t partition_point(Pred pred) const
+        {
+            std::size_t rank = 0;
+            const node* n = root;
+            if (nullptr == n)
+                return 0;
+            while(!n->leaf)
+            {
+                const inner_node* in = static_cast<const inner_node*>(n);
+                unsigned ix = in->count - 1;
+                while(ix > 0 && !pred(in->mins[ix]))
+                    --ix;
+                for(unsigned cx = 0; cx < ix; ++cx)
+                    rank += in->children[cx]->size;
+                n = in->children[ix];
+            }
+            const leaf_node* ln = static_cast<const leaf_node*>(n);
+            return rank + (std::partition_point(ln->items, ln->items + ln->count, pred) - ln->items);
+        }
+
+        //@brief    Returns the object at position @a rank, which must be
+        // less than size().
+        T* at(std::size_t rank) const
+        {
+            const node* n = root;
+            while(!n->leaf)
+            {
+                const inner_node* in = static_cast<const inner_node*>(n);
+                unsigned ix = 0;
+                while(rank >= in->children[ix]->size)
+                    rank -= in->children[ix++]->size;
+                n = in->children[ix];
+            }
+            return static_cast<const leaf_node*>(n)->items[rank];
+        }
+
+        //@brief    Call @a f for up to @a count objects in order, starting at
+        // position @a offset, stopping early if @a f returns false.
+        template <typename F> void visit(std::size_t offset, std::size_t count, F f) const
+        {
+            if (root && offset < root->size)
+                visit(root, offset, count, f);
+        }
+};
+
+} // namespace benedias
+
+#endif // BENEDIAS_BTREE_H_INCLUDED
@@ -0,0 +1,267 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Equality and lexicographic comparison of byte strings of known length, for
+the string directory and the dbstring comparison operators.
+
+bytes_equal     true if the bytes are equal.
+bytes_compare   the sign of the first differing byte, as unsigned char, as
+                memcmp.
+
+Strings shorter than 16 bytes are compared with two overlapping 8 or 4 byte
+loads, without a call, longer strings 16 bytes at a time with SSE2, or 32
+bytes at a time with AVX2 if the CPU supports it and the strings are long
+enough to repay the call, and the last block is loaded overlapping the
+previous one rather than byte by byte. Other targets use memcmp.
+*/
+#ifndef BENEDIAS_BYTES_H_INCLUDED
+#define BENEDIAS_BYTES_H_INCLUDED
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define BENEDIAS_BYTES_X86_SIMD
+#endif
+
+namespace benedias {
+
+namespace bytes_detail {
+
+static inline uint64_t load64(const char* ptr)
+{
+    uint64_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return v;
+}
+
+static inline uint32_t load32(const char* ptr)
+{
+    uint32_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return v;
+}
+
+// Words in the byte order of the string, so that they compare as the bytes.
+static inline uint64_t ordered(uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(v);
+#else
+    return v;
+#endif
+}
+
+static inline uint32_t ordered(uint32_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(v);
+#else
+    return v;
+#endif
+}
+
+template <typename W> static inline int compare_words(W lhs, W rhs)
+{
+    lhs = ordered(lhs);
+    rhs = ordered(rhs);
+    return lhs < rhs ? -1 : 1;
+}
+
+static inline int compare_bytes(const char* lhs, const char* rhs, std::size_t ix)
+{
+    return int(static_cast<unsigned char>(lhs[ix])) - int(static_cast<unsigned char>(rhs[ix]));
+}
+
+// Fewer than 16 bytes.
+static inline bool equal_short(const char* lhs, const char* rhs, std::size_t length)
+{
+    if (length >= 8)
+        return 0 == ((load64(lhs) ^ load64(rhs))
+                | (load64(lhs + length - 8) ^ load64(rhs + length - 8)));
+    if (length >= 4)
+        return 0 == ((load32(lhs) ^ load32(rhs))
+                | (load32(lhs + length - 4) ^ load32(rhs + length - 4)));
+    for(std::size_t ix = 0; ix < length; ++ix)
+    {
+        if (lhs[ix] != rhs[ix])
+            return false;
+    }
+    return true;
+}
+
+// Fewer than 16 bytes, the overlapping bytes of the second word are equal if
+// the first words are.
+static inline int compare_short(const char* lhs, const char* rhs, std::size_t length)
+{
+    if (length >= 8)
+    {
+        uint64_t l = load64(lhs);
+        uint64_t r = load64(rhs);
+        if (l != r)
+            return compare_words(l, r);
+        l = load64(lhs + length - 8);
+        r = load64(rhs + length - 8);
+        return l == r ? 0 : compare_words(l, r);
+    }
+    if (length >= 4)
+    {
+        uint32_t l = load32(lhs);
+        uint32_t r = load32(rhs);
+        if (l != r)
+            return compare_words(l, r);
+        l = load32(lhs + length - 4);
+        r = load32(rhs + length - 4);
+        return l == r ? 0 : compare_words(l, r);
+    }
+    for(std::size_t ix = 0; ix < length; ++ix)
+    {
+        if (lhs[ix] != rhs[ix])
+            return compare_bytes(lhs, rhs, ix);
+    }
+    return 0;
+}
+
+#ifdef  BENEDIAS_BYTES_X86_SIMD
+// Strings at least this long are compared with AVX2.
+static const std::size_t avx2_min_length = 64;
+
+// A mask of the bytes of 16 bytes at @a ix which are equal.
+static inline unsigned equal_mask16(const char* lhs, const char* rhs, std::size_t ix)
+{
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + ix));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + ix));
+    return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(l, r)));
+}
+
+// At least 16 bytes.
+static inline bool equal_sse2(const char* lhs, const char* rhs, std::size_t length)
+{
+    std::size_t ix = 0;
+    for(; ix + 16 <= length; ix += 16)
+    {
+        if (0xffff != equal_mask16(lhs, rhs, ix))
+            return false;
+    }
+    return ix == length || 0xffff == equal_mask16(lhs, rhs, length - 16);
+}
+
+static inline int compare_sse2(const char* lhs, const char* rhs, std::size_t length)
+{
+    std::size_t ix = 0;
+    unsigned mask;
+    for(; ix + 16 <= length; ix += 16)
+    {
+        mask = equal_mask16(lhs, rhs, ix);
+        if (0xffff != mask)
+            return compare_bytes(lhs, rhs, ix + __builtin_ctz(~mask));
+    }
+    if (ix == length)
+        return 0;
+    ix = length - 16;
+    mask = equal_mask16(lhs, rhs, ix);
+    return 0xffff == mask ? 0 : compare_bytes(lhs, rhs, ix + __builtin_ctz(~mask));
+}
+
+// At least 32 bytes.
+__attribute__((target("avx2")))
+static inline unsigned equal_mask32(const char* lhs, const char* rhs, std::size_t ix)
+{
+    __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + ix));
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + ix));
+    return unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r)));
+}
+
+__attribute__((target("avx2")))
+static bool equal_avx2(const char* lhs, const char* rhs, std::size_t length)
+{
+    std::size_t ix = 0;
+    for(; ix + 32 <= length; ix += 32)
+    {
+        if (~0u != equal_mask32(lhs, rhs, ix))
+            return false;
+    }
+    return ix == length || ~0u == equal_mask32(lhs, rhs, length - 32);
+}
+
+__attribute__((target("avx2")))
+static int compare_avx2(const char* lhs, const char* rhs, std::size_t length)
+{
+    std::size_t ix = 0;
+    unsigned mask;
+    for(; ix + 32 <= length; ix += 32)
+    {
+        mask = equal_mask32(lhs, rhs, ix);
+        if (~0u != mask)
+            return compare_bytes(lhs, rhs, ix + __builtin_ctz(~mask));
+    }
+    if (ix == length)
+        return 0;
+    ix = length - 32;
+    mask = equal_mask32(lhs, rhs, ix);
+    return ~0u == mask ? 0 : compare_bytes(lhs, rhs, ix + __builtin_ctz(~mask));
+}
+
+static inline bool cpu_avx2()
+{
+    static const bool avx2 = []()
+        {
+            __builtin_cpu_init();
+            return 0 != __builtin_cpu_supports("avx2");
+        }();
+    return avx2;
+}
+#endif
+
+} // namespace bytes_detail
+
+//@brief    Returns true if the @a length bytes at @a lhs and @a rhs are equal.
+static inline bool bytes_equal(const char* lhs, const char* rhs, std::size_t length)
+{
+    using namespace bytes_detail;
+    if (length < 16)
+        return equal_short(lhs, rhs, length);
+#ifdef  BENEDIAS_BYTES_X86_SIMD
+    if (length >= avx2_min_length && cpu_avx2())
+        return equal_avx2(lhs, rhs, length);
+    return equal_sse2(lhs, rhs, length);
+#else
+    return 0 == memcmp(lhs, rhs, length);
+#endif
+}
+
+//@brief    Compares the @a length bytes at @a lhs and @a rhs, returns a
+// value less than, equal to or greater than 0, as memcmp.
+static inline int bytes_compare(const char* lhs, const char* rhs, std::size_t length)
+{
+    using namespace bytes_detail;
+    if (length < 16)
+        return compare_short(lhs, rhs, length);
+#ifdef  BENEDIAS_BYTES_X86_SIMD
+    if (length >= avx2_min_length && cpu_avx2())
+        return compare_avx2(lhs, rhs, length);
+    return compare_sse2(lhs, rhs, length);
+#else
+    return memcmp(lhs, rhs, length);
+#endif
+}
+
+} // namespace benedias
+
+#endif // BENEDIAS_BYTES_H_INCLUDED
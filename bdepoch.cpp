@@ -0,0 +1,223 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bdepoch.h"
+
+namespace benedias {
+
+// Number of objects retired by a thread before it attempts reclamation.
+static const std::size_t reclaim_threshold = 64;
+
+struct retired_object
+{
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch;
+};
+
+// Per thread epoch state, records are never deleted, records of threads
+// which have exited are reused.
+struct alignas(64) epoch_record
+{
+    // 0 => not in a critical section, otherwise the epoch in which the
+    // critical section was entered.
+    std::atomic<uint64_t> local;
+    std::atomic<bool> in_use;
+    epoch_record* next;
+    // Only accessed by the owning thread.
+    unsigned nesting;
+    std::vector<retired_object> retired;
+
+    epoch_record():local(0),in_use(true),next(nullptr),nesting(0){}
+};
+
+static std::atomic<uint64_t> global_epoch(1);
+static std::atomic<epoch_record*> records(nullptr);
+
+// Objects retired by threads which have exited.
+static std::mutex orphans_mutex;
+static std::vector<retired_object> orphans;
+
+static thread_local epoch_record* th_record = nullptr;
+// Set once the record has been released on thread exit, a record acquired by
+// thread local destructors which run later is released when the outermost
+// epoch_guard is destroyed.
+static thread_local bool th_exited = false;
+
+static void release_record();
+
+struct record_releaser
+{
+    ~record_releaser()
+    {
+        release_record();
+    }
+};
+static thread_local record_releaser th_releaser;
+
+static epoch_record* acquire_record()
+{
+    epoch_record* rec;
+    for (rec = records.load(std::memory_order_acquire); rec; rec = rec->next)
+    {
+        bool expected = false;
+        if (!rec->in_use.load(std::memory_order_relaxed)
+                && rec->in_use.compare_exchange_strong(expected, true))
+            return rec;
+    }
+    // Records are cache line aligned, and never deleted.
+    void* mem = nullptr;
+    if (0 != posix_memalign(&mem, alignof(epoch_record), sizeof(epoch_record)))
+        throw std::bad_alloc();
+    rec = new (mem) epoch_record();
+    epoch_record* head = records.load(std::memory_order_relaxed);
+    do
+    {
+        rec->next = head;
+    } while(!records.compare_exchange_weak(head, rec,
+                std::memory_order_release, std::memory_order_relaxed));
+    return rec;
+}
+
+static inline epoch_record* thread_record()
+{
+    if (nullptr == th_record)
+    {
+        th_record = acquire_record();
+        // Ensure the record is released when the thread exits.
+        (void)&th_releaser;
+    }
+    return th_record;
+}
+
+static void release_record()
+{
+    epoch_record* rec = th_record;
+    th_exited = true;
+    if (nullptr == rec)
+        return;
+    th_record = nullptr;
+    if (!rec->retired.empty())
+    {
+        std::lock_guard<std::mutex> lockg(orphans_mutex);
+        orphans.insert(orphans.end(), rec->retired.begin(), rec->retired.end());
+        rec->retired.clear();
+    }
+    rec->nesting = 0;
+    rec->local.store(0, std::memory_order_release);
+    rec->in_use.store(false, std::memory_order_release);
+}
+
+// The epoch can be advanced only when every thread in a critical section
+// has entered it in the current epoch.
+static void try_advance()
+{
+    uint64_t epoch = global_epoch.load();
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (epoch_record* rec = records.load(std::memory_order_acquire); rec; rec = rec->next)
+    {
+        uint64_t local = rec->local.load();
+        if (local != 0 && local != epoch)
+            return;
+    }
+    global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+// Delete objects retired two or more epochs ago, objects are retired
+// in epoch order.
+static void delete_safe(std::vector<retired_object>& retired, uint64_t epoch)
+{
+    std::size_t count = 0;
+    while(count < retired.size() && retired[count].epoch + 2 <= epoch)
+    {
+        retired[count].deleter(retired[count].ptr);
+        ++count;
+    }
+    if (count)
+        retired.erase(retired.begin(), retired.begin() + count);
+}
+
+epoch_guard::epoch_guard()
+{
+    epoch_enter();
+}
+
+epoch_guard::~epoch_guard()
+{
+    epoch_leave();
+}
+
+void epoch_enter()
+{
+    epoch_record* rec = thread_record();
+    if (0 == rec->nesting++)
+    {
+        rec->local.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void epoch_leave()
+{
+    epoch_record* rec = th_record;
+    if (0 == --rec->nesting)
+    {
+        rec->local.store(0, std::memory_order_release);
+        if (th_exited)
+            release_record();
+    }
+}
+
+void epoch_retire(void* ptr, void (*deleter)(void*))
+{
+    if (th_exited && nullptr == th_record)
+    {
+        std::lock_guard<std::mutex> lockg(orphans_mutex);
+        orphans.push_back({ptr, deleter, global_epoch.load()});
+        return;
+    }
+    epoch_record* rec = thread_record();
+    rec->retired.push_back({ptr, deleter, global_epoch.load()});
+    if (rec->retired.size() >= reclaim_threshold)
+        epoch_reclaim();
+}
+
+void epoch_reclaim()
+{
+    epoch_record* rec = thread_record();
+    try_advance();
+    uint64_t epoch = global_epoch.load();
+    delete_safe(rec->retired, epoch);
+
+    std::unique_lock<std::mutex> lockg(orphans_mutex, std::try_to_lock);
+    if (lockg.owns_lock() && !orphans.empty())
+        delete_safe(orphans, epoch);
+}
+
+std::size_t epoch_pending()
+{
+    return thread_record()->retired.size();
+}
+
+} // namespace benedias
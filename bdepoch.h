@@ -0,0 +1,73 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Epoch based reclamation, based on
+"Practical lock-freedom, Keir Fraser"
+
+Threads reading shared data structures without locks do so within an
+epoch_guard. Objects unlinked from those data structures are retired rather
+than deleted, and are deleted once every thread which could have been reading
+them has left its epoch_guard.
+
+The rules:
+    1) pointers read within an epoch_guard must not be used after the
+    epoch_guard has been destroyed.
+    2) an epoch_guard must be destroyed by the thread which created it.
+    3) objects must be unlinked before they are retired, and retired once.
+    Long lived epoch_guards delay reclamation, they do not block other threads.
+*/
+#ifndef BENEDIAS_EPOCH_H_INCLUDED
+#define BENEDIAS_EPOCH_H_INCLUDED
+
+#include <cstddef>
+
+namespace benedias {
+
+//@brief    Enter an epoch critical section for the lifetime of the instance.
+// epoch_guards nest, only the outermost epoch_guard has any effect.
+class epoch_guard
+{
+    public:
+        epoch_guard();
+        ~epoch_guard();
+
+        // Non copyable
+        epoch_guard(const epoch_guard&) = delete;
+        epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+//@brief    Enter and leave an epoch critical section, for critical sections
+// which are not scoped, e.g. held by an iterator. Calls must be paired, and
+// nest with epoch_guards.
+void epoch_enter();
+void epoch_leave();
+
+//@brief    Defer the deletion of @a ptr using @a deleter until no thread
+// can be accessing it.
+void epoch_retire(void* ptr, void (*deleter)(void*));
+
+//@brief    Attempt to advance the epoch and delete retired objects of the
+// calling thread which are now safe to delete.
+void epoch_reclaim();
+
+//@brief    Returns the number of objects retired by the calling thread,
+// which have not yet been deleted.
+std::size_t epoch_pending();
+
+} // namespace benedias
+
+#endif // BENEDIAS_EPOCH_H_INCLUDED
@@ -0,0 +1,669 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Hash functions of byte strings, for use as the hash policy of the string
+directory, see BENEDIAS_MEMDB_DBSTRING_HASH.
+
+A hash policy is a default constructible type with
+    std::size_t operator()(const char* chars, std::size_t length) const
+    static void hash_many(const char* const* chars, const std::size_t* lengths,
+            std::size_t count, std::size_t* hashes)
+hash_many hashes count independent strings, for bulk interning, and may
+hash several strings at once, its results are those of operator().
+
+lookup3_hash    Bob Jenkins' lookup3, 12 bytes per round, see lookup3.c.
+                hash_many hashes 8 or 4 strings at once in 32 bit SIMD lanes,
+                using AVX2 or SSE4.2 if the CPU supports them.
+wyhash          Wang Yi's wyhash (final version 4), 48 bytes per round
+                using 64x64->128 bit multiplies, public domain.
+xxhash64        Yann Collet's XXH64, 32 bytes per round, BSD licensed
+                algorithm, reimplemented here.
+SIMD instruction sets before AVX-512 have no 64 bit multiplies, so wyhash
+and xxhash64 hash_many hash one string at a time.
+*/
+#ifndef BENEDIAS_HASH_H_INCLUDED
+#define BENEDIAS_HASH_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#include "lookup3.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BENEDIAS_HASH_X86_LANES
+#endif
+
+namespace benedias {
+
+namespace hash_detail {
+
+constexpr uint64_t rotl64(uint64_t v, unsigned bits)
+{
+    return (v << bits) | (v >> (64 - bits));
+}
+
+constexpr uint32_t rotl32(uint32_t v, unsigned bits)
+{
+    return (v << bits) | (v >> (32 - bits));
+}
+
+// Reads of the hash functions, runtime_reader for hashing at run time, and
+// constexpr_reader for hashing literals at compile time, which reads bytes
+// in the byte order of the target so the hash values are the same.
+struct runtime_reader
+{
+    static inline uint64_t byte(const char* ptr, std::size_t ix)
+    {
+        return uint8_t(ptr[ix]);
+    }
+
+    static inline uint64_t read64(const char* ptr)
+    {
+        uint64_t v;
+        memcpy(&v, ptr, sizeof(v));
+        return v;
+    }
+
+    static inline uint64_t read32(const char* ptr)
+    {
+        uint32_t v;
+        memcpy(&v, ptr, sizeof(v));
+        return v;
+    }
+};
+
+struct constexpr_reader
+{
+    static constexpr uint64_t byte(const char* ptr, std::size_t ix)
+    {
+        return uint8_t(ptr[ix]);
+    }
+
+    static constexpr uint64_t read(const char* ptr, unsigned size)
+    {
+        uint64_t v = 0;
+        for(unsigned ix = 0; ix < size; ++ix)
+        {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            v |= byte(ptr, ix) << (8 * (size - 1 - ix));
+#else
+            v |= byte(ptr, ix) << (8 * ix);
+#endif
+        }
+        return v;
+    }
+
+    static constexpr uint64_t read64(const char* ptr)
+    {
+        return read(ptr, 8);
+    }
+
+    static constexpr uint64_t read32(const char* ptr)
+    {
+        return read(ptr, 4);
+    }
+};
+
+template <typename H> static void hash_each(const char* const* chars, const std::size_t* lengths,
+        std::size_t count, std::size_t* hashes)
+{
+    H hash;
+    for(std::size_t ix = 0; ix < count; ++ix)
+        hashes[ix] = hash(chars[ix], lengths[ix]);
+}
+
+// lookup3 in lanes, the result of a lane is that of lkp3_hash2 with the
+// initial values used by lookup3_hash, see lkp3_hashlittle2 in lookup3.c.
+// A lane mixes 12 byte blocks while more than 12 bytes remain, then adds the
+// zero padded last block of 1 to 12 bytes and applies the final mix, an
+// empty string has neither. Lanes with fewer blocks keep their state while
+// the other lanes mix.
+static const uint32_t lookup3_pc = 47;
+static const uint32_t lookup3_pb = 13;
+
+static inline uint32_t lookup3_blocks(std::size_t length)
+{
+    return length > 12 ? uint32_t((length - 1) / 12) : 0;
+}
+
+static inline uint32_t lookup3_read32(const char* ptr)
+{
+    uint32_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return v;
+}
+
+// The words of the last block, of 0 to 12 bytes, zero padded, read with
+// loads of 4 bytes which overlap rather than byte by byte.
+static inline void lookup3_last(const char* ptr, std::size_t length,
+        uint32_t& k0, uint32_t& k1, uint32_t& k2)
+{
+    const unsigned char* uptr = reinterpret_cast<const unsigned char*>(ptr);
+    if (length >= 8)
+    {
+        k0 = lookup3_read32(ptr);
+        k1 = lookup3_read32(ptr + 4);
+        k2 = uint32_t(uint64_t(lookup3_read32(ptr + length - 4)) >> (8 * (12 - length)));
+    }
+    else if (length >= 4)
+    {
+        k0 = lookup3_read32(ptr);
+        k1 = uint32_t(uint64_t(lookup3_read32(ptr + length - 4)) >> (8 * (8 - length)));
+        k2 = 0;
+    }
+    else
+    {
+        k0 = length ? uptr[0] | (uint32_t(uptr[length >> 1]) << 8 * (length >> 1))
+            | (uint32_t(uptr[length - 1]) << 8 * (length - 1)) : 0;
+        k1 = 0;
+        k2 = 0;
+    }
+}
+
+// The words of a block of each lane, for the SIMD kernels.
+template <unsigned N> struct lookup3_lanes
+{
+    alignas(32) uint32_t k0[N];
+    alignas(32) uint32_t k1[N];
+    alignas(32) uint32_t k2[N];
+    // All ones for the lanes using the block.
+    alignas(32) uint32_t active[N];
+    uint32_t blocks[N];
+    uint32_t max_blocks;
+
+    lookup3_lanes(const std::size_t* lengths):max_blocks(0)
+    {
+        for(unsigned lx = 0; lx < N; ++lx)
+        {
+            blocks[lx] = lookup3_blocks(lengths[lx]);
+            if (blocks[lx] > max_blocks)
+                max_blocks = blocks[lx];
+        }
+    }
+
+    // A block which is mixed, always 12 bytes, for lanes which have it.
+    void gather(const char* const* chars, uint32_t block)
+    {
+        for(unsigned lx = 0; lx < N; ++lx)
+        {
+            if (block < blocks[lx])
+            {
+                const char* ptr = chars[lx] + std::size_t(block) * 12;
+                memcpy(&k0[lx], ptr, 4);
+                memcpy(&k1[lx], ptr + 4, 4);
+                memcpy(&k2[lx], ptr + 8, 4);
+                active[lx] = ~0u;
+            }
+            else
+            {
+                k0[lx] = k1[lx] = k2[lx] = 0;
+                active[lx] = 0;
+            }
+        }
+    }
+
+    // The zero padded last block, of 1 to 12 bytes, for non empty lanes.
+    void gather_last(const char* const* chars, const std::size_t* lengths)
+    {
+        for(unsigned lx = 0; lx < N; ++lx)
+        {
+            std::size_t offset = std::size_t(blocks[lx]) * 12;
+            lookup3_last(chars[lx] + offset, lengths[lx] - offset, k0[lx], k1[lx], k2[lx]);
+            active[lx] = lengths[lx] ? ~0u : 0;
+        }
+    }
+};
+
+#ifdef  BENEDIAS_HASH_X86_LANES
+#define BENEDIAS_LKP3_ROT256(x, k) _mm256_or_si256(_mm256_slli_epi32(x, k), _mm256_srli_epi32(x, 32 - (k)))
+#define BENEDIAS_LKP3_ROT128(x, k) _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - (k)))
+
+__attribute__((target("avx2")))
+static void lookup3_hash8(const char* const* chars, const std::size_t* lengths, std::size_t* hashes)
+{
+    lookup3_lanes<8> lanes(lengths);
+    alignas(32) uint32_t init[8];
+    for(unsigned lx = 0; lx < 8; ++lx)
+        init[lx] = 0xdeadbeef + uint32_t(lengths[lx]) + lookup3_pc;
+    __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(init));
+    __m256i b = a;
+    __m256i c = _mm256_add_epi32(a, _mm256_set1_epi32(lookup3_pb));
+    for(uint32_t block = 0; block <= lanes.max_blocks; ++block)
+    {
+        bool mixing = block < lanes.max_blocks;
+        if (mixing)
+            lanes.gather(chars, block);
+        else
+            lanes.gather_last(chars, lengths);
+        __m256i x = _mm256_add_epi32(a, _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.k0)));
+        __m256i y = _mm256_add_epi32(b, _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.k1)));
+        __m256i z = _mm256_add_epi32(c, _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.k2)));
+        if (mixing)
+        {
+            // mix(x,y,z)
+            x = _mm256_sub_epi32(x, z); x = _mm256_xor_si256(x, BENEDIAS_LKP3_ROT256(z, 4)); z = _mm256_add_epi32(z, y);
+            y = _mm256_sub_epi32(y, x); y = _mm256_xor_si256(y, BENEDIAS_LKP3_ROT256(x, 6)); x = _mm256_add_epi32(x, z);
+            z = _mm256_sub_epi32(z, y); z = _mm256_xor_si256(z, BENEDIAS_LKP3_ROT256(y, 8)); y = _mm256_add_epi32(y, x);
+            x = _mm256_sub_epi32(x, z); x = _mm256_xor_si256(x, BENEDIAS_LKP3_ROT256(z, 16)); z = _mm256_add_epi32(z, y);
+            y = _mm256_sub_epi32(y, x); y = _mm256_xor_si256(y, BENEDIAS_LKP3_ROT256(x, 19)); x = _mm256_add_epi32(x, z);
+            z = _mm256_sub_epi32(z, y); z = _mm256_xor_si256(z, BENEDIAS_LKP3_ROT256(y, 4)); y = _mm256_add_epi32(y, x);
+        }
+        else
+        {
+            // final(x,y,z)
+            z = _mm256_xor_si256(z, y); z = _mm256_sub_epi32(z, BENEDIAS_LKP3_ROT256(y, 14));
+            x = _mm256_xor_si256(x, z); x = _mm256_sub_epi32(x, BENEDIAS_LKP3_ROT256(z, 11));
+            y = _mm256_xor_si256(y, x); y = _mm256_sub_epi32(y, BENEDIAS_LKP3_ROT256(x, 25));
+            z = _mm256_xor_si256(z, y); z = _mm256_sub_epi32(z, BENEDIAS_LKP3_ROT256(y, 16));
+            x = _mm256_xor_si256(x, z); x = _mm256_sub_epi32(x, BENEDIAS_LKP3_ROT256(z, 4));
+            y = _mm256_xor_si256(y, x); y = _mm256_sub_epi32(y, BENEDIAS_LKP3_ROT256(x, 14));
+            z = _mm256_xor_si256(z, y); z = _mm256_sub_epi32(z, BENEDIAS_LKP3_ROT256(y, 24));
+        }
+        __m256i active = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.active));
+        a = _mm256_blendv_epi8(a, x, active);
+        b = _mm256_blendv_epi8(b, y, active);
+        c = _mm256_blendv_epi8(c, z, active);
+    }
+    alignas(32) uint32_t out_b[8];
+    alignas(32) uint32_t out_c[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(out_b), b);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(out_c), c);
+    for(unsigned lx = 0; lx < 8; ++lx)
+        hashes[lx] = std::size_t(out_c[lx]) | (std::size_t(out_b[lx]) << 32);
+}
+
+__attribute__((target("sse4.2")))
+static void lookup3_hash4(const char* const* chars, const std::size_t* lengths, std::size_t* hashes)
+{
+    lookup3_lanes<4> lanes(lengths);
+    alignas(16) uint32_t init[4];
+    for(unsigned lx = 0; lx < 4; ++lx)
+        init[lx] = 0xdeadbeef + uint32_t(lengths[lx]) + lookup3_pc;
+    __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(init));
+    __m128i b = a;
+    __m128i c = _mm_add_epi32(a, _mm_set1_epi32(lookup3_pb));
+    for(uint32_t block = 0; block <= lanes.max_blocks; ++block)
+    {
+        bool mixing = block < lanes.max_blocks;
+        if (mixing)
+            lanes.gather(chars, block);
+        else
+            lanes.gather_last(chars, lengths);
+        __m128i x = _mm_add_epi32(a, _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.k0)));
+        __m128i y = _mm_add_epi32(b, _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.k1)));
+        __m128i z = _mm_add_epi32(c, _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.k2)));
+        if (mixing)
+        {
+            // mix(x,y,z)
+            x = _mm_sub_epi32(x, z); x = _mm_xor_si128(x, BENEDIAS_LKP3_ROT128(z, 4)); z = _mm_add_epi32(z, y);
+            y = _mm_sub_epi32(y, x); y = _mm_xor_si128(y, BENEDIAS_LKP3_ROT128(x, 6)); x = _mm_add_epi32(x, z);
+            z = _mm_sub_epi32(z, y); z = _mm_xor_si128(z, BENEDIAS_LKP3_ROT128(y, 8)); y = _mm_add_epi32(y, x);
+            x = _mm_sub_epi32(x, z); x = _mm_xor_si128(x, BENEDIAS_LKP3_ROT128(z, 16)); z = _mm_add_epi32(z, y);
+            y = _mm_sub_epi32(y, x); y = _mm_xor_si128(y, BENEDIAS_LKP3_ROT128(x, 19)); x = _mm_add_epi32(x, z);
+            z = _mm_sub_epi32(z, y); z = _mm_xor_si128(z, BENEDIAS_LKP3_ROT128(y, 4)); y = _mm_add_epi32(y, x);
+        }
+        else
+        {
+            // final(x,y,z)
+            z = _mm_xor_si128(z, y); z = _mm_sub_epi32(z, BENEDIAS_LKP3_ROT128(y, 14));
+            x = _mm_xor_si128(x, z); x = _mm_sub_epi32(x, BENEDIAS_LKP3_ROT128(z, 11));
+            y = _mm_xor_si128(y, x); y = _mm_sub_epi32(y, BENEDIAS_LKP3_ROT128(x, 25));
+            z = _mm_xor_si128(z, y); z = _mm_sub_epi32(z, BENEDIAS_LKP3_ROT128(y, 16));
+            x = _mm_xor_si128(x, z); x = _mm_sub_epi32(x, BENEDIAS_LKP3_ROT128(z, 4));
+            y = _mm_xor_si128(y, x); y = _mm_sub_epi32(y, BENEDIAS_LKP3_ROT128(x, 14));
+            z = _mm_xor_si128(z, y); z = _mm_sub_epi32(z, BENEDIAS_LKP3_ROT128(y, 24));
+        }
+        __m128i active = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.active));
+        a = _mm_blendv_epi8(a, x, active);
+        b = _mm_blendv_epi8(b, y, active);
+        c = _mm_blendv_epi8(c, z, active);
+    }
+    alignas(16) uint32_t out_b[4];
+    alignas(16) uint32_t out_c[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(out_b), b);
+    _mm_store_si128(reinterpret_cast<__m128i*>(out_c), c);
+    for(unsigned lx = 0; lx < 4; ++lx)
+        hashes[lx] = std::size_t(out_c[lx]) | (std::size_t(out_b[lx]) << 32);
+}
+
+#undef BENEDIAS_LKP3_ROT256
+#undef BENEDIAS_LKP3_ROT128
+
+// The number of lanes supported by the CPU, 8, 4 or 1.
+static inline unsigned lookup3_cpu_lanes()
+{
+    static const unsigned lanes = []()
+        {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return 8u;
+            if (__builtin_cpu_supports("sse4.2"))
+                return 4u;
+            return 1u;
+        }();
+    return lanes;
+}
+#else
+static inline unsigned lookup3_cpu_lanes()
+{
+    return 1;
+}
+#endif
+
+// lkp3_hashlittle2 (lkp3_hashbig2 on big endian targets) for hashing literals
+// at compile time, with the initial values used by lookup3_hash.
+constexpr void lookup3_mix(uint32_t& a, uint32_t& b, uint32_t& c)
+{
+    a -= c; a ^= rotl32(c, 4); c += b;
+    b -= a; b ^= rotl32(a, 6); a += c;
+    c -= b; c ^= rotl32(b, 8); b += a;
+    a -= c; a ^= rotl32(c, 16); c += b;
+    b -= a; b ^= rotl32(a, 19); a += c;
+    c -= b; c ^= rotl32(b, 4); b += a;
+}
+
+constexpr void lookup3_final(uint32_t& a, uint32_t& b, uint32_t& c)
+{
+    c ^= b; c -= rotl32(b, 14);
+    a ^= c; a -= rotl32(c, 11);
+    b ^= a; b -= rotl32(a, 25);
+    c ^= b; c -= rotl32(b, 16);
+    a ^= c; a -= rotl32(c, 4);
+    b ^= a; b -= rotl32(a, 14);
+    c ^= b; c -= rotl32(b, 24);
+}
+
+// With two initial values the result is c and b, otherwise c.
+constexpr uint64_t lookup3_constexpr(const char* ptr, std::size_t length, bool two)
+{
+    uint32_t a = 0xdeadbeef + uint32_t(length) + lookup3_pc;
+    uint32_t b = a;
+    uint32_t c = a;
+    if (two)
+        c += lookup3_pb;
+    for(; length > 12; length -= 12, ptr += 12)
+    {
+        a += uint32_t(constexpr_reader::read32(ptr));
+        b += uint32_t(constexpr_reader::read32(ptr + 4));
+        c += uint32_t(constexpr_reader::read32(ptr + 8));
+        lookup3_mix(a, b, c);
+    }
+    if (length)
+    {
+        char last[12] = {};
+        for(std::size_t ix = 0; ix < length; ++ix)
+            last[ix] = ptr[ix];
+        a += uint32_t(constexpr_reader::read32(last));
+        b += uint32_t(constexpr_reader::read32(last + 4));
+        c += uint32_t(constexpr_reader::read32(last + 8));
+        lookup3_final(a, b, c);
+    }
+    return two ? c | (uint64_t(b) << 32) : c;
+}
+
+} // namespace hash_detail
+
+struct lookup3_hash
+{
+    std::size_t operator()(const char* chars, std::size_t length) const
+    {
+        std::size_t hashv = (std::size_t)47 + ((std::size_t)13 << 32);
+        if (sizeof(hashv) == 8)
+        {
+            uint32_t* p = (uint32_t *)&hashv;
+            lkp3_hash2(chars, length, p, p+1);
+        }
+        else
+        {
+            hashv = lkp3_hash(chars, length, 47);
+        }
+        return hashv;
+    }
+
+    //@brief    The hash of a string literal, evaluated at compile time,
+    // equal to operator().
+    static constexpr std::size_t literal_hash(const char* chars, std::size_t length)
+    {
+        if (sizeof(std::size_t) != 8)
+            return std::size_t(hash_detail::lookup3_constexpr(chars, length, false));
+        uint64_t cb = hash_detail::lookup3_constexpr(chars, length, true);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        // lkp3_hash2 writes c and b to the first and second words of the hash.
+        cb = (cb << 32) | (cb >> 32);
+#endif
+        return std::size_t(cb);
+    }
+
+    //@brief    Hash count strings using @a lanes lanes, 8, 4 or 1, lanes
+    // which the CPU does not support fall back to fewer lanes.
+    static void hash_lanes(const char* const* chars, const std::size_t* lengths,
+            std::size_t count, std::size_t* hashes, unsigned lanes)
+    {
+        using namespace hash_detail;
+        std::size_t ix = 0;
+#ifdef  BENEDIAS_HASH_X86_LANES
+        if (sizeof(std::size_t) == 8)
+        {
+            lanes = std::min(lanes, lookup3_cpu_lanes());
+            if (lanes >= 8)
+            {
+                for(; ix + 8 <= count; ix += 8)
+                    lookup3_hash8(chars + ix, lengths + ix, hashes + ix);
+            }
+            if (lanes >= 4)
+            {
+                for(; ix + 4 <= count; ix += 4)
+                    lookup3_hash4(chars + ix, lengths + ix, hashes + ix);
+            }
+        }
+#endif
+        hash_each<lookup3_hash>(chars + ix, lengths + ix, count - ix, hashes + ix);
+    }
+
+    static void hash_many(const char* const* chars, const std::size_t* lengths,
+            std::size_t count, std::size_t* hashes)
+    {
+        hash_lanes(chars, lengths, count, hashes, hash_detail::lookup3_cpu_lanes());
+    }
+};
+
+struct wyhash
+{
+    static const uint64_t p0 = 0x2d358dccaa6c78a5ull;
+    static const uint64_t p1 = 0x8bb84b93962eacc9ull;
+    static const uint64_t p2 = 0x4b33a62ed433d4a3ull;
+    static const uint64_t p3 = 0x4d5a2da51de1aa47ull;
+
+    static constexpr void mum(uint64_t& a, uint64_t& b)
+    {
+        __uint128_t r = a;
+        r *= b;
+        a = uint64_t(r);
+        b = uint64_t(r >> 64);
+    }
+
+    static constexpr uint64_t mix(uint64_t a, uint64_t b)
+    {
+        mum(a, b);
+        return a ^ b;
+    }
+
+    template <typename R> static constexpr uint64_t hash_with(const char* ptr, std::size_t length, uint64_t seed)
+    {
+        seed ^= mix(seed ^ p0, p1);
+        uint64_t a = 0;
+        uint64_t b = 0;
+        if (length <= 16)
+        {
+            if (length >= 4)
+            {
+                std::size_t quarter = (length >> 3) << 2;
+                a = (R::read32(ptr) << 32) | R::read32(ptr + quarter);
+                b = (R::read32(ptr + length - 4) << 32) | R::read32(ptr + length - 4 - quarter);
+            }
+            else if (length > 0)
+                a = (R::byte(ptr, 0) << 16) | (R::byte(ptr, length >> 1) << 8) | R::byte(ptr, length - 1);
+        }
+        else
+        {
+            std::size_t left = length;
+            if (left > 48)
+            {
+                uint64_t seed1 = seed;
+                uint64_t seed2 = seed;
+                do
+                {
+                    seed = mix(R::read64(ptr) ^ p1, R::read64(ptr + 8) ^ seed);
+                    seed1 = mix(R::read64(ptr + 16) ^ p2, R::read64(ptr + 24) ^ seed1);
+                    seed2 = mix(R::read64(ptr + 32) ^ p3, R::read64(ptr + 40) ^ seed2);
+                    ptr += 48;
+                    left -= 48;
+                } while(left > 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while(left > 16)
+            {
+                seed = mix(R::read64(ptr) ^ p1, R::read64(ptr + 8) ^ seed);
+                ptr += 16;
+                left -= 16;
+            }
+            a = R::read64(ptr + left - 16);
+            b = R::read64(ptr + left - 8);
+        }
+        a ^= p1;
+        b ^= seed;
+        mum(a, b);
+        return mix(a ^ p0 ^ length, b ^ p1);
+    }
+
+    static uint64_t hash(const void* key, std::size_t length, uint64_t seed = 0)
+    {
+        return hash_with<hash_detail::runtime_reader>(static_cast<const char*>(key), length, seed);
+    }
+
+    std::size_t operator()(const char* chars, std::size_t length) const
+    {
+        return std::size_t(hash(chars, length));
+    }
+
+    //@brief    The hash of a string literal, evaluated at compile time,
+    // equal to operator().
+    static constexpr std::size_t literal_hash(const char* chars, std::size_t length)
+    {
+        return std::size_t(hash_with<hash_detail::constexpr_reader>(chars, length, 0));
+    }
+
+    static void hash_many(const char* const* chars, const std::size_t* lengths,
+            std::size_t count, std::size_t* hashes)
+    {
+        hash_detail::hash_each<wyhash>(chars, lengths, count, hashes);
+    }
+};
+
+struct xxhash64
+{
+    static const uint64_t prime1 = 11400714785074694791ull;
+    static const uint64_t prime2 = 14029467366897019727ull;
+    static const uint64_t prime3 = 1609587929392839161ull;
+    static const uint64_t prime4 = 9650029242287828579ull;
+    static const uint64_t prime5 = 2870177450012600261ull;
+
+    static constexpr uint64_t round(uint64_t acc, uint64_t input)
+    {
+        return hash_detail::rotl64(acc + input * prime2, 31) * prime1;
+    }
+
+    static constexpr uint64_t merge(uint64_t acc, uint64_t v)
+    {
+        return (acc ^ round(0, v)) * prime1 + prime4;
+    }
+
+    template <typename R> static constexpr uint64_t hash_with(const char* ptr, std::size_t length, uint64_t seed)
+    {
+        using hash_detail::rotl64;
+        const char* end = ptr + length;
+        uint64_t h = 0;
+        if (length >= 32)
+        {
+            uint64_t v1 = seed + prime1 + prime2;
+            uint64_t v2 = seed + prime2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - prime1;
+            do
+            {
+                v1 = round(v1, R::read64(ptr));
+                v2 = round(v2, R::read64(ptr + 8));
+                v3 = round(v3, R::read64(ptr + 16));
+                v4 = round(v4, R::read64(ptr + 24));
+                ptr += 32;
+            } while(end - ptr >= 32);
+            h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        }
+        else
+            h = seed + prime5;
+        h += length;
+        for(; end - ptr >= 8; ptr += 8)
+            h = rotl64(h ^ round(0, R::read64(ptr)), 27) * prime1 + prime4;
+        if (end - ptr >= 4)
+        {
+            h = rotl64(h ^ (R::read32(ptr) * prime1), 23) * prime2 + prime3;
+            ptr += 4;
+        }
+        for(; ptr != end; ++ptr)
+            h = rotl64(h ^ (R::byte(ptr, 0) * prime5), 11) * prime1;
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static uint64_t hash(const void* key, std::size_t length, uint64_t seed = 0)
+    {
+        return hash_with<hash_detail::runtime_reader>(static_cast<const char*>(key), length, seed);
+    }
+
+    std::size_t operator()(const char* chars, std::size_t length) const
+    {
+        return std::size_t(hash(chars, length));
+    }
+
+    //@brief    The hash of a string literal, evaluated at compile time,
+    // equal to operator().
+    static constexpr std::size_t literal_hash(const char* chars, std::size_t length)
+    {
+        return std::size_t(hash_with<hash_detail::constexpr_reader>(chars, length, 0));
+    }
+
+    static void hash_many(const char* const* chars, const std::size_t* lengths,
+            std::size_t count, std::size_t* hashes)
+    {
+        hash_detail::hash_each<xxhash64>(chars, lengths, count, hashes);
+    }
+};
+
+} // namespace benedias
+
+#endif // BENEDIAS_HASH_H_INCLUDED
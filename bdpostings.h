@@ -0,0 +1,177 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Compressed posting list, an ascending list of 32 bit ids, for inverted
+indexes.
+
+Ids are appended in ascending order and stored as variable length encoded
+deltas, in blocks of block_size ids. The first id of each block is kept in
+a skip table, so intersections skip blocks without decoding them.
+
+Not thread safe, access must be serialised by the caller.
+*/
+#ifndef BENEDIAS_POSTINGS_H_INCLUDED
+#define BENEDIAS_POSTINGS_H_INCLUDED
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+namespace benedias {
+
+class posting_list
+{
+    private:
+        static const unsigned block_size = 128;
+
+        struct block
+        {
+            // The first id of the block, which is not in bytes.
+            uint32_t first;
+            // Offset in bytes of the deltas of the following ids.
+            uint32_t offset;
+        };
+
+        std::vector<uint8_t> bytes;
+        std::vector<block> blocks;
+        uint32_t count = 0;
+        uint32_t last = 0;
+
+        static const uint8_t* decode(const uint8_t* ptr, uint32_t& delta)
+        {
+            uint32_t value = 0;
+            unsigned shift = 0;
+            while(*ptr & 0x80)
+            {
+                value |= uint32_t(*ptr++ & 0x7f) << shift;
+                shift += 7;
+            }
+            delta = value | (uint32_t(*ptr++) << shift);
+            return ptr;
+        }
+
+        // Number of ids in block ix.
+        uint32_t block_count(std::size_t ix) const
+        {
+            return ix + 1 < blocks.size() ? block_size : count - ix * block_size;
+        }
+
+    public:
+        //@brief    Append @a id, which must not be less than the last id
+        // appended, returns false if @a id is the last id.
+        bool append(uint32_t id)
+        {
+            if (count && id == last)
+                return false;
+            if (0 == count % block_size)
+                blocks.push_back(block{id, uint32_t(bytes.size())});
+            else
+            {
+                uint32_t delta = id - last;
+                while(delta >= 0x80)
+                {
+                    bytes.push_back(uint8_t(delta | 0x80));
+                    delta >>= 7;
+                }
+                bytes.push_back(uint8_t(delta));
+            }
+            last = id;
+            ++count;
+            return true;
+        }
+
+        std::size_t size() const
+        {
+            return count;
+        }
+
+        //@brief    Returns the number of bytes used by the encoded ids.
+        std::size_t memory() const
+        {
+            return bytes.capacity() + blocks.capacity() * sizeof(block);
+        }
+
+        //@brief    Call @a f for each id in ascending order.
+        template <typename F> void visit(F f) const
+        {
+            for(std::size_t bx = 0; bx < blocks.size(); ++bx)
+            {
+                uint32_t id = blocks[bx].first;
+                const uint8_t* ptr = bytes.data() + blocks[bx].offset;
+                f(id);
+                for(uint32_t n = block_count(bx); n > 1; --n)
+                {
+                    uint32_t delta;
+                    ptr = decode(ptr, delta);
+                    id += delta;
+                    f(id);
+                }
+            }
+        }
+
+        //@brief    Remove the ids in @a ids, which must be ascending, that
+        // are not in this list.
+        void intersect(std::vector<uint32_t>& ids) const
+        {
+            std::size_t out = 0;
+            std::size_t in = 0;
+            std::size_t bx = 0;
+            while(in < ids.size() && bx < blocks.size())
+            {
+                uint32_t target = ids[in];
+                // Skip blocks which end before the target.
+                while(bx + 1 < blocks.size() && blocks[bx + 1].first <= target)
+                    ++bx;
+                uint32_t id = blocks[bx].first;
+                const uint8_t* ptr = bytes.data() + blocks[bx].offset;
+                uint32_t n = block_count(bx);
+                // Merge the ids of the block with the targets.
+                while(true)
+                {
+                    if (id == target)
+                        ids[out++] = target;
+                    if (id >= target)
+                    {
+                        if (++in == ids.size())
+                            break;
+                        target = ids[in];
+                        if (id >= target)
+                            continue;
+                        if (bx + 1 < blocks.size() && blocks[bx + 1].first <= target)
+                            break;
+                    }
+                    if (0 == --n)
+                        break;
+                    uint32_t delta;
+                    ptr = decode(ptr, delta);
+                    id += delta;
+                }
+                if (0 == n)
+                {
+                    // Targets before the next block are not in the list.
+                    ++bx;
+                    while(in < ids.size() && bx < blocks.size() && ids[in] < blocks[bx].first)
+                        ++in;
+                }
+            }
+            ids.resize(out);
+        }
+};
+
+} // namespace benedias
+
+#endif // BENEDIAS_POSTINGS_H_INCLUDED
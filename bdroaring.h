@@ -0,0 +1,441 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Compressed bitmap of 32 bit ids, in the manner of roaring bitmaps.
+
+Ids are partitioned by their high 16 bits into containers, held in
+ascending order of the high bits. A container holds the low 16 bits of its
+ids either as a sorted array, while it has at most array_max ids, or as a
+bitmap of 65536 bits. Sparse sets cost 2 bytes per id and dense sets 1 bit
+per id, and intersections, unions and differences combine containers with
+matching high bits only.
+
+Not thread safe, access must be serialised by the caller.
+*/
+#ifndef BENEDIAS_ROARING_H_INCLUDED
+#define BENEDIAS_ROARING_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace benedias {
+
+class roaring_bitmap
+{
+    private:
+        // Beyond array_max ids a bitmap is smaller than an array.
+        static const unsigned array_max = 4096;
+        static const unsigned container_words = 65536 / 64;
+
+        struct container
+        {
+            uint16_t key;
+            // Number of ids.
+            uint32_t count;
+            // Sorted low bits, while count <= array_max.
+            std::vector<uint16_t> array;
+            // container_words words, while count > array_max.
+            std::vector<uint64_t> words;
+
+            bool is_bitmap() const
+            {
+                return !words.empty();
+            }
+
+            bool contains(uint16_t low) const
+            {
+                if (is_bitmap())
+                    return words[low >> 6] & (uint64_t(1) << (low & 63));
+                return std::binary_search(array.begin(), array.end(), low);
+            }
+
+            void to_bitmap()
+            {
+                words.assign(container_words, 0);
+                for(uint16_t low: array)
+                    words[low >> 6] |= uint64_t(1) << (low & 63);
+                std::vector<uint16_t>().swap(array);
+            }
+
+            void to_array()
+            {
+                array.clear();
+                array.reserve(count);
+                for(unsigned wx = 0; wx < container_words; ++wx)
+                {
+                    for(uint64_t word = words[wx]; word; word &= word - 1)
+                        array.push_back(uint16_t(wx * 64 + __builtin_ctzll(word)));
+                }
+                std::vector<uint64_t>().swap(words);
+            }
+
+            // Recount and pick the smaller representation after a
+            // combination.
+            void normalise()
+            {
+                if (is_bitmap())
+                {
+                    count = 0;
+                    for(uint64_t word: words)
+                        count += __builtin_popcountll(word);
+                    if (count <= array_max)
+                        to_array();
+                }
+                else
+                {
+                    count = uint32_t(array.size());
+                    if (count > array_max)
+                        to_bitmap();
+                }
+            }
+
+            void intersect(const container& other)
+            {
+                if (is_bitmap() && other.is_bitmap())
+                {
+                    for(unsigned wx = 0; wx < container_words; ++wx)
+                        words[wx] &= other.words[wx];
+                }
+                else if (is_bitmap())
+                {
+                    std::vector<uint16_t> both;
+                    for(uint16_t low: other.array)
+                    {
+                        if (contains(low))
+                            both.push_back(low);
+                    }
+                    std::vector<uint64_t>().swap(words);
+                    array.swap(both);
+                }
+                else if (other.is_bitmap())
+                {
+                    array.erase(std::remove_if(array.begin(), array.end(),
+                                [&other](uint16_t low) { return !other.contains(low); }),
+                            array.end());
+                }
+                else
+                {
+                    std::vector<uint16_t> both;
+                    std::set_intersection(array.begin(), array.end(),
+                            other.array.begin(), other.array.end(),
+                            std::back_inserter(both));
+                    array.swap(both);
+                }
+                normalise();
+            }
+
+            void unite(const container& other)
+            {
+                if (!is_bitmap() && !other.is_bitmap())
+                {
+                    std::vector<uint16_t> either;
+                    either.reserve(array.size() + other.array.size());
+                    std::set_union(array.begin(), array.end(),
+                            other.array.begin(), other.array.end(),
+                            std::back_inserter(either));
+                    array.swap(either);
+                }
+                else
+                {
+                    if (!is_bitmap())
+                        to_bitmap();
+                    if (other.is_bitmap())
+                    {
+                        for(unsigned wx = 0; wx < container_words; ++wx)
+                            words[wx] |= other.words[wx];
+                    }
+                    else
+                    {
+                        for(uint16_t low: other.array)
+                            words[low >> 6] |= uint64_t(1) << (low & 63);
+                    }
+                }
+                normalise();
+            }
+
+            void subtract(const container& other)
+            {
+                if (is_bitmap() && other.is_bitmap())
+                {
+                    for(unsigned wx = 0; wx < container_words; ++wx)
+                        words[wx] &= ~other.words[wx];
+                }
+                else if (is_bitmap())
+                {
+                    for(uint16_t low: other.array)
+                        words[low >> 6] &= ~(uint64_t(1) << (low & 63));
+                }
+                else if (other.is_bitmap())
+                {
+                    array.erase(std::remove_if(array.begin(), array.end(),
+                                [&other](uint16_t low) { return other.contains(low); }),
+                            array.end());
+                }
+                else
+                {
+                    std::vector<uint16_t> left;
+                    std::set_difference(array.begin(), array.end(),
+                            other.array.begin(), other.array.end(),
+                            std::back_inserter(left));
+                    array.swap(left);
+                }
+                normalise();
+            }
+        };
+
+        // Ascending keys, no empty containers.
+        std::vector<container> containers;
+
+        std::vector<container>::iterator find_container(uint16_t key)
+        {
+            return std::lower_bound(containers.begin(), containers.end(), key,
+                    [](const container& c, uint16_t k) { return c.key < k; });
+        }
+
+        std::vector<container>::const_iterator find_container(uint16_t key) const
+        {
+            return std::lower_bound(containers.begin(), containers.end(), key,
+                    [](const container& c, uint16_t k) { return c.key < k; });
+        }
+
+    public:
+        //@brief    Add @a id, returns false if @a id is already present.
+        bool add(uint32_t id)
+        {
+            uint16_t key = uint16_t(id >> 16);
+            uint16_t low = uint16_t(id);
+            auto itr = find_container(key);
+            if (itr == containers.end() || itr->key != key)
+            {
+                itr = containers.insert(itr, container());
+                itr->key = key;
+                itr->count = 0;
+            }
+            if (itr->is_bitmap())
+            {
+                uint64_t& word = itr->words[low >> 6];
+                uint64_t bit = uint64_t(1) << (low & 63);
+                if (word & bit)
+                    return false;
+                word |= bit;
+            }
+            else
+            {
+                auto pos = std::lower_bound(itr->array.begin(), itr->array.end(), low);
+                if (pos != itr->array.end() && *pos == low)
+                    return false;
+                itr->array.insert(pos, low);
+                if (itr->array.size() > array_max)
+                    itr->to_bitmap();
+            }
+            ++itr->count;
+            return true;
+        }
+
+        //@brief    Remove @a id, returns false if @a id is not present.
+        bool remove(uint32_t id)
+        {
+            uint16_t key = uint16_t(id >> 16);
+            uint16_t low = uint16_t(id);
+            auto itr = find_container(key);
+            if (itr == containers.end() || itr->key != key || !itr->contains(low))
+                return false;
+            if (itr->is_bitmap())
+            {
+                itr->words[low >> 6] &= ~(uint64_t(1) << (low & 63));
+                if (--itr->count <= array_max)
+                    itr->to_array();
+            }
+            else
+            {
+                itr->array.erase(std::lower_bound(itr->array.begin(), itr->array.end(), low));
+                if (0 == --itr->count)
+                    containers.erase(itr);
+            }
+            return true;
+        }
+
+        bool contains(uint32_t id) const
+        {
+            uint16_t key = uint16_t(id >> 16);
+            auto itr = find_container(key);
+            return itr != containers.end() && itr->key == key && itr->contains(uint16_t(id));
+        }
+
+        std::size_t size() const
+        {
+            std::size_t count = 0;
+            for(const container& c: containers)
+                count += c.count;
+            return count;
+        }
+
+        bool empty() const
+        {
+            return containers.empty();
+        }
+
+        void clear()
+        {
+            std::vector<container>().swap(containers);
+        }
+
+        //@brief    Returns the number of bytes used by the containers.
+        std::size_t memory() const
+        {
+            std::size_t bytes = containers.capacity() * sizeof(container);
+            for(const container& c: containers)
+                bytes += c.array.capacity() * sizeof(uint16_t) + c.words.capacity() * sizeof(uint64_t);
+            return bytes;
+        }
+
+        //@brief    Set @a id to the least id present which is not less than
+        // @a id, returns false if there is none.
+        bool next(uint32_t& id) const
+        {
+            uint16_t key = uint16_t(id >> 16);
+            for(auto itr = find_container(key); itr != containers.end(); ++itr)
+            {
+                uint32_t from = itr->key == key ? (id & 0xffff) : 0;
+                uint32_t high = uint32_t(itr->key) << 16;
+                if (itr->is_bitmap())
+                {
+                    unsigned wx = from >> 6;
+                    uint64_t word = itr->words[wx] & (~uint64_t(0) << (from & 63));
+                    while(true)
+                    {
+                        if (word)
+                        {
+                            id = high | (wx * 64 + __builtin_ctzll(word));
+                            return true;
+                        }
+                        if (++wx == container_words)
+                            break;
+                        word = itr->words[wx];
+                    }
+                }
+                else
+                {
+                    auto pos = std::lower_bound(itr->array.begin(), itr->array.end(), uint16_t(from));
+                    if (pos != itr->array.end())
+                    {
+                        id = high | *pos;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        //@brief    Call @a f for each id in ascending order.
+        template <typename F> void visit(F f) const
+        {
+            for(const container& c: containers)
+            {
+                uint32_t high = uint32_t(c.key) << 16;
+                if (c.is_bitmap())
+                {
+                    for(unsigned wx = 0; wx < container_words; ++wx)
+                    {
+                        for(uint64_t word = c.words[wx]; word; word &= word - 1)
+                            f(high | (wx * 64 + __builtin_ctzll(word)));
+                    }
+                }
+                else
+                {
+                    for(uint16_t low: c.array)
+                        f(high | low);
+                }
+            }
+        }
+
+        //@brief    Remove the ids which are not in @a other.
+        void intersect(const roaring_bitmap& other)
+        {
+            auto out = containers.begin();
+            auto theirs = other.containers.begin();
+            for(auto itr = containers.begin(); itr != containers.end(); ++itr)
+            {
+                while(theirs != other.containers.end() && theirs->key < itr->key)
+                    ++theirs;
+                if (theirs == other.containers.end())
+                    break;
+                if (theirs->key != itr->key)
+                    continue;
+                itr->intersect(*theirs);
+                if (itr->count)
+                {
+                    if (out != itr)
+                        *out = std::move(*itr);
+                    ++out;
+                }
+            }
+            containers.erase(out, containers.end());
+        }
+
+        //@brief    Add the ids in @a other.
+        void unite(const roaring_bitmap& other)
+        {
+            std::vector<container> either;
+            either.reserve(containers.size() + other.containers.size());
+            auto mine = containers.begin();
+            auto theirs = other.containers.begin();
+            while(mine != containers.end() || theirs != other.containers.end())
+            {
+                if (theirs == other.containers.end()
+                        || (mine != containers.end() && mine->key < theirs->key))
+                    either.push_back(std::move(*mine++));
+                else if (mine == containers.end() || theirs->key < mine->key)
+                    either.push_back(*theirs++);
+                else
+                {
+                    mine->unite(*theirs++);
+                    either.push_back(std::move(*mine++));
+                }
+            }
+            containers.swap(either);
+        }
+
+        //@brief    Remove the ids in @a other.
+        void subtract(const roaring_bitmap& other)
+        {
+            auto out = containers.begin();
+            auto theirs = other.containers.begin();
+            for(auto itr = containers.begin(); itr != containers.end(); ++itr)
+            {
+                while(theirs != other.containers.end() && theirs->key < itr->key)
+                    ++theirs;
+                if (theirs != other.containers.end() && theirs->key == itr->key)
+                    itr->subtract(*theirs);
+                if (itr->count)
+                {
+                    if (out != itr)
+                        *out = std::move(*itr);
+                    ++out;
+                }
+            }
+            containers.erase(out, containers.end());
+        }
+};
+
+} // namespace benedias
+
+#endif // BENEDIAS_ROARING_H_INCLUDED
@@ -0,0 +1,418 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "bdslab.h"
+
+namespace benedias {
+
+// Size classes, tuned for strings of up to a few dozen characters
+// (names, titles, tags) with coarser classes for paths.
+static constexpr uint16_t class_sizes[] = {
+    16, 24, 32, 40, 48, 56, 64,
+    80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512
+};
+static const unsigned class_count = sizeof(class_sizes)/sizeof(class_sizes[0]);
+static_assert(class_sizes[class_count - 1] == slab_max_size, "largest size class must be slab_max_size");
+
+// Maps (size + 7)/8 to a size class.
+struct class_index
+{
+    uint8_t index[slab_max_size/8 + 1];
+
+    constexpr class_index():index{}
+    {
+        unsigned c = 0;
+        for(unsigned ix = 0; ix <= slab_max_size/8; ++ix)
+        {
+            while(class_sizes[c] < ix * 8)
+                ++c;
+            index[ix] = c;
+        }
+    }
+};
+static constexpr class_index classes;
+
+static inline unsigned class_of(std::size_t size)
+{
+    return classes.index[(size + 7) >> 3];
+}
+
+static const std::size_t region_size = std::size_t(2) << 20;
+// Objects per magazine, magazines are refilled and flushed half at a time.
+static const unsigned magazine_size = 32;
+static const unsigned batch_size = magazine_size / 2;
+
+struct free_object
+{
+    free_object* next;
+};
+
+// Free list of a size class.
+struct alignas(64) size_class
+{
+    std::mutex lock;
+    free_object* free_list = nullptr;
+    std::size_t free_count = 0;
+    // Objects carved from regions.
+    std::size_t carved_count = 0;
+};
+static size_class central[class_count];
+
+// Current region, objects are carved out of it sequentially.
+static std::mutex region_lock;
+static char* region_next = nullptr;
+static char* region_end = nullptr;
+static std::atomic<std::size_t> mapped_bytes(0);
+static std::atomic<std::size_t> carved_bytes(0);
+static std::atomic<std::size_t> hugetlb_regions(0);
+static std::atomic<std::size_t> large_objects(0);
+static std::atomic<std::size_t> large_bytes(0);
+
+static void* map_region()
+{
+#if BENEDIAS_SLAB_HUGE_PAGES == 2
+    void* mem = mmap(nullptr, region_size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (MAP_FAILED != mem)
+    {
+        ++hugetlb_regions;
+        return mem;
+    }
+#endif
+#if BENEDIAS_SLAB_HUGE_PAGES >= 1
+    // Transparent huge pages are only used for huge page aligned memory,
+    // so map twice the size and trim to an aligned region.
+    char* raw = static_cast<char*>(mmap(nullptr, region_size * 2, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0));
+    if (MAP_FAILED == raw)
+        throw std::bad_alloc();
+    char* aligned = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(raw) + region_size - 1) & ~(region_size - 1));
+    if (aligned != raw)
+        munmap(raw, aligned - raw);
+    munmap(aligned + region_size, raw + region_size * 2 - (aligned + region_size));
+    madvise(aligned, region_size, MADV_HUGEPAGE);
+    return aligned;
+#else
+    void* mem = mmap(nullptr, region_size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == mem)
+        throw std::bad_alloc();
+    return mem;
+#endif
+}
+
+// Carve up to @a count objects of size class @a c from regions, with the
+// size class lock held. Returns a list of the objects carved.
+static free_object* carve(unsigned c, unsigned count, unsigned& carved)
+{
+    std::size_t size = class_sizes[c];
+    std::lock_guard<std::mutex> lockg(region_lock);
+    if (std::size_t(region_end - region_next) < size)
+    {
+        // The tail of the old region, smaller than the object, is abandoned.
+        region_next = static_cast<char*>(map_region());
+        region_end = region_next + region_size;
+        mapped_bytes += region_size;
+    }
+    carved = std::min<std::size_t>(count, (region_end - region_next) / size);
+    free_object* head = nullptr;
+    for(unsigned ix = 0; ix < carved; ++ix)
+    {
+        free_object* obj = reinterpret_cast<free_object*>(region_next);
+        region_next += size;
+        obj->next = head;
+        head = obj;
+    }
+    carved_bytes += carved * size;
+    central[c].carved_count += carved;
+    return head;
+}
+
+// Take up to @a count objects of size class @a c from the free list,
+// carving more if necessary.
+static unsigned central_take(unsigned c, void** items, unsigned count)
+{
+    size_class& sc = central[c];
+    std::lock_guard<std::mutex> lockg(sc.lock);
+    if (nullptr == sc.free_list)
+    {
+        unsigned carved;
+        sc.free_list = carve(c, count, carved);
+        sc.free_count += carved;
+    }
+    unsigned taken = 0;
+    while(taken < count && sc.free_list)
+    {
+        items[taken++] = sc.free_list;
+        sc.free_list = sc.free_list->next;
+    }
+    sc.free_count -= taken;
+    return taken;
+}
+
+// Return @a count objects of size class @a c to the free list.
+static void central_give(unsigned c, void* const* items, unsigned count)
+{
+    if (0 == count)
+        return;
+    // Link the objects before taking the lock.
+    for(unsigned ix = 0; ix + 1 < count; ++ix)
+        static_cast<free_object*>(items[ix])->next = static_cast<free_object*>(items[ix + 1]);
+    free_object* last = static_cast<free_object*>(items[count - 1]);
+    size_class& sc = central[c];
+    std::lock_guard<std::mutex> lockg(sc.lock);
+    last->next = sc.free_list;
+    sc.free_list = static_cast<free_object*>(items[0]);
+    sc.free_count += count;
+}
+
+struct magazine
+{
+    // Only modified by the owning thread, read by slab_get_stats.
+    std::atomic<unsigned> count;
+    void* items[magazine_size];
+};
+
+// Per thread caches are never deleted, caches of threads which have
+// exited are reused.
+struct alignas(64) thread_cache
+{
+    std::atomic<bool> in_use;
+    thread_cache* next;
+    magazine magazines[class_count];
+
+    thread_cache():in_use(true),next(nullptr)
+    {
+        for(unsigned c = 0; c < class_count; ++c)
+            magazines[c].count.store(0, std::memory_order_relaxed);
+    }
+};
+
+static std::atomic<thread_cache*> caches(nullptr);
+static thread_local thread_cache* th_cache = nullptr;
+// Set once the thread cache has been released on thread exit, objects freed
+// by thread local destructors which run later go to the free lists directly.
+static thread_local bool th_exited = false;
+
+static void release_cache();
+
+struct cache_releaser
+{
+    ~cache_releaser()
+    {
+        release_cache();
+    }
+};
+static thread_local cache_releaser th_releaser;
+
+static thread_cache* acquire_cache()
+{
+    thread_cache* tc;
+    for (tc = caches.load(std::memory_order_acquire); tc; tc = tc->next)
+    {
+        bool expected = false;
+        if (!tc->in_use.load(std::memory_order_relaxed)
+                && tc->in_use.compare_exchange_strong(expected, true))
+            return tc;
+    }
+    void* mem = nullptr;
+    if (0 != posix_memalign(&mem, alignof(thread_cache), sizeof(thread_cache)))
+        throw std::bad_alloc();
+    tc = new (mem) thread_cache();
+    thread_cache* head = caches.load(std::memory_order_relaxed);
+    do
+    {
+        tc->next = head;
+    } while(!caches.compare_exchange_weak(head, tc,
+                std::memory_order_release, std::memory_order_relaxed));
+    return tc;
+}
+
+static inline thread_cache* get_cache()
+{
+    if (nullptr == th_cache && !th_exited)
+    {
+        th_cache = acquire_cache();
+        // Ensure the cache is released when the thread exits.
+        (void)&th_releaser;
+    }
+    return th_cache;
+}
+
+static void release_cache()
+{
+    thread_cache* tc = th_cache;
+    th_exited = true;
+    if (nullptr == tc)
+        return;
+    th_cache = nullptr;
+    for(unsigned c = 0; c < class_count; ++c)
+    {
+        magazine& mag = tc->magazines[c];
+        central_give(c, mag.items, mag.count.load(std::memory_order_relaxed));
+        mag.count.store(0, std::memory_order_relaxed);
+    }
+    tc->in_use.store(false, std::memory_order_release);
+}
+
+void* slab_alloc(std::size_t size)
+{
+    if (size > slab_max_size)
+    {
+        ++large_objects;
+        large_bytes += size;
+        return ::operator new(size);
+    }
+    unsigned c = class_of(size);
+    thread_cache* tc = get_cache();
+    if (nullptr == tc)
+    {
+        void* ptr;
+        if (0 == central_take(c, &ptr, 1))
+            throw std::bad_alloc();
+        return ptr;
+    }
+    magazine& mag = tc->magazines[c];
+    unsigned count = mag.count.load(std::memory_order_relaxed);
+    if (0 == count)
+    {
+        count = central_take(c, mag.items, batch_size);
+        if (0 == count)
+            throw std::bad_alloc();
+    }
+    --count;
+    mag.count.store(count, std::memory_order_relaxed);
+    return mag.items[count];
+}
+
+void slab_free(void* ptr, std::size_t size)
+{
+    if (size > slab_max_size)
+    {
+        --large_objects;
+        large_bytes -= size;
+        ::operator delete(ptr);
+        return;
+    }
+    unsigned c = class_of(size);
+    thread_cache* tc = get_cache();
+    if (nullptr == tc)
+    {
+        central_give(c, &ptr, 1);
+        return;
+    }
+    magazine& mag = tc->magazines[c];
+    unsigned count = mag.count.load(std::memory_order_relaxed);
+    if (magazine_size == count)
+    {
+        // Flush the older half of the magazine.
+        central_give(c, mag.items, batch_size);
+        for(unsigned ix = batch_size; ix < magazine_size; ++ix)
+            mag.items[ix - batch_size] = mag.items[ix];
+        count -= batch_size;
+    }
+    mag.items[count] = ptr;
+    mag.count.store(count + 1, std::memory_order_relaxed);
+}
+
+bool slab_shrink(void* ptr, std::size_t size, std::size_t new_size)
+{
+    if (size > slab_max_size || new_size > size)
+        return false;
+    unsigned c = class_of(size);
+    unsigned nc = class_of(new_size);
+    std::size_t tail = class_sizes[c] - class_sizes[nc];
+    if (tail < class_sizes[0])
+        return false;
+    // The object now belongs to the smaller class, and each piece of the
+    // tail to the largest class which leaves a remainder of 0, or at least
+    // the smallest class. Sizes are multiples of 8, and every multiple of 8
+    // up to 64 is a class, so the tail is always divided exactly.
+    {
+        std::lock_guard<std::mutex> lockg(central[c].lock);
+        --central[c].carved_count;
+    }
+    {
+        std::lock_guard<std::mutex> lockg(central[nc].lock);
+        ++central[nc].carved_count;
+    }
+    char* piece = static_cast<char*>(ptr) + class_sizes[nc];
+    while(tail)
+    {
+        unsigned pc = class_of(tail);
+        while(class_sizes[pc] > tail
+                || (class_sizes[pc] != tail && tail - class_sizes[pc] < class_sizes[0]))
+            --pc;
+        {
+            std::lock_guard<std::mutex> lockg(central[pc].lock);
+            ++central[pc].carved_count;
+        }
+        void* item = piece;
+        central_give(pc, &item, 1);
+        piece += class_sizes[pc];
+        tail -= class_sizes[pc];
+    }
+    return true;
+}
+
+std::size_t slab_usable_size(std::size_t size)
+{
+    if (size > slab_max_size)
+        return size;
+    return class_sizes[class_of(size)];
+}
+
+slab_stats slab_get_stats()
+{
+    slab_stats stats = {};
+    stats.mapped = mapped_bytes.load();
+    stats.carved = carved_bytes.load();
+    stats.large_objects = large_objects.load();
+    stats.large_bytes = large_bytes.load();
+    stats.hugetlb_regions = hugetlb_regions.load();
+    for(unsigned c = 0; c < class_count; ++c)
+    {
+        // Objects in transit between a magazine and a free list may be
+        // counted twice.
+        std::ptrdiff_t in_use;
+        {
+            std::lock_guard<std::mutex> lockg(central[c].lock);
+            in_use = central[c].carved_count - central[c].free_count;
+        }
+        for (thread_cache* tc = caches.load(std::memory_order_acquire); tc; tc = tc->next)
+            in_use -= tc->magazines[c].count.load(std::memory_order_relaxed);
+        if (in_use > 0)
+        {
+            stats.objects += in_use;
+            stats.bytes += in_use * class_sizes[c];
+        }
+    }
+    return stats;
+}
+
+} // namespace benedias
@@ -0,0 +1,93 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Size classed slab allocator for large numbers of small objects.
+
+Objects are carved out of large regions obtained directly from mmap, and
+carry no allocator header, so the only overhead is rounding up to the size
+class. Freed objects are kept on per size class free lists and are reused
+for objects of the same class.
+
+Each thread caches free objects in a magazine per size class, so allocating
+and freeing takes no lock, except when a magazine has to be refilled from,
+or flushed to, the free list of its size class, which is done in batches.
+
+The size of an object must be supplied when it is freed.
+Sizes larger than slab_max_size are allocated using ::operator new.
+Memory in regions is never returned to the system.
+
+Huge pages:
+    BENEDIAS_SLAB_HUGE_PAGES == 0 normal pages
+    BENEDIAS_SLAB_HUGE_PAGES == 1 transparent huge pages are requested for
+        regions (madvise(MADV_HUGEPAGE)), the default.
+    BENEDIAS_SLAB_HUGE_PAGES == 2 regions are mapped using MAP_HUGETLB,
+        falling back to transparent huge pages if no huge pages are available.
+*/
+#ifndef BENEDIAS_SLAB_H_INCLUDED
+#define BENEDIAS_SLAB_H_INCLUDED
+
+#include <cstddef>
+
+#ifndef BENEDIAS_SLAB_HUGE_PAGES
+#define BENEDIAS_SLAB_HUGE_PAGES    1
+#endif
+
+namespace benedias {
+
+// Largest size allocated from slabs.
+const std::size_t slab_max_size = 512;
+
+//@brief    Allocate @a size bytes, aligned to 8 bytes.
+void* slab_alloc(std::size_t size);
+
+//@brief    Free @a ptr allocated using slab_alloc(@a size).
+void slab_free(void* ptr, std::size_t size);
+
+//@brief    Shrink the allocation of @a size bytes at @a ptr in place to
+// @a new_size bytes, the tail is returned to the free lists of smaller size
+// classes. Returns false, leaving the allocation unchanged, if @a size is
+// larger than slab_max_size, or the tail is smaller than the smallest size
+// class. If true is returned @a ptr must be freed using @a new_size.
+bool slab_shrink(void* ptr, std::size_t size, std::size_t new_size);
+
+//@brief    Returns the number of bytes actually reserved for an allocation
+// of @a size bytes.
+std::size_t slab_usable_size(std::size_t size);
+
+struct slab_stats
+{
+    // Bytes mapped for regions.
+    std::size_t mapped;
+    // Bytes handed out from regions, including objects on free lists.
+    std::size_t carved;
+    // Number of objects, and size class rounded bytes, in use.
+    std::size_t objects;
+    std::size_t bytes;
+    // Number of objects, and bytes, allocated using ::operator new.
+    std::size_t large_objects;
+    std::size_t large_bytes;
+    // Number of regions backed by MAP_HUGETLB huge pages.
+    std::size_t hugetlb_regions;
+};
+
+//@brief    Returns allocator statistics, counts are approximate while other
+// threads are allocating or freeing.
+slab_stats slab_get_stats();
+
+} // namespace benedias
+
+#endif // BENEDIAS_SLAB_H_INCLUDED
@@ -0,0 +1,199 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is part of sqzbsrv.
+
+sqzbsrv is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+sqzbsrv is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Benchmark of the byte string comparisons in bdbytes.h against memcmp, and
+of the dbstring comparison operators.
+For short artist names and long file paths, which differ only near the end,
+reports nanoseconds per comparison of equal copies and of strings differing
+in their last byte, for bytes_equal, bytes_compare and memcmp, then of
+dbstring == dbstring, which compares identities, dbstring == std::string,
+sorting dbstrings, and interning strings which are in the directory, which
+probes the directory.
+
+usage: cmpbench [number of strings]
+*/
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include "bdbytes.h"
+#include "dbstring.h"
+
+using benedias::memdb::dbstring;
+using benedias::sharedobj_ptr;
+
+static const char* first_names[] = {
+    "John", "Paul", "Ella", "Nina", "Miles", "Aretha", "Bob", "Joni",
+    "David", "Billie", "Ray", "Etta", "Frank", "Patti", "Leonard", "Kate",
+};
+static const char* last_names[] = {
+    "Smith", "Davis", "Simone", "Mitchell", "Bowie", "Holiday", "Charles",
+    "James", "Sinatra", "Smith", "Cohen", "Bush", "Franklin", "Fitzgerald",
+};
+
+static std::vector<std::string> make_artists(unsigned count)
+{
+    std::vector<std::string> corpus;
+    for (unsigned i = 0; i < count; i++)
+    {
+        corpus.push_back(std::string(first_names[i % 16]) + " "
+                + last_names[(i / 16) % 14] + " " + std::to_string(i));
+    }
+    return corpus;
+}
+
+static std::vector<std::string> make_paths(unsigned count)
+{
+    std::vector<std::string> corpus;
+    char buf[256];
+    for (unsigned i = 0; i < count; i++)
+    {
+        snprintf(buf, sizeof(buf), "/srv/music/library/%s %s/Album %u (Remastered)/%02u - Track.flac",
+                first_names[i % 16], last_names[(i / 16) % 14], i / 12, i % 12 + 1);
+        corpus.push_back(buf);
+    }
+    return corpus;
+}
+
+static volatile long sink;
+
+// Returns nanoseconds per call of @a f, the best of several runs.
+template <typename F> static double time_per_call(std::size_t calls, F f)
+{
+    double best = 0;
+    for (unsigned run = 0; run < 5; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        long total = f();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        sink = total;
+        if (0 == run || elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best / calls;
+}
+
+static void bytes_bench(const char* title, const std::vector<std::string>& corpus)
+{
+    static const unsigned repeat = 20;
+    // Equal copies in separate buffers, and copies differing in the last byte.
+    std::vector<std::string> copies(corpus);
+    std::vector<std::string> others(corpus);
+    std::size_t bytes = 0;
+    for (std::string& s: others)
+    {
+        s.back() ^= 1;
+        bytes += s.size();
+    }
+    std::size_t calls = repeat * corpus.size();
+    printf("%s: %zu strings, %.1f bytes average\n", title, corpus.size(), double(bytes) / corpus.size());
+    for (const std::vector<std::string>* rhs: {&copies, &others})
+    {
+        const std::vector<std::string>& other = *rhs;
+        double eq = time_per_call(calls, [&]()
+                {
+                    long n = 0;
+                    for (unsigned r = 0; r < repeat; r++)
+                        for (std::size_t ix = 0; ix < corpus.size(); ix++)
+                            n += benedias::bytes_equal(corpus[ix].data(), other[ix].data(), corpus[ix].size());
+                    return n;
+                });
+        double cmp = time_per_call(calls, [&]()
+                {
+                    long n = 0;
+                    for (unsigned r = 0; r < repeat; r++)
+                        for (std::size_t ix = 0; ix < corpus.size(); ix++)
+                            n += benedias::bytes_compare(corpus[ix].data(), other[ix].data(), corpus[ix].size());
+                    return n;
+                });
+        double mem = time_per_call(calls, [&]()
+                {
+                    long n = 0;
+                    for (unsigned r = 0; r < repeat; r++)
+                        for (std::size_t ix = 0; ix < corpus.size(); ix++)
+                            n += memcmp(corpus[ix].data(), other[ix].data(), corpus[ix].size());
+                    return n;
+                });
+        printf("  %-9s bytes_equal %6.2f ns  bytes_compare %6.2f ns  memcmp %6.2f ns\n",
+                rhs == &copies ? "equal" : "differ", eq, cmp, mem);
+    }
+}
+
+static void dbstring_bench(const char* title, const std::vector<std::string>& corpus)
+{
+    static const unsigned repeat = 20;
+    std::vector<sharedobj_ptr<dbstring>> strings;
+    for (const std::string& s: corpus)
+        strings.push_back(dbstring::make_sharedobj(s));
+    std::size_t calls = repeat * corpus.size();
+    // Neighbours, which are distinct strings of the same form.
+    double identity = time_per_call(calls, [&]()
+            {
+                long n = 0;
+                for (unsigned r = 0; r < repeat; r++)
+                    for (std::size_t ix = 1; ix < strings.size(); ix++)
+                        n += *strings[ix].get() == *strings[ix - 1].get();
+                return n;
+            });
+    double stdstr = time_per_call(calls, [&]()
+            {
+                long n = 0;
+                for (unsigned r = 0; r < repeat; r++)
+                    for (std::size_t ix = 0; ix < strings.size(); ix++)
+                        n += *strings[ix].get() == corpus[ix];
+                return n;
+            });
+    std::vector<sharedobj_ptr<dbstring>> sorted;
+    double sort = time_per_call(corpus.size(), [&]()
+            {
+                sorted = strings;
+                std::reverse(sorted.begin(), sorted.end());
+                std::sort(sorted.begin(), sorted.end(),
+                        [](const sharedobj_ptr<dbstring>& lhs, const sharedobj_ptr<dbstring>& rhs)
+                        { return *lhs.get() < *rhs.get(); });
+                return long(sorted.size());
+            });
+    double probe = time_per_call(corpus.size(), [&]()
+            {
+                long n = 0;
+                for (const std::string& s: corpus)
+                    n += dbstring::make_sharedobj(s)->size();
+                return n;
+            });
+    printf("  %s: == dbstring %6.2f ns  == std::string %6.2f ns  sort %6.1f ns/string  intern hit %6.1f ns\n",
+            title, identity, stdstr, sort, probe);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned count = argc > 1 ? atoi(argv[1]) : 100000;
+    std::vector<std::string> artists = make_artists(count);
+    std::vector<std::string> paths = make_paths(count);
+    bytes_bench("artists", artists);
+    bytes_bench("paths", paths);
+    printf("dbstring\n");
+    dbstring_bench("artists", artists);
+    dbstring_bench("paths", paths);
+    return 0;
+}
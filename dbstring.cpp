@@ -16,13 +16,21 @@ You should have received a copy of the GNU General Public License
 along with this file.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <mutex>
-#include <stack>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
 #include <unordered_map>
-#include <bitset>
+#include <unordered_set>
+#include <functional>
 #include <string.h>
+#include <stdlib.h>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <stdexcept>
 #include <assert.h>
 #include <thread>
+#include <deque>
 
 //#define DBSTRING_DEBUG_TRACE
 #ifdef  DBSTRING_DEBUG_TRACE
@@ -30,329 +38,3574 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 static std::ostream& trace_out(std::cout);
 #endif
 
+#include "bdbtree.h"
+#include "bdpostings.h"
+#include "bdroaring.h"
 #include "bdrwlock.h"
+#include "bdepoch.h"
+#include "bdslab.h"
+#include "bdhash.h"
+#include "bdbytes.h"
 #include "dbstring.h"
-#include "lookup3.h"
+#ifdef  BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY
+#include "lfhashtable.h"
+#endif
+#ifdef  BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY
+#include "bdart.h"
+#endif
 
 namespace benedias {
     namespace memdb {
 
-static std::mutex domain_factory_mutex; 
-static std::bitset<BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT> domain_master;
-static bool reap_immediately = true;
+// Modified while other threads are releasing strings, e.g. by dbstring_bulk_load.
+static std::atomic<bool> reap_immediately(true);
+// Number of dbstring_bulk_load instances.
+static std::atomic<unsigned> bulk_loaders(0);
+// Serialises the first and last dbstring_bulk_load instances, the reaping mode
+// when the first was created is restored when the last is destroyed.
+static std::mutex bulk_load_lock;
+static bool bulk_load_was_delayed = false;
+
+// Releases which left strings referenced only by the directory, counted in
+// batches per thread, used to wake the background reaper.
+static std::atomic<unsigned> reapable_releases(0);
+static const unsigned reapable_batch = 32;
+static thread_local unsigned th_reapable_releases = 0;
+static void wake_reaper(unsigned releases);
+
+static inline void note_reapable_release()
+{
+    if (++th_reapable_releases == reapable_batch)
+    {
+        th_reapable_releases = 0;
+        wake_reaper(reapable_releases.fetch_add(reapable_batch) + reapable_batch);
+    }
+}
+
+// Statistics counters, see dbstring::stats.
+// Each thread counts in its own block, which only it modifies, so counting is
+// a load and a store to memory no other thread writes. dbstring::stats sums
+// the blocks. Blocks are never deleted, blocks of threads which have exited
+// are reused, keeping their counts.
+enum stat_counter
+{
+    stat_hits,
+    stat_misses,
+    stat_release_erases,
+    stat_reaps,
+    stat_reap_ns,
+    stat_reaped,
+    stat_background_reaped,
+    stat_domain_reaped,
+    stat_counters
+};
+
+// Padded rather than aligned, which operator new does not honour before C++17,
+// so the counts of blocks allocated together are in different cache lines.
+struct stats_counts
+{
+    std::atomic<bool> in_use;
+    stats_counts* next;
+    std::atomic<uint64_t> counts[stat_counters];
+    char padding[64];
+
+    stats_counts():in_use(true),next(nullptr)
+    {
+        for(auto& count: counts)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    // Only by the owning thread.
+    void add(stat_counter counter, uint64_t n)
+    {
+        std::atomic<uint64_t>& count = counts[counter];
+        count.store(count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+static std::atomic<stats_counts*> stats_blocks(nullptr);
+static thread_local stats_counts* th_stats = nullptr;
+// Set once the thread block has been released on thread exit, counts by
+// thread local destructors which run later are added to exited_stats.
+static thread_local bool th_stats_exited = false;
+static stats_counts exited_stats;
+
+struct stats_counts_releaser
+{
+    ~stats_counts_releaser()
+    {
+        if (th_stats)
+            th_stats->in_use.store(false);
+        th_stats = nullptr;
+        th_stats_exited = true;
+    }
+};
+static thread_local stats_counts_releaser th_stats_releaser;
+
+static stats_counts* get_stats_counts()
+{
+    stats_counts* sc;
+    for (sc = stats_blocks.load(); sc; sc = sc->next)
+    {
+        bool expected = false;
+        if (!sc->in_use.load(std::memory_order_relaxed)
+                && sc->in_use.compare_exchange_strong(expected, true))
+            return sc;
+    }
+    sc = new stats_counts();
+    stats_counts* head = stats_blocks.load(std::memory_order_relaxed);
+    do
+    {
+        sc->next = head;
+    } while(!stats_blocks.compare_exchange_weak(head, sc));
+    return sc;
+}
+
+static inline void count_stat(stat_counter counter, uint64_t n = 1)
+{
+    if (nullptr == th_stats)
+    {
+        if (th_stats_exited)
+        {
+            exited_stats.counts[counter].fetch_add(n, std::memory_order_relaxed);
+            return;
+        }
+        // Ensure the block is released when the thread exits.
+        (void)&th_stats_releaser;
+        th_stats = get_stats_counts();
+    }
+    th_stats->add(counter, n);
+}
 
 #ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+// Domain members are kept in a compressed bitmap per domain, of dense ids
+// assigned to strings when they are first added to a domain, so strings do
+// not carry domain state and the number of domains is not limited.
+// Membership does not hold a reference. The id of a string removed from the
+// directory is retired after the shard write lock is released, until then
+// the string has a zero use count and is skipped like retired ids. Once
+// enough ids are retired they are subtracted from every domain and recycled.
+// domain_lock is never taken with a shard lock held.
+// Domain iterators capture members holding domain_lock for reading, and
+// release it between chunks. dbstring::drop_domain releases domain_lock
+// between batches, and blocks recycling until it is done.
+static benedias::FurwLock1 domain_lock;
+
+// With domain_lock held.
+struct domain_ids
+{
+    // Indexed by id, nullptr for retired and free ids.
+    std::vector<dbstring*> strings;
+    std::unordered_map<const dbstring*, uint32_t> ids;
+    benedias::roaring_bitmap retired;
+    // Descending, so the lowest ids are reused first.
+    std::vector<uint32_t> free_ids;
+    std::unordered_set<dbstring_domain*> domains;
+    // The number of domains being dropped, retired ids are not recycled
+    // while it is not 0.
+    unsigned drops = 0;
+
+    uint32_t id_of(dbstring* dbs)
+    {
+        auto find = ids.find(dbs);
+        if (find != ids.end())
+            return find->second;
+        uint32_t id;
+        if (free_ids.empty())
+        {
+            id = uint32_t(strings.size());
+            strings.push_back(dbs);
+        }
+        else
+        {
+            id = free_ids.back();
+            free_ids.pop_back();
+            strings[id] = dbs;
+        }
+        ids.emplace(dbs, id);
+        return id;
+    }
+
+    void retire(dbstring* dbs);
+};
+static domain_ids domain_members;
+
 class dbstring_domain
 {
-    unsigned bitnum;
     public:
-        std::bitset<BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT> mask;
+        // With domain_lock held.
+        benedias::roaring_bitmap members;
         dbstring_domain()
         {
-            std::lock_guard<std::mutex> lockg(domain_factory_mutex);
-            for (bitnum = 0; bitnum < BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT; ++bitnum)
+            benedias::write_lock_guard wrlockg(domain_lock);
+            domain_members.domains.insert(this);
+        }
+        ~dbstring_domain()
+        {
+            benedias::write_lock_guard wrlockg(domain_lock);
+            domain_members.domains.erase(this);
+        }
+
+        void add(dbstring* dbs)
+        {
+            benedias::write_lock_guard wrlockg(domain_lock);
+            members.add(domain_members.id_of(dbs));
+        }
+
+        // Remove @a dead, which have been removed from the directory, from
+        // their domains, after the shard write lock is released and before
+        // they are disposed of, so domain_lock is never taken with a shard
+        // lock held.
+        static void remove(const std::vector<dbstring*>& dead)
+        {
+            if (dead.empty())
+                return;
+            benedias::write_lock_guard wrlockg(domain_lock);
+            for(auto dbs: dead)
+                domain_members.retire(dbs);
+        }
+
+        // Members less those whose ids are retired.
+        std::size_t size() const
+        {
+            benedias::roaring_bitmap stale(members);
+            stale.intersect(domain_members.retired);
+            return members.size() - stale.size();
+        }
+};
+
+void domain_ids::retire(dbstring* dbs)
+{
+    if (ids.empty())
+        return;
+    auto find = ids.find(dbs);
+    if (find == ids.end())
+        return;
+    strings[find->second] = nullptr;
+    retired.add(find->second);
+    ids.erase(find);
+    if (drops || retired.size() < std::max<std::size_t>(ids.size(), 1024))
+        return;
+    for(dbstring_domain* dom: domains)
+        dom->members.subtract(retired);
+    if (ids.empty())
+    {
+        std::vector<dbstring*>().swap(strings);
+        std::vector<uint32_t>().swap(free_ids);
+    }
+    else
+    {
+        retired.visit([this](uint32_t id) { free_ids.push_back(id); });
+        std::sort(free_ids.begin(), free_ids.end(), std::greater<uint32_t>());
+    }
+    retired.clear();
+}
+#endif
+
+// The hash of the string directory.
+typedef BENEDIAS_MEMDB_DBSTRING_HASH string_hash;
+
+struct cstr_hash
+{
+    std::size_t operator()(const char* cs) const
+    {
+        return (*this)(cs, strlen(cs));
+    }
+
+    std::size_t operator()(const char* cs, std::size_t length) const
+    {
+        return string_hash()(cs, length);
+    }
+
+    // Hash count strings, several at once if the hash supports it.
+    void operator()(const char* const* cs, const std::size_t* lengths,
+            std::size_t count, std::size_t* hashes) const
+    {
+        string_hash::hash_many(cs, lengths, count, hashes);
+    }
+};
+
+// The characters of a string, for code running with a directory shard, or an
+// index, lock held, does not mark the string as accessed.
+struct dbstring_chars
+{
+    static inline const char* of(const dbstring* dbs)
+    {
+        return dbs->char_seq();
+    }
+};
+
+static inline const char* chars_of(const dbstring* dbs)
+{
+    return dbstring_chars::of(dbs);
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+// The characters of strings move when they are migrated to or from the cold
+// tier, so the keys of strings in the directory refer to the string instead,
+// which is flagged in the length.
+static const std::size_t string_key_flag = std::size_t(1) << (sizeof(std::size_t) * 8 - 1);
+#endif
+
+// Directory key, the characters, length and hash value of a string.
+// The hash value is computed once, when the string is looked up or created,
+// and is not recomputed when the table is rehashed.
+// Equality compares the hash values and lengths before the characters.
+struct dbstring_key
+{
+    const char* chars;
+    std::size_t length;
+    std::size_t hashv;
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+    const char* key_chars() const
+    {
+        if (length & string_key_flag)
+            return chars_of(reinterpret_cast<const dbstring*>(chars));
+        return chars;
+    }
+
+    std::size_t key_length() const
+    {
+        return length & ~string_key_flag;
+    }
+#else
+    const char* key_chars() const
+    {
+        return chars;
+    }
+
+    std::size_t key_length() const
+    {
+        return length;
+    }
+#endif
+
+    bool operator==(const dbstring_key& other) const
+    {
+        if (chars == other.chars)
+            return true;
+        return hashv == other.hashv && key_length() == other.key_length()
+            && benedias::bytes_equal(key_chars(), other.key_chars(), key_length());
+    }
+};
+
+struct dbstring_key_hash
+{
+    std::size_t operator()(const dbstring_key& key) const noexcept
+    {
+        return key.hashv;
+    }
+};
+
+//For 100% safety, the lifetime of C string instances used for keys must either 
+// 1) span the lifetime of the associated entry string_directory
+//or
+// 2) exceed the lifetime of string_directory
+// Therefore adding strings must be done with care.
+// Perversely for this use case, setting the "key" to the characters of the dbstring instance
+// is the solution. There isn't a circular dependency because the dbstring instance is
+// guaranteed to exist as long as the directory holds a reference to it, and it
+// "can" only be deleted after the entry in string_directory is removed.
+// The directory holds a counted reference to each string, but using a raw pointer
+// so that removing an entry does not re-enter dbstring::sharedobj_release while
+// a shard lock is held.
+typedef std::unordered_map<dbstring_key, dbstring*, dbstring_key_hash> HASHTABLE;
+
+static inline dbstring_key key_of(const dbstring* dbs)
+{
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+    return dbstring_key{reinterpret_cast<const char*>(dbs), dbs->size() | string_key_flag, dbs->hash_value()};
+#else
+    return dbstring_key{chars_of(dbs), dbs->size(), dbs->hash_value()};
+#endif
+}
+
+// Binary safe lexicographic comparison, for strings without NULs the
+// order is the same as strcmp.
+static inline int compare(const char* lhs, std::size_t lhs_len, const char* rhs, std::size_t rhs_len)
+{
+    int rv = benedias::bytes_compare(lhs, rhs, lhs_len < rhs_len ? lhs_len : rhs_len);
+    if (0 == rv && lhs_len != rhs_len)
+        rv = lhs_len < rhs_len ? -1 : 1;
+    return rv;
+}
+
+// The ordered index, when enabled, holds every string in the directory in
+// lexicographic order. It is updated with the write lock of the shard being
+// modified held, and has its own read write lock, so lookups in the index
+// never take a shard lock.
+// enabled is changed with the index write lock held, and checked again by
+// updates and lookups once they hold the index lock, see toggle_index.
+struct dbstring_less
+{
+    bool operator()(const dbstring* lhs, const dbstring* rhs) const
+    {
+        return 0 > compare(chars_of(lhs), lhs->size(), chars_of(rhs), rhs->size());
+    }
+};
+
+struct order_index
+{
+    benedias::FurwLock1 lock;
+    benedias::counted_btree<dbstring, dbstring_less> tree;
+    // Changed with the lock held.
+    std::atomic<bool> enabled{false};
+    // Serialises enabling and disabling.
+    std::mutex toggle_lock;
+
+    // With the lock held, the tree ignores strings already present.
+    void insert(dbstring* dbs)
+    {
+        tree.insert(dbs);
+    }
+
+    // With the lock held.
+    void clear()
+    {
+        tree.clear();
+    }
+
+    void add(dbstring* dbs)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+        {
+            benedias::write_lock_guard wrlockg(lock);
+            if (enabled.load(std::memory_order_relaxed))
+                insert(dbs);
+        }
+    }
+
+    void remove(dbstring* dbs)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+        {
+            benedias::write_lock_guard wrlockg(lock);
+            if (enabled.load(std::memory_order_relaxed))
+                tree.erase(dbs);
+        }
+    }
+
+    // Acquire up to count strings from position offset, with the lock held.
+    // Strings being removed from the lock free directory are skipped.
+    void acquire(std::size_t offset, std::size_t count, std::vector<sharedobj_ptr<dbstring>>& strings)
+    {
+        if (!enabled.load(std::memory_order_relaxed))
+            return;
+        strings.reserve(std::min(count, tree.size()));
+        tree.visit(offset, count, [&strings](dbstring* dbs)
+                {
+                    if (dbs->sharedobj_try_acquire())
+                        strings.push_back(sharedobj_ptr<dbstring>::adopt(dbs));
+                    return true;
+                });
+    }
+};
+static order_index string_index;
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// ASCII case folding.
+static inline char fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+
+// Compares strings as specified by dbstring_collation, without building
+// collation keys.
+// A run of digits compares with other characters as a digit would, and with
+// another run of digits by numeric value, since digits are contiguous in
+// ASCII the order is consistent.
+struct collator
+{
+    dbstring_collation options;
+
+    // Returns the offset of the first character after a leading article.
+    std::size_t skip_article(const char* chars, std::size_t length) const
+    {
+        if (!options.strip_articles)
+            return 0;
+        for(const std::string& article: options.articles)
+        {
+            std::size_t alen = article.size();
+            // The article must be followed by a space and something else.
+            if (alen + 1 >= length || ' ' != chars[alen])
+                continue;
+            std::size_t ix = 0;
+            while(ix < alen && fold(chars[ix]) == fold(article[ix]))
+                ++ix;
+            if (ix == alen)
+                return alen + 1;
+        }
+        return 0;
+    }
+
+    int compare(const char* lhs, std::size_t lhs_len, const char* rhs, std::size_t rhs_len) const
+    {
+        std::size_t lx = skip_article(lhs, lhs_len);
+        std::size_t rx = skip_article(rhs, rhs_len);
+        while(lx < lhs_len && rx < rhs_len)
+        {
+            char lc = lhs[lx];
+            char rc = rhs[rx];
+            if (options.natural_numbers && is_digit(lc) && is_digit(rc))
             {
-                if (!domain_master.test(bitnum))
-                    break;
+                // Leading zeros are not significant, then the longer run of
+                // digits is the larger number.
+                while(lx < lhs_len && '0' == lhs[lx])
+                    ++lx;
+                while(rx < rhs_len && '0' == rhs[rx])
+                    ++rx;
+                std::size_t lend = lx;
+                while(lend < lhs_len && is_digit(lhs[lend]))
+                    ++lend;
+                std::size_t rend = rx;
+                while(rend < rhs_len && is_digit(rhs[rend]))
+                    ++rend;
+                if (lend - lx != rend - rx)
+                    return lend - lx < rend - rx ? -1 : 1;
+                int rv = benedias::bytes_compare(lhs + lx, rhs + rx, lend - lx);
+                if (rv)
+                    return rv;
+                lx = lend;
+                rx = rend;
+                continue;
+            }
+            if (options.fold_case)
+            {
+                lc = fold(lc);
+                rc = fold(rc);
             }
-            if (bitnum >= BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT)
-                throw std::overflow_error("benedias::memdb::dbstring domains");
-            domain_master[bitnum] = true;
-            mask[bitnum] = true;
+            if (lc != rc)
+                return static_cast<unsigned char>(lc) < static_cast<unsigned char>(rc) ? -1 : 1;
+            ++lx;
+            ++rx;
         }
-        ~dbstring_domain()
+        if (lx < lhs_len)
+            return 1;
+        return rx < rhs_len ? -1 : 0;
+    }
+
+    int compare(const dbstring* lhs, const dbstring* rhs) const
+    {
+        return compare(chars_of(lhs), lhs->size(), chars_of(rhs), rhs->size());
+    }
+};
+
+// Strings which collate equally are ordered by their characters, so the
+// collation index holds distinct strings.
+struct collation_less
+{
+    const collator* coll;
+
+    bool operator()(const dbstring* lhs, const dbstring* rhs) const
+    {
+        int rv = coll->compare(lhs, rhs);
+        if (0 == rv)
+            rv = compare(chars_of(lhs), lhs->size(), chars_of(rhs), rhs->size());
+        return 0 > rv;
+    }
+};
+
+// The collation index, when enabled, holds every string in the directory in
+// collation order, and is maintained like the ordered index.
+// Strings which collate equally have the same ordinal.
+struct collation_index
+{
+    benedias::FurwLock1 lock;
+    collator coll;
+    benedias::counted_btree<dbstring, collation_less> tree{collation_less{&coll}};
+    // Changed with the lock held.
+    std::atomic<bool> enabled{false};
+    // Serialises enabling and disabling.
+    std::mutex toggle_lock;
+
+    // With the lock held, ordinals are assigned by freeze.
+    void insert(dbstring* dbs)
+    {
+        tree.insert(dbs);
+    }
+
+    // With the lock held, every string in the tree is live.
+    void clear()
+    {
+        tree.visit(0, tree.size(), [](dbstring* dbs)
+                {
+                    dbs->ordinal.store(0, std::memory_order_relaxed);
+                    return true;
+                });
+        tree.clear();
+    }
+
+    void add(dbstring* dbs)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+        {
+            benedias::write_lock_guard wrlockg(lock);
+            if (enabled.load(std::memory_order_relaxed))
+            {
+                insert(dbs);
+                dbs->ordinal.store(ordinal_between(dbs), std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void remove(dbstring* dbs)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+        {
+            benedias::write_lock_guard wrlockg(lock);
+            if (enabled.load(std::memory_order_relaxed))
+                tree.erase(dbs);
+        }
+    }
+
+    // Returns an ordinal for dbs, which is in the tree, between those of its
+    // neighbours, or 0 if there is none, with the lock held.
+    uint32_t ordinal_between(const dbstring* dbs) const
+    {
+        collation_less less{&coll};
+        std::size_t rank = tree.partition_point([&](const dbstring* other)
+                {
+                    return less(other, dbs);
+                });
+        const dbstring* prev = rank > 0 ? tree.at(rank - 1) : nullptr;
+        const dbstring* next = rank + 1 < tree.size() ? tree.at(rank + 1) : nullptr;
+        if (prev && 0 == coll.compare(prev, dbs))
+            return prev->collation_ordinal();
+        if (next && 0 == coll.compare(next, dbs))
+            return next->collation_ordinal();
+        uint64_t low = prev ? prev->collation_ordinal() : 0;
+        uint64_t high = next ? next->collation_ordinal() : uint64_t(UINT32_MAX) + 1;
+        if ((prev && 0 == low) || (next && 0 == high) || high - low < 2)
+            return 0;
+        return uint32_t(low + (high - low) / 2);
+    }
+
+    // Assign evenly spaced ordinals, with the lock held.
+    void freeze()
+    {
+        std::size_t distinct = 0;
+        const dbstring* prev = nullptr;
+        tree.visit(0, tree.size(), [&](const dbstring* dbs)
+                {
+                    if (nullptr == prev || 0 != coll.compare(prev, dbs))
+                        ++distinct;
+                    prev = dbs;
+                    return true;
+                });
+        uint64_t spacing = std::max<uint64_t>(1, UINT32_MAX / (distinct + 1));
+        uint64_t ordinal = 0;
+        prev = nullptr;
+        tree.visit(0, tree.size(), [&](dbstring* dbs)
+                {
+                    if (nullptr == prev || 0 != coll.compare(prev, dbs))
+                        ordinal += spacing;
+                    prev = dbs;
+                    // More distinct strings than ordinals, which is unlikely.
+                    dbs->ordinal.store(ordinal <= UINT32_MAX ? uint32_t(ordinal) : 0,
+                            std::memory_order_relaxed);
+                    return true;
+                });
+    }
+};
+static collation_index string_collation;
+#endif
+
+// Returns true if chars contains the pattern, ignoring ASCII case.
+static bool contains_folded(const char* chars, std::size_t length, const char* pattern, std::size_t plen)
+{
+    if (plen > length)
+        return false;
+    for(std::size_t ix = 0; ix + plen <= length; ++ix)
+    {
+        std::size_t px = 0;
+        while(px < plen && fold(chars[ix + px]) == fold(pattern[px]))
+            ++px;
+        if (px == plen)
+            return true;
+    }
+    return false;
+}
+
+static inline bool contains(const dbstring* dbs, const char* pattern, std::size_t plen, bool ignore_case)
+{
+    if (ignore_case)
+        return contains_folded(chars_of(dbs), dbs->size(), pattern, plen);
+    return 0 == plen || nullptr != memmem(chars_of(dbs), dbs->size(), pattern, plen);
+}
+
+// The trigram index, when enabled, maps each trigram of ASCII case folded
+// characters to a compressed posting list of the strings containing it, and
+// is maintained like the ordered index.
+// Substring searches intersect the posting lists of the trigrams of the
+// pattern, shortest first, and check the candidates.
+// Strings are identified by ids allocated in ascending order, so ids are
+// only ever appended to posting lists. The ids of reaped strings are retired,
+// when there are more retired ids than strings the index is rebuilt,
+// renumbering the strings.
+struct trigram_index
+{
+    benedias::FurwLock1 lock;
+    std::unordered_map<uint32_t, benedias::posting_list> postings;
+    // Strings with fewer than 3 characters.
+    benedias::posting_list short_strings;
+    // Indexed by id, nullptr for retired ids.
+    std::vector<dbstring*> strings;
+    std::unordered_map<const dbstring*, uint32_t> ids;
+    // Changed with the lock held.
+    std::atomic<bool> enabled{false};
+    // Serialises enabling and disabling.
+    std::mutex toggle_lock;
+
+    static inline uint32_t trigram(const char* chars)
+    {
+        return uint32_t(uint8_t(fold(chars[0]))) << 16
+            | uint32_t(uint8_t(fold(chars[1]))) << 8
+            | uint32_t(uint8_t(fold(chars[2])));
+    }
+
+    // With the lock held, strings already present are ignored.
+    void insert(dbstring* dbs)
+    {
+        if (ids.count(dbs))
+            return;
+        uint32_t id = uint32_t(strings.size());
+        strings.push_back(dbs);
+        ids.emplace(dbs, id);
+        const char* chars = chars_of(dbs);
+        for(std::size_t ix = 0; ix + 3 <= dbs->size(); ++ix)
+            postings[trigram(chars + ix)].append(id);
+        if (dbs->size() < 3)
+            short_strings.append(id);
+    }
+
+    // With the lock held.
+    void clear()
+    {
+        postings.clear();
+        short_strings = benedias::posting_list();
+        strings.clear();
+        ids.clear();
+    }
+
+    void add(dbstring* dbs)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+        {
+            benedias::write_lock_guard wrlockg(lock);
+            if (enabled.load(std::memory_order_relaxed))
+                insert(dbs);
+        }
+    }
+
+    void remove(dbstring* dbs)
+    {
+        if (enabled.load(std::memory_order_relaxed))
+        {
+            benedias::write_lock_guard wrlockg(lock);
+            if (!enabled.load(std::memory_order_relaxed))
+                return;
+            auto find = ids.find(dbs);
+            if (find == ids.end())
+                return;
+            strings[find->second] = nullptr;
+            ids.erase(find);
+            if (strings.size() - ids.size() > std::max<std::size_t>(ids.size(), 1024))
+            {
+                std::vector<dbstring*> live;
+                live.reserve(ids.size());
+                for(dbstring* str: strings)
+                {
+                    if (str)
+                        live.push_back(str);
+                }
+                clear();
+                for(dbstring* str: live)
+                    insert(str);
+            }
+        }
+    }
+
+    // Acquire the strings containing the pattern, with the lock held.
+    void search(const char* pattern, std::size_t plen, bool ignore_case,
+            std::vector<sharedobj_ptr<dbstring>>& found) const
+    {
+        std::vector<uint32_t> candidates;
+        if (plen < 2)
+        {
+            // Every string is a candidate.
+            candidates.reserve(strings.size());
+            for(uint32_t id = 0; id < strings.size(); ++id)
+                candidates.push_back(id);
+        }
+        else if (2 == plen)
+        {
+            // The strings with a trigram starting or ending with the
+            // pattern, and the strings too short to have trigrams.
+            uint32_t bigram = uint32_t(uint8_t(fold(pattern[0]))) << 8 | uint8_t(fold(pattern[1]));
+            auto collect = [&candidates](uint32_t id) { candidates.push_back(id); };
+            for(uint32_t c = 0; c < 256; ++c)
+            {
+                auto find = postings.find(bigram << 8 | c);
+                if (find != postings.end())
+                    find->second.visit(collect);
+                find = postings.find(c << 16 | bigram);
+                if (find != postings.end())
+                    find->second.visit(collect);
+            }
+            short_strings.visit(collect);
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        }
+        else
+        {
+            std::vector<const benedias::posting_list*> lists;
+            for(std::size_t ix = 0; ix + 3 <= plen; ++ix)
+            {
+                auto find = postings.find(trigram(pattern + ix));
+                if (find == postings.end())
+                    return;
+                lists.push_back(&find->second);
+            }
+            std::sort(lists.begin(), lists.end(),
+                    [](const benedias::posting_list* lhs, const benedias::posting_list* rhs)
+                    {
+                        return lhs->size() < rhs->size()
+                            || (lhs->size() == rhs->size() && lhs < rhs);
+                    });
+            lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+            candidates.reserve(lists[0]->size());
+            lists[0]->visit([&candidates](uint32_t id) { candidates.push_back(id); });
+            for(std::size_t ix = 1; ix < lists.size() && !candidates.empty(); ++ix)
+                lists[ix]->intersect(candidates);
+        }
+        for(uint32_t id: candidates)
+        {
+            dbstring* dbs = strings[id];
+            if (dbs && contains(dbs, pattern, plen, ignore_case) && dbs->sharedobj_try_acquire())
+                found.push_back(sharedobj_ptr<dbstring>::adopt(dbs));
+        }
+    }
+};
+static trigram_index string_trigrams;
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+// The cold tier holds the characters of strings which have not been accessed
+// for a while in front coded blocks, the strings of a block are sorted, and
+// each is stored as the number of leading characters it shares with the
+// previous string, followed by the remaining characters.
+// A string migrated to the cold tier is shrunk in place to its fixed size
+// fields followed by a cold_ref. When the characters are accessed they are
+// decompressed to an allocation, whose address replaces the cold_ref and the
+// entry in the block is dropped, a later sweep migrates the string again.
+// Strings whose characters have been returned by pointer, by c_str, are
+// exposed and not migrated while they are referenced other than by the
+// directory, so neither their inline characters nor thawed allocations are
+// released while the pointer can be in use.
+// Sweeps build blocks from the strings of one shard at a time, holding the
+// shard and index write locks, so code reading characters with those locks
+// held is excluded, accessors are excluded using dbstring::tier.
+// Strings in blocks in which fewer than half the entries are live are
+// migrated to new blocks, and blocks without live entries are released.
+struct cold_ref
+{
+    uint32_t block;
+    uint32_t entry;
+};
+static_assert(sizeof(cold_ref) == sizeof(char*), "cold_ref must have the size of a pointer");
+
+// Allocation size of a string in the cold tier.
+static const std::size_t cold_size = sizeof(dbstring) + sizeof(cold_ref);
+
+// Scratch buffers of a thread for characters decoded without thawing, code
+// reading characters with locks held reads at most two strings at a time.
+// Set once the buffers are destroyed on thread exit, thread local
+// destructors which run later, e.g. releases, thaw strings instead.
+static thread_local bool th_peek_exited = false;
+struct peek_scratch
+{
+    static const unsigned count = 4;
+    std::string chars[count];
+    unsigned next = 0;
+
+    ~peek_scratch()
+    {
+        th_peek_exited = true;
+    }
+};
+static thread_local peek_scratch th_peek;
+
+struct cold_store
+{
+    static const uint32_t block_entries = 32;
+
+    struct block
+    {
+        std::vector<uint8_t> bytes;
+        uint32_t count = 0;
+        // Entries referenced by strings, decremented with the lock held for
+        // reading.
+        std::atomic<uint32_t> live{0};
+    };
+
+    benedias::FurwLock1 lock;
+    std::vector<std::unique_ptr<block>> blocks;
+    std::vector<uint32_t> free_blocks;
+    std::atomic<std::size_t> cold_count{0};
+    std::atomic<std::size_t> thawed_count{0};
+
+    static void encode(std::vector<uint8_t>& bytes, std::size_t value)
+    {
+        while(value >= 0x80)
+        {
+            bytes.push_back(uint8_t(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(uint8_t(value));
+    }
+
+    static std::size_t encoded_size(std::size_t value)
+    {
+        std::size_t size = 1;
+        while(value >= 0x80)
+        {
+            value >>= 7;
+            ++size;
+        }
+        return size;
+    }
+
+    static const uint8_t* decode(const uint8_t* ptr, std::size_t& value)
+    {
+        value = 0;
+        unsigned shift = 0;
+        while(*ptr & 0x80)
+        {
+            value |= std::size_t(*ptr++ & 0x7f) << shift;
+            shift += 7;
+        }
+        value |= std::size_t(*ptr++) << shift;
+        return ptr;
+    }
+
+    // Call f(entry, chars) for the entries of blk up to last.
+    template <typename F> static void decode_block(const block& blk, uint32_t last, F f)
+    {
+        std::string chars;
+        const uint8_t* ptr = blk.bytes.data();
+        for(uint32_t ex = 0; ex <= last; ++ex)
+        {
+            std::size_t shared;
+            std::size_t length;
+            ptr = decode(ptr, shared);
+            ptr = decode(ptr, length);
+            chars.resize(shared);
+            chars.append(reinterpret_cast<const char*>(ptr), length);
+            ptr += length;
+            f(ex, chars);
+        }
+    }
+
+    // The cold_ref, or the decompressed characters, of a string which is not
+    // inline.
+    static cold_ref ref_of(const dbstring* dbs)
+    {
+        cold_ref ref;
+        memcpy(&ref, dbs + 1, sizeof(ref));
+        return ref;
+    }
+
+    static char*& thawed_chars(const dbstring* dbs)
+    {
+        return *reinterpret_cast<char**>(const_cast<dbstring*>(dbs) + 1);
+    }
+
+    // Decompress the characters of dbs, which is being thawed.
+    void thaw(const dbstring* dbs)
+    {
+        cold_ref ref = ref_of(dbs);
+        char* chars = static_cast<char*>(benedias::slab_alloc(dbs->length + 1));
+        {
+            benedias::read_lock_guard rdlockg(lock);
+            block& blk = *blocks[ref.block];
+            decode_block(blk, ref.entry, [&](uint32_t ex, const std::string& decoded)
+                    {
+                        if (ex == ref.entry)
+                            memcpy(chars, decoded.data(), dbs->length);
+                    });
+            --blk.live;
+        }
+        chars[dbs->length] = '\0';
+        thawed_chars(dbs) = chars;
+        --cold_count;
+        ++thawed_count;
+    }
+
+    // Decode the characters of dbs, which is being decompressed, to a
+    // scratch buffer of the calling thread, without thawing it. The buffer
+    // is valid until the thread has decoded peek_scratch::count more
+    // strings. Returns nullptr once the buffers have been destroyed on
+    // thread exit.
+    const char* peek(const dbstring* dbs)
+    {
+        if (th_peek_exited)
+            return nullptr;
+        std::string& chars = th_peek.chars[th_peek.next++ % peek_scratch::count];
+        cold_ref ref = ref_of(dbs);
+        benedias::read_lock_guard rdlockg(lock);
+        decode_block(*blocks[ref.block], ref.entry, [&](uint32_t ex, const std::string& decoded)
+                {
+                    if (ex == ref.entry)
+                        chars = decoded;
+                });
+        return chars.c_str();
+    }
+
+    // Release the cold tier resources of dbs, which is being deleted.
+    void release(const dbstring* dbs)
+    {
+        if (dbstring::tier_cold == dbs->tier.load(std::memory_order_relaxed))
+        {
+            benedias::read_lock_guard rdlockg(lock);
+            --blocks[ref_of(dbs).block]->live;
+            --cold_count;
+        }
+        else
+        {
+            benedias::slab_free(thawed_chars(dbs), dbs->length + 1);
+            --thawed_count;
+        }
+    }
+
+    // Inline strings are only migrated if the allocation can be shrunk.
+    static std::size_t shrinkable_bytes(std::size_t length)
+    {
+        std::size_t size = sizeof(dbstring) + length + 1;
+        if (size > benedias::slab_max_size)
+            return 0;
+        std::size_t saved = benedias::slab_usable_size(size) - benedias::slab_usable_size(cold_size);
+        return saved >= benedias::slab_usable_size(1) ? saved : 0;
+    }
+
+    // Change dbs from tier from to the cold tier, referencing ref, with the
+    // lock held for writing, returns false if dbs has been accessed.
+    bool migrate(dbstring* dbs, uint8_t from, cold_ref ref)
+    {
+        if (!dbs->tier.compare_exchange_strong(from, dbstring::tier_converting))
+            return false;
+        switch(from)
+        {
+            case dbstring::tier_inline_idle:
+                if (!benedias::slab_shrink(dbs, sizeof(dbstring) + dbs->length + 1, cold_size))
+                {
+                    dbs->tier.store(dbstring::tier_inline_idle, std::memory_order_release);
+                    return false;
+                }
+                ++cold_count;
+                break;
+            case dbstring::tier_thawed_idle:
+                benedias::slab_free(thawed_chars(dbs), dbs->length + 1);
+                --thawed_count;
+                ++cold_count;
+                break;
+            default:
+                --blocks[ref_of(dbs).block]->live;
+                break;
+        }
+        memcpy(reinterpret_cast<char*>(dbs + 1), &ref, sizeof(ref));
+        ++blocks[ref.block]->live;
+        dbs->tier.store(dbstring::tier_cold, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t new_block()
+    {
+        uint32_t bid;
+        if (free_blocks.empty())
+        {
+            bid = uint32_t(blocks.size());
+            blocks.emplace_back();
+        }
+        else
+        {
+            bid = free_blocks.back();
+            free_blocks.pop_back();
+        }
+        blocks[bid].reset(new block());
+        return bid;
+    }
+
+    // Migrate the idle strings of a shard, and clear the touched state of
+    // the others, with the shard and index write locks held.
+    // Returns the number of strings migrated.
+    std::size_t sweep(const std::vector<dbstring*>& strings)
+    {
+        struct candidate
+        {
+            dbstring* dbs;
+            const char* chars;
+        };
+        std::vector<candidate> candidates;
+        std::vector<std::pair<cold_ref, dbstring*>> sparse;
+        benedias::write_lock_guard wrlockg(lock);
+        for(dbstring* dbs: strings)
+        {
+            uint8_t from = dbs->tier.load(std::memory_order_acquire);
+            switch(from)
+            {
+                case dbstring::tier_inline_exposed:
+                case dbstring::tier_thawed_exposed:
+                    // Pointers to the characters may be in use while the
+                    // string is referenced other than by the directory,
+                    // which holds the only reference if it is 1, and the
+                    // shard write lock keeps lookups from acquiring it.
+                    if (1 == dbs->refcount.load(std::memory_order_relaxed))
+                        dbs->tier.compare_exchange_strong(from, from + 1);
+                    break;
+                case dbstring::tier_inline_touched:
+                case dbstring::tier_thawed_touched:
+                    // Accessors only change idle to touched, or exposed.
+                    dbs->tier.compare_exchange_strong(from, from + 1);
+                    break;
+                case dbstring::tier_inline_idle:
+                    if (shrinkable_bytes(dbs->length))
+                        candidates.push_back(candidate{dbs, reinterpret_cast<const char*>(dbs + 1)});
+                    break;
+                case dbstring::tier_thawed_idle:
+                    candidates.push_back(candidate{dbs, thawed_chars(dbs)});
+                    break;
+                case dbstring::tier_cold:
+                    {
+                        cold_ref ref = ref_of(dbs);
+                        const block& blk = *blocks[ref.block];
+                        if (2 * blk.live.load() < blk.count)
+                            sparse.push_back(std::make_pair(ref, dbs));
+                    }
+                    break;
+                default:
+                    // Being thawed.
+                    break;
+            }
+        }
+
+        // Decompress the strings in sparse blocks, a block at a time.
+        std::sort(sparse.begin(), sparse.end(),
+                [](const std::pair<cold_ref, dbstring*>& lhs, const std::pair<cold_ref, dbstring*>& rhs)
+                {
+                    return lhs.first.block != rhs.first.block ?
+                        lhs.first.block < rhs.first.block : lhs.first.entry < rhs.first.entry;
+                });
+        std::deque<std::string> decoded;
+        for(auto it = sparse.cbegin(); it != sparse.cend();)
+        {
+            auto last = it;
+            while(last != sparse.cend() && last->first.block == it->first.block)
+                ++last;
+            auto next = it;
+            decode_block(*blocks[it->first.block], (last - 1)->first.entry,
+                    [&](uint32_t ex, const std::string& chars)
+                    {
+                        if (next != last && next->first.entry == ex)
+                        {
+                            decoded.push_back(chars);
+                            candidates.push_back(candidate{next->second, decoded.back().data()});
+                            ++next;
+                        }
+                    });
+            it = last;
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+                [](const candidate& lhs, const candidate& rhs)
+                {
+                    return 0 > compare(lhs.chars, lhs.dbs->length, rhs.chars, rhs.dbs->length);
+                });
+        std::size_t migrated = 0;
+        block* blk = nullptr;
+        uint32_t bid = 0;
+        // The previous entry, the characters of migrated strings do not
+        // remain where they were.
+        std::string prev;
+        for(const candidate& cand: candidates)
+        {
+            dbstring* dbs = cand.dbs;
+            std::size_t length = dbs->length;
+            std::size_t shared = 0;
+            std::size_t limit = std::min(prev.size(), length);
+            while(shared < limit && prev[shared] == cand.chars[shared])
+                ++shared;
+            // The cost of the first entry of a block, which is stored in
+            // full, is spread over the block.
+            std::size_t cost = encoded_size(shared) + encoded_size(length - shared) + length - shared;
+            uint8_t from = dbs->tier.load(std::memory_order_relaxed);
+            if (dbstring::tier_inline_idle == from)
+            {
+                if (shrinkable_bytes(length) <= cost)
+                    continue;
+            }
+            else if (dbstring::tier_thawed_idle != from && dbstring::tier_cold != from)
+            {
+                // Accessed since it was found to be idle.
+                continue;
+            }
+            if (nullptr == blk || block_entries == blk->count)
+            {
+                if (blk)
+                    blk->bytes.shrink_to_fit();
+                bid = new_block();
+                blk = blocks[bid].get();
+                shared = 0;
+            }
+            encode(blk->bytes, shared);
+            encode(blk->bytes, length - shared);
+            blk->bytes.insert(blk->bytes.end(), cand.chars + shared, cand.chars + length);
+            prev.assign(cand.chars, length);
+            cold_ref ref{bid, blk->count++};
+            if (migrate(dbs, from, ref) && dbstring::tier_cold != from)
+                ++migrated;
+        }
+        if (blk)
+            blk->bytes.shrink_to_fit();
+
+        // Release blocks without live entries.
+        for(uint32_t ix = 0; ix < blocks.size(); ++ix)
+        {
+            if (blocks[ix] && 0 == blocks[ix]->live.load())
+            {
+                blocks[ix].reset();
+                free_blocks.push_back(ix);
+            }
+        }
+        return migrated;
+    }
+
+    dbstring_cold_stats stats()
+    {
+        dbstring_cold_stats rv = {};
+        benedias::read_lock_guard rdlockg(lock);
+        rv.cold = cold_count.load();
+        rv.thawed = thawed_count.load();
+        for(const std::unique_ptr<block>& blk: blocks)
+        {
+            if (blk)
+            {
+                ++rv.blocks;
+                rv.block_bytes += sizeof(block) + blk->bytes.capacity();
+            }
+        }
+        return rv;
+    }
+};
+// Defined before the directory, which may delete strings in the cold tier
+// when destroyed.
+static cold_store cold_strings;
+#endif
+
+// The string directory is split into shards, each shard has its own hash
+// table and lock, so interning or releasing unrelated strings does not contend.
+// The shard for a string is selected using the upper bits of its hash value,
+// the lower bits are left for bucket selection within the shard hash table.
+static_assert(BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT > 0 &&
+        0 == (BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT & (BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT - 1)),
+        "BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT must be a power of 2");
+const unsigned shard_count = BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT;
+
+// Directory shards implement
+//  find    : lookup, returns an empty sharedobj_ptr if not found.
+//  insert  : add a new string, unless a string with the same value was
+//            added first, returns the string in the directory.
+//  remove_released : drop a reference queued by dbstring::sharedobj_release,
+//            removing the string from the directory if only the directory
+//            reference remains, with a write_guard held.
+//            returns true if the string was removed.
+//  dispose : delete a string removed by remove_released, without a guard.
+//  chains  : the number of buckets and the longest chain probed by a
+//            lookup, with a read_guard, see dbstring_stats.
+//  memory  : the bytes used by the table, with a read_guard.
+//  bucket_count : number of positions in the table, for collect.
+//  collect : acquire a reference to the strings referenced only by the
+//            directory, at positions from to from + count - 1, with a read_guard,
+//            returns the next position.
+//  read_enter, read_leave : enter and leave a read section, for iterators.
+//  size    : the number of strings, with a read section held.
+//  version : incremented whenever a string is added or removed.
+//  first, seek, next, get : positional access for iteration, with a read
+//            section held, get does not acquire the string.
+//  after   : the position following a string, which is referenced so it
+//            remains in the shard, with a read section held, to resume
+//            iteration in a later read section.
+// and for bulk operations, which are made with a read_guard or write_guard
+// for the shard held
+//  lookup  : lookup, with a read_guard or write_guard.
+//  intern  : lookup, creating and adding the string if not found, with a
+//            write_guard.
+//  reserve : make room for additional strings, with a write_guard.
+//  prefetch: prefetch the location of a hash value in the table, lock free
+//            directory only, the locations of the other directories are
+//            not known until the lookup.
+#if defined(BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY)
+// Adaptive radix tree guarded by a read write lock, strings sharing prefixes
+// share inner nodes, and the strings themselves are the leaves, so there is no
+// per string node or key.
+struct dbstring_art_key
+{
+    benedias::art_key operator()(const dbstring* dbs) const
+    {
+        return benedias::art_key{reinterpret_cast<const unsigned char*>(chars_of(dbs)), dbs->size()};
+    }
+};
+typedef benedias::art_tree<dbstring, dbstring_art_key> ARTREE;
+
+struct alignas(64) directory_shard
+{
+    benedias::FurwLock1 lock;
+    ARTREE tree;
+    // Incremented when strings are added or removed, with the write lock held.
+    std::atomic<uint64_t> version{0};
+
+    // Strings are visited in key order, the position is the current string.
+    struct cursor
+    {
+        dbstring* current;
+        bool started;
+
+        bool operator==(const cursor& other) const
+        {
+            return current == other.current && started == other.started;
+        }
+    };
+
+    struct read_guard
+    {
+        benedias::read_lock_guard rdlockg;
+        read_guard(directory_shard& ds):rdlockg(ds.lock) {}
+    };
+
+    void read_enter()
+    {
+        lock.read_lock();
+    }
+
+    void read_leave()
+    {
+        lock.read_unlock();
+    }
+
+    struct write_guard
+    {
+        benedias::write_lock_guard wrlockg;
+        write_guard(directory_shard& ds):wrlockg(ds.lock) {}
+    };
+
+    sharedobj_ptr<dbstring> lookup(const char* chars, std::size_t length, std::size_t)
+    {
+        return sharedobj_ptr<dbstring>(tree.find(reinterpret_cast<const unsigned char*>(chars), length));
+    }
+
+    sharedobj_ptr<dbstring> find(const char* chars, std::size_t length, std::size_t hashv)
+    {
+        read_guard guard(*this);
+        return lookup(chars, length, hashv);
+    }
+
+    void add(dbstring* dbs, std::size_t)
+    {
+        // The directory reference.
+        dbs->sharedobj_acquire();
+        tree.insert(dbs);
+        version.fetch_add(1, std::memory_order_relaxed);
+        string_index.add(dbs);
+        string_trigrams.add(dbs);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+        string_collation.add(dbs);
+#endif
+    }
+
+    sharedobj_ptr<dbstring> insert(sharedobj_ptr<dbstring>& dbs, std::size_t hashv)
+    {
+        write_guard guard(*this);
+        sharedobj_ptr<dbstring> find = lookup(chars_of(dbs.get()), dbs->size(), hashv);
+        if (find)
+            return find;
+        add(dbs.get(), hashv);
+        return dbs;
+    }
+
+    void reserve(std::size_t)
+    {
+    }
+
+    bool remove_released(dbstring* dbs)
+    {
+        // Lookups cannot acquire the string while the write lock is held,
+        // but existing references can be copied or released concurrently.
+        unsigned int rc = dbs->refcount.load();
+        while(true)
+        {
+            if (2 == rc)
+            {
+                // The directory and the queued reference.
+                if (dbs->refcount.compare_exchange_weak(rc, 0))
+                {
+                    tree.erase(dbs);
+                    version.fetch_add(1, std::memory_order_relaxed);
+                    string_index.remove(dbs);
+                    string_trigrams.remove(dbs);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+                    string_collation.remove(dbs);
+#endif
+                    return true;
+                }
+            }
+            else if (dbs->refcount.compare_exchange_weak(rc, rc - 1))
+                return false;
+        }
+    }
+
+    static void dispose(dbstring* dbs)
+    {
+        sharedobj_delete(dbs);
+    }
+
+    // The tree has no buckets, a lookup descends at most its height.
+    void chains(std::size_t& buckets, std::size_t& longest) const
+    {
+        buckets = 0;
+        longest = tree.height();
+    }
+
+    std::size_t memory() const
+    {
+        return tree.memory();
+    }
+
+    std::size_t size() const
+    {
+        return tree.size();
+    }
+
+    // Position 0 is the empty string, position b + 1 the strings starting
+    // with the byte b.
+    std::size_t bucket_count() const
+    {
+        return 257;
+    }
+
+    std::size_t collect(std::size_t from, std::size_t count, std::vector<dbstring*>& candidates)
+    {
+        std::size_t end = std::min<std::size_t>(257, from + count);
+        unsigned char first_byte = uint8_t(from - 1);
+        dbstring* dbs = 0 == from ? tree.first() : tree.lower_bound(&first_byte, 1);
+        for(; dbs; dbs = tree.next(dbs))
+        {
+            std::size_t pos = dbs->size() ? uint8_t(chars_of(dbs)[0]) + 1 : 0;
+            if (pos >= end)
+                break;
+            // The string cannot be removed while the lock is held.
+            // Hot and immortal strings have flags in the use count.
+            if (dbs->refcount.load() == 1)
+            {
+                ++dbs->refcount;
+                candidates.push_back(dbs);
+            }
+        }
+        return end;
+    }
+
+    cursor first() const
+    {
+        return cursor{nullptr, false};
+    }
+
+    bool seek(cursor& itr) const
+    {
+        if (!itr.started)
+        {
+            itr.current = tree.first();
+            itr.started = true;
+        }
+        return nullptr != itr.current;
+    }
+
+    void next(cursor& itr) const
+    {
+        if (itr.current)
+            itr.current = tree.next(itr.current);
+    }
+
+    // The tree is walked in key order, so the walk resumes exactly.
+    cursor after(const dbstring* dbs) const
+    {
+        return cursor{tree.next(dbs), true};
+    }
+
+    dbstring* get(const cursor& itr) const
+    {
+        return itr.current;
+    }
+
+    // Drop the directory references, strings still referenced elsewhere are
+    // deleted when the last reference is released.
+    ~directory_shard()
+    {
+        reap_immediately = false;
+        tree.visit([](dbstring* dbs)
+                {
+                    sharedobj_ptr<dbstring> sp(dbs);
+                    --dbs->refcount;
+                });
+        tree.clear();
+    }
+};
+#elif !defined(BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY)
+// std::unordered_map guarded by a read write lock.
+struct alignas(64) directory_shard
+{
+    benedias::FurwLock1 lock;
+    HASHTABLE table;
+    // Incremented when strings are added or removed, with the write lock held.
+    std::atomic<uint64_t> version{0};
+
+    typedef HASHTABLE::const_iterator cursor;
+
+    struct read_guard
+    {
+        benedias::read_lock_guard rdlockg;
+        read_guard(directory_shard& ds):rdlockg(ds.lock) {}
+    };
+
+    void read_enter()
+    {
+        lock.read_lock();
+    }
+
+    void read_leave()
+    {
+        lock.read_unlock();
+    }
+
+    struct write_guard
+    {
+        benedias::write_lock_guard wrlockg;
+        write_guard(directory_shard& ds):wrlockg(ds.lock) {}
+    };
+
+    sharedobj_ptr<dbstring> lookup(const char* chars, std::size_t length, std::size_t hashv)
+    {
+        HASHTABLE::iterator find = table.find(dbstring_key{chars, length, hashv});
+        if (find != table.end())
+            return sharedobj_ptr<dbstring>(find->second);
+        return sharedobj_ptr<dbstring>();
+    }
+
+    sharedobj_ptr<dbstring> find(const char* chars, std::size_t length, std::size_t hashv)
+    {
+        read_guard guard(*this);
+        return lookup(chars, length, hashv);
+    }
+
+    void add(dbstring* dbs, std::size_t)
+    {
+        // The directory reference.
+        dbs->sharedobj_acquire();
+        table.emplace(key_of(dbs), dbs);
+        version.fetch_add(1, std::memory_order_relaxed);
+        string_index.add(dbs);
+        string_trigrams.add(dbs);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+        string_collation.add(dbs);
+#endif
+    }
+
+    sharedobj_ptr<dbstring> insert(sharedobj_ptr<dbstring>& dbs, std::size_t hashv)
+    {
+        write_guard guard(*this);
+        sharedobj_ptr<dbstring> find = lookup(chars_of(dbs.get()), dbs->size(), hashv);
+        if (find)
+            return find;
+        add(dbs.get(), hashv);
+        return dbs;
+    }
+
+    void reserve(std::size_t count)
+    {
+        table.reserve(table.size() + count);
+    }
+
+    bool remove_released(dbstring* dbs)
+    {
+        // Lookups cannot acquire the string while the write lock is held,
+        // but existing references can be copied or released concurrently.
+        unsigned int rc = dbs->refcount.load();
+        while(true)
+        {
+            if (2 == rc)
+            {
+                // The directory and the queued reference.
+                if (dbs->refcount.compare_exchange_weak(rc, 0))
+                {
+                    table.erase(key_of(dbs));
+                    version.fetch_add(1, std::memory_order_relaxed);
+                    string_index.remove(dbs);
+                    string_trigrams.remove(dbs);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+                    string_collation.remove(dbs);
+#endif
+                    return true;
+                }
+            }
+            else if (dbs->refcount.compare_exchange_weak(rc, rc - 1))
+                return false;
+        }
+    }
+
+    static void dispose(dbstring* dbs)
+    {
+        sharedobj_delete(dbs);
+    }
+
+    void chains(std::size_t& buckets, std::size_t& longest) const
+    {
+        buckets = table.bucket_count();
+        longest = 0;
+        for(std::size_t bx = 0; bx < buckets; ++bx)
+            longest = std::max(longest, table.bucket_size(bx));
+    }
+
+    // An estimate, the buckets and a node per string holding the next
+    // pointer and the entry.
+    std::size_t memory() const
+    {
+        return table.bucket_count() * sizeof(void*)
+            + table.size() * (sizeof(void*) + sizeof(HASHTABLE::value_type));
+    }
+
+    std::size_t size() const
+    {
+        return table.size();
+    }
+
+    std::size_t bucket_count() const
+    {
+        return table.bucket_count();
+    }
+
+    std::size_t collect(std::size_t from, std::size_t count, std::vector<dbstring*>& candidates)
+    {
+        std::size_t end = std::min(table.bucket_count(), from + std::min(count, table.bucket_count()));
+        for(std::size_t bx = from; bx < end; ++bx)
+        {
+            for(auto it = table.cbegin(bx); it != table.cend(bx); ++it)
+            {
+                // The string cannot be removed while the lock is held.
+                // Hot and immortal strings have flags in the use count.
+                if (it->second->refcount.load() == 1)
+                {
+                    ++it->second->refcount;
+                    candidates.push_back(it->second);
+                }
+            }
+        }
+        return end;
+    }
+
+    cursor first() const
+    {
+        return table.cbegin();
+    }
+
+    bool seek(cursor& itr) const
+    {
+        return itr != table.cend();
+    }
+
+    void next(cursor& itr) const
+    {
+        ++itr;
+    }
+
+    // Resizing the table reorders it, the walk may then revisit or miss
+    // strings.
+    cursor after(const dbstring* dbs) const
+    {
+        cursor itr = table.find(key_of(dbs));
+        if (itr != table.cend())
+            ++itr;
+        return itr;
+    }
+
+    dbstring* get(const cursor& itr) const
+    {
+        return itr->second;
+    }
+
+    // Drop the directory references, strings still referenced elsewhere are
+    // deleted when the last reference is released.
+    ~directory_shard()
+    {
+        reap_immediately = false;
+        for(HASHTABLE::iterator it = table.begin(); it != table.end(); ++it)
+        {
+            sharedobj_ptr<dbstring> dbs(it->second);
+            --dbs->refcount;
+        }
+        table.clear();
+    }
+};
+#else
+// Lock free open addressing hash table, lookups do not write to shared
+// memory, modifications are serialised by a mutex.
+// A string is removed from the directory by atomically changing its use count
+// from 2 (the directory reference and the reference of the release queue, or
+// of the reaper) to 0 with the mutex held, lookups only acquire strings with a
+// non zero use count. Removed strings are deleted using
+// epoch based reclamation since lock free lookups may still be accessing them.
+struct dbstring_hash
+{
+    std::size_t operator()(const dbstring* dbs) const
+    {
+        return dbs->hash_value();
+    }
+};
+typedef benedias::lf_hashtable<dbstring, dbstring_hash> LFHASHTABLE;
+
+static void delete_dbstring(void* ptr)
+{
+    sharedobj_delete(static_cast<dbstring*>(ptr));
+}
+
+struct alignas(64) directory_shard
+{
+    std::mutex lock;
+    LFHASHTABLE table;
+    // Incremented when strings are added or removed, with the lock held.
+    std::atomic<uint64_t> version{0};
+
+    struct cursor
+    {
+        const LFHASHTABLE::table* tbl;
+        std::size_t ix;
+
+        bool operator==(const cursor& other) const
+        {
+            return tbl == other.tbl && ix == other.ix;
+        }
+    };
+
+    static inline bool matches(const dbstring* candidate, const char* chars,
+            std::size_t length, std::size_t hashv)
+    {
+        return candidate->hash_value() == hashv && candidate->size() == length
+            && benedias::bytes_equal(candidate->c_str(), chars, length);
+    }
+
+    struct read_guard
+    {
+        benedias::epoch_guard guard;
+        read_guard(directory_shard&) {}
+    };
+
+    void read_enter()
+    {
+        benedias::epoch_enter();
+    }
+
+    void read_leave()
+    {
+        benedias::epoch_leave();
+    }
+
+    struct write_guard
+    {
+        std::lock_guard<std::mutex> lockg;
+        write_guard(directory_shard& ds):lockg(ds.lock) {}
+    };
+
+    // Strings are only removed with the lock held, so with a write_guard
+    // a string found has a non zero use count.
+    sharedobj_ptr<dbstring> lookup(const char* chars, std::size_t length, std::size_t hashv)
+    {
+        dbstring* dbs = table.find(hashv,
+                [=](const dbstring* candidate) { return matches(candidate, chars, length, hashv);});
+        if (dbs && dbs->sharedobj_try_acquire())
+            return sharedobj_ptr<dbstring>::adopt(dbs);
+        return sharedobj_ptr<dbstring>();
+    }
+
+    sharedobj_ptr<dbstring> find(const char* chars, std::size_t length, std::size_t hashv)
+    {
+        read_guard guard(*this);
+        return lookup(chars, length, hashv);
+    }
+
+    void add(dbstring* dbs, std::size_t hashv)
+    {
+        // The directory reference.
+        dbs->sharedobj_acquire();
+        table.insert(dbs, hashv);
+        version.fetch_add(1, std::memory_order_relaxed);
+        string_index.add(dbs);
+        string_trigrams.add(dbs);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+        string_collation.add(dbs);
+#endif
+    }
+
+    sharedobj_ptr<dbstring> insert(sharedobj_ptr<dbstring>& dbs, std::size_t hashv)
+    {
+        write_guard guard(*this);
+        sharedobj_ptr<dbstring> find = lookup(chars_of(dbs.get()), dbs->size(), hashv);
+        if (find)
+            return find;
+        add(dbs.get(), hashv);
+        return dbs;
+    }
+
+    void reserve(std::size_t count)
+    {
+        table.reserve(count);
+    }
+
+    void prefetch(std::size_t hashv) const
+    {
+        table.prefetch(hashv);
+    }
+
+    bool remove_released(dbstring* dbs)
+    {
+        // Lock free lookups may acquire the string concurrently.
+        unsigned int rc = dbs->refcount.load();
+        while(true)
+        {
+            if (2 == rc)
+            {
+                // The directory and the queued reference.
+                if (dbs->refcount.compare_exchange_weak(rc, 0))
+                {
+                    table.erase(dbs, dbs->hash_value());
+                    version.fetch_add(1, std::memory_order_relaxed);
+                    string_index.remove(dbs);
+                    string_trigrams.remove(dbs);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+                    string_collation.remove(dbs);
+#endif
+                    return true;
+                }
+            }
+            else if (dbs->refcount.compare_exchange_weak(rc, rc - 1))
+                return false;
+        }
+    }
+
+    static void dispose(dbstring* dbs)
+    {
+        // Deletion is deferred, lock free lookups may be reading the string.
+        benedias::epoch_retire(dbs, delete_dbstring);
+    }
+
+    void chains(std::size_t& buckets, std::size_t& longest) const
+    {
+        buckets = LFHASHTABLE::capacity(table.get_table());
+        longest = table.longest_run();
+    }
+
+    std::size_t memory() const
+    {
+        return table.memory();
+    }
+
+    // The count is maintained with the lock held.
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lockg(lock);
+        return table.size();
+    }
+
+    std::size_t bucket_count() const
+    {
+        return LFHASHTABLE::capacity(table.get_table());
+    }
+
+    std::size_t collect(std::size_t from, std::size_t count, std::vector<dbstring*>& candidates)
+    {
+        const LFHASHTABLE::table* tbl = table.get_table();
+        std::size_t capacity = LFHASHTABLE::capacity(tbl);
+        std::size_t end = std::min(capacity, from + std::min(count, capacity));
+        for(std::size_t ix = from; ix < end; ++ix)
+        {
+            dbstring* dbs = LFHASHTABLE::at(tbl, ix);
+            // The string may be removed concurrently.
+            // Hot and immortal strings have flags in the use count.
+            if (dbs && dbs->refcount.load() == 1 && dbs->sharedobj_try_acquire())
+                candidates.push_back(dbs);
+        }
+        return end;
+    }
+
+    cursor first() const
+    {
+        return cursor{table.get_table(), 0};
+    }
+
+    bool seek(cursor& itr) const
+    {
+        std::size_t capacity = LFHASHTABLE::capacity(itr.tbl);
+        // Strings being removed have a zero use count.
+        for(; itr.ix < capacity; ++itr.ix)
+        {
+            dbstring* dbs = LFHASHTABLE::at(itr.tbl, itr.ix);
+            if (dbs && 0 != dbs->refcount.load())
+                break;
+        }
+        return itr.ix < capacity;
+    }
+
+    void next(cursor& itr) const
+    {
+        ++itr.ix;
+    }
+
+    // Resizing the table reorders it, the walk may then revisit or miss
+    // strings.
+    cursor after(const dbstring* dbs) const
+    {
+        const LFHASHTABLE::table* tbl = table.get_table();
+        std::size_t ix = LFHASHTABLE::position(tbl, dbs, dbs->hash_value());
+        return cursor{tbl, ix < LFHASHTABLE::capacity(tbl) ? ix + 1 : ix};
+    }
+
+    dbstring* get(const cursor& itr) const
+    {
+        return LFHASHTABLE::at(itr.tbl, itr.ix);
+    }
+
+    // Drop the directory references, strings still referenced elsewhere are
+    // deleted when the last reference is released.
+    ~directory_shard()
+    {
+        reap_immediately = false;
+        table.for_each([](dbstring* dbs)
+                {
+                    sharedobj_ptr<dbstring> sp(dbs);
+                    --dbs->refcount;
+                });
+    }
+};
+#endif
+static directory_shard string_directory[shard_count];
+
+static inline unsigned shard_index(std::size_t hashv)
+{
+    return (hashv >> (sizeof(hashv) * 4)) & (shard_count - 1);
+}
+
+static inline directory_shard& shard_for(std::size_t hashv)
+{
+    return string_directory[shard_index(hashv)];
+}
+
+// With reaping immediate, a release which would leave only the directory
+// reference does not remove the string from the directory there and then,
+// which would take the shard write lock and stall readers on every such
+// release. Instead the string is queued, with the reference being released,
+// on a per thread list. Queued strings are removed in batches, taking the
+// write lock of each shard once per batch. Strings which are acquired again
+// before the batch is processed simply have the queued reference dropped.
+// In the lock free directory removed strings are deleted using epoch based
+// reclamation and readers are never blocked. The locked directory cannot be
+// modified without its write lock, so readers of a shard are still blocked
+// while a batch is removed from it, but once per batch rather than once per
+// release, and deletion happens after the lock is released.
+// A queue is flushed when it is full, when its oldest string has been queued
+// for release_max_delay, by releases on other threads and the background
+// reaper once it is older than that, and by dbstring::reap, so strings
+// released by a thread which then idles are not kept indefinitely.
+static const std::size_t release_batch_size = 64;
+static const std::chrono::milliseconds release_max_delay(10);
+
+// Drop the references to the strings from first to last, all in shard ds,
+// removing those referenced only by the directory, returns the number removed.
+// The write lock is held for at most max_hold at a time (0 => unbounded).
+static std::size_t remove_released(directory_shard& ds,
+        std::vector<dbstring*>::const_iterator first, std::vector<dbstring*>::const_iterator last,
+        std::chrono::microseconds max_hold = std::chrono::microseconds(0))
+{
+    // Check the time every few removals.
+    static const unsigned check_every = 16;
+    std::vector<dbstring*> dead;
+    std::size_t removed = 0;
+    while(first != last)
+    {
+        {
+            directory_shard::write_guard guard(ds);
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned count = 1; first != last; ++count)
+            {
+                if (ds.remove_released(*first))
+                    dead.push_back(*first);
+                ++first;
+                if (max_hold.count() && 0 == count % check_every
+                        && std::chrono::steady_clock::now() - start >= max_hold)
+                    break;
+            }
+        }
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+        dbstring_domain::remove(dead);
+#endif
+        for(auto dbs: dead)
+        {
+#ifdef  DBSTRING_DEBUG_TRACE
+            trace_out << "benedias::memdb::dbstring.reaped " << dbs << " " << dbs->c_str() << std::endl;
+#endif
+            ds.dispose(dbs);
+        }
+        removed += dead.size();
+        dead.clear();
+        if (first != last)
+            std::this_thread::yield();
+    }
+    return removed;
+}
+
+static std::size_t remove_released(std::vector<dbstring*>& released)
+{
+    std::size_t removed = 0;
+    std::sort(released.begin(), released.end(),
+            [](const dbstring* lhs, const dbstring* rhs)
+            {
+                return shard_index(lhs->hash_value()) < shard_index(rhs->hash_value());
+            });
+    for(auto it = released.cbegin(); it != released.cend();)
+    {
+        unsigned s = shard_index((*it)->hash_value());
+        auto last = it;
+        while(last != released.cend() && shard_index((*last)->hash_value()) == s)
+            ++last;
+        removed += remove_released(string_directory[s], it, last);
+        it = last;
+    }
+    released.clear();
+    return removed;
+}
+
+// Remove the strings released by the calling thread.
+static void remove_queued(std::vector<dbstring*>& released)
+{
+    count_stat(stat_release_erases, remove_released(released));
+}
+
+// The lock is held only to add to or take the queued strings, so other
+// threads can flush the queue, and never while they are removed.
+struct release_queue
+{
+    std::mutex lock;
+    std::vector<dbstring*> released;
+    std::chrono::steady_clock::time_point first_queued;
+    // The strings being removed by the owning thread, swapped with released.
+    std::vector<dbstring*> batch;
+    // The list of the queues of live threads.
+    release_queue* prev;
+    release_queue* next;
+
+    release_queue();
+    ~release_queue();
+
+    // Take the queued strings, if @a queued_before is not null only if the
+    // oldest was queued before it.
+    bool take(std::vector<dbstring*>& batch,
+            const std::chrono::steady_clock::time_point* queued_before = nullptr)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (released.empty() || (queued_before && first_queued >= *queued_before))
+            return false;
+        batch.swap(released);
+        return true;
+    }
+};
+
+// The queues of live threads, constant initialised so that threads may
+// release strings during static initialisation.
+static std::mutex release_queues_lock;
+static release_queue* release_queues = nullptr;
+// The time of the next check for stale queues of other threads, as
+// steady_clock ticks.
+static std::atomic<std::chrono::steady_clock::rep> release_check_at(0);
+
+static thread_local release_queue th_releases;
+// Set when th_releases has been destroyed on thread exit, strings released
+// by thread local destructors which run later are removed immediately.
+static thread_local bool th_releases_exited = false;
+
+release_queue::release_queue():prev(nullptr)
+{
+    std::lock_guard<std::mutex> guard(release_queues_lock);
+    next = release_queues;
+    if (next)
+        next->prev = this;
+    release_queues = this;
+}
+
+release_queue::~release_queue()
+{
+    {
+        std::lock_guard<std::mutex> guard(release_queues_lock);
+        if (prev)
+            prev->next = next;
+        else
+            release_queues = next;
+        if (next)
+            next->prev = prev;
+    }
+    take(batch);
+    remove_queued(batch);
+    th_releases_exited = true;
+}
+
+// Remove the strings queued by all threads, if @a queued_before is not null
+// only from the queues with strings queued before it.
+static void flush_all_releases(const std::chrono::steady_clock::time_point* queued_before = nullptr)
+{
+    std::vector<std::vector<dbstring*>> batches;
+    {
+        std::lock_guard<std::mutex> guard(release_queues_lock);
+        for(release_queue* queue = release_queues; queue; queue = queue->next)
+        {
+            batches.emplace_back();
+            if (!queue->take(batches.back(), queued_before))
+                batches.pop_back();
+        }
+    }
+    for(auto& batch: batches)
+        remove_queued(batch);
+}
+
+// Flush the queues of other threads with strings queued for longer than
+// release_max_delay, at most once every release_max_delay.
+static void flush_stale_releases(std::chrono::steady_clock::time_point now)
+{
+    auto check_at = release_check_at.load(std::memory_order_relaxed);
+    if (now.time_since_epoch().count() < check_at
+            || !release_check_at.compare_exchange_strong(check_at,
+                (now + release_max_delay).time_since_epoch().count()))
+        return;
+    std::chrono::steady_clock::time_point queued_before = now - release_max_delay;
+    flush_all_releases(&queued_before);
+}
+
+static void queue_release(dbstring* dbs)
+{
+    if (th_releases_exited)
+    {
+        std::vector<dbstring*> released(1, dbs);
+        remove_queued(released);
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    bool full;
+    {
+        std::lock_guard<std::mutex> guard(th_releases.lock);
+        if (th_releases.released.empty())
+            th_releases.first_queued = now;
+        th_releases.released.push_back(dbs);
+        full = th_releases.released.size() >= release_batch_size
+            || now - th_releases.first_queued >= release_max_delay;
+        if (full)
+            th_releases.batch.swap(th_releases.released);
+    }
+    if (!th_releases.batch.empty())
+        remove_queued(th_releases.batch);
+    flush_stale_releases(now);
+}
+
+static void flush_releases()
+{
+    if (!th_releases_exited && th_releases.take(th_releases.batch))
+        remove_queued(th_releases.batch);
+}
+
+// Hot strings, per thread deferred reference counting.
+// While a string is hot the use count holds hot_flag and hot_bias, the sum of
+// the use count and the net changes held in thread tables is the real use
+// count. The bias keeps the string from being reaped while deferred counts are
+// outstanding, and absorbs flushes of negative deferred counts which are
+// applied before the matching positive counts of other threads.
+// Cooling clears hot_flag and advances hot_generation, each thread flushes all
+// its deferred counts when it sees a new generation, and the bias is removed
+// once every thread table has been flushed at or after the cooling generation.
+static const unsigned int hot_flag = 1u << 31;
+static const unsigned int hot_bias = 1u << 29;
+// Immortal strings, the use count is no longer maintained.
+static const unsigned int immortal_flag = 1u << 30;
+static const unsigned int use_count_mask = hot_bias - 1;
+// Entries per thread table, and the number of entries probed.
+static const unsigned hot_table_size = 64;
+static const unsigned hot_probe_limit = 8;
+
+static std::atomic<unsigned> hot_generation(0);
+
+struct hot_entry
+{
+    dbstring* dbs;
+    long delta;
+};
+
+// Thread tables are never deleted, tables of threads which have exited are
+// reused.
+struct alignas(64) hot_counts
+{
+    std::atomic<bool> in_use;
+    hot_counts* next;
+    // The generation at which the table was last flushed.
+    std::atomic<unsigned> generation;
+    // Only accessed by the owning thread.
+    hot_entry entries[hot_table_size];
+
+    hot_counts():in_use(true),next(nullptr),generation(0),entries{}
+    {
+    }
+
+    void flush()
+    {
+        for(auto& entry: entries)
+        {
+            if (entry.dbs)
+            {
+                if (entry.delta)
+                    entry.dbs->refcount.fetch_add((unsigned int)entry.delta);
+                entry.dbs = nullptr;
+                entry.delta = 0;
+            }
+        }
+    }
+
+    // Add @a delta to the deferred count of @a dbs, returns false if the
+    // change must be applied to the use count.
+    bool update(dbstring* dbs, long delta)
+    {
+        unsigned gen = hot_generation.load();
+        if (generation.load(std::memory_order_relaxed) != gen)
+        {
+            flush();
+            generation.store(gen);
+        }
+        // Checked after the generation, so that counts are never deferred
+        // for a string being cooled, in a table flushed for its generation.
+        if (0 == (dbs->refcount.load() & hot_flag))
+            return false;
+        std::size_t h = (reinterpret_cast<uintptr_t>(dbs) >> 4) * 0x9E3779B97F4A7C15ull;
+        for(unsigned px = 0; px < hot_probe_limit; ++px)
+        {
+            hot_entry& entry = entries[(h + px) & (hot_table_size - 1)];
+            if (entry.dbs == dbs || nullptr == entry.dbs)
+            {
+                entry.dbs = dbs;
+                entry.delta += delta;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void drop_bias(dbstring* dbs)
+    {
+        dbs->refcount.fetch_sub(hot_bias);
+    }
+};
+
+static std::atomic<hot_counts*> hot_tables(nullptr);
+static thread_local hot_counts* th_hot = nullptr;
+// Set once the thread table has been released on thread exit, hot strings
+// copied or released by thread local destructors which run later use the
+// use count directly.
+static thread_local bool th_hot_exited = false;
+
+static void release_hot_counts();
+
+struct hot_counts_releaser
+{
+    ~hot_counts_releaser()
+    {
+        release_hot_counts();
+    }
+};
+static thread_local hot_counts_releaser th_hot_releaser;
+
+static hot_counts* get_hot_counts()
+{
+    if (nullptr == th_hot && !th_hot_exited)
+    {
+        hot_counts* hc;
+        for (hc = hot_tables.load(); hc; hc = hc->next)
+        {
+            bool expected = false;
+            if (!hc->in_use.load(std::memory_order_relaxed)
+                    && hc->in_use.compare_exchange_strong(expected, true))
+                break;
+        }
+        if (nullptr == hc)
+        {
+            void* mem = nullptr;
+            if (0 != posix_memalign(&mem, alignof(hot_counts), sizeof(hot_counts)))
+                throw std::bad_alloc();
+            hc = new (mem) hot_counts();
+            hot_counts* head = hot_tables.load(std::memory_order_relaxed);
+            do
+            {
+                hc->next = head;
+            } while(!hot_tables.compare_exchange_weak(head, hc));
+        }
+        hc->generation.store(hot_generation.load());
+        th_hot = hc;
+        // Ensure the table is flushed and released when the thread exits.
+        (void)&th_hot_releaser;
+    }
+    return th_hot;
+}
+
+static void release_hot_counts()
+{
+    hot_counts* hc = th_hot;
+    th_hot_exited = true;
+    if (nullptr == hc)
+        return;
+    th_hot = nullptr;
+    hc->flush();
+    hc->in_use.store(false);
+}
+
+static inline bool hot_update(dbstring* dbs, long delta)
+{
+    hot_counts* hc = get_hot_counts();
+    return hc && hc->update(dbs, delta);
+}
+
+// Strings being cooled, with the generation at which they were cooled.
+static std::mutex cooling_lock;
+static std::vector<std::pair<dbstring*, unsigned>> cooling;
+
+// Remove the bias from cooled strings, once all thread tables in use have been
+// flushed since they were cooled.
+static void settle_cooling()
+{
+    std::lock_guard<std::mutex> lockg(cooling_lock);
+    if (cooling.empty())
+        return;
+    unsigned oldest = hot_generation.load();
+    for (hot_counts* hc = hot_tables.load(); hc; hc = hc->next)
+    {
+        unsigned gen = hc->generation.load();
+        if (hc->in_use.load() && int(gen - oldest) < 0)
+            oldest = gen;
+    }
+    auto settled = std::partition(cooling.begin(), cooling.end(),
+            [oldest](const std::pair<dbstring*, unsigned>& cooled)
+            {
+                return int(oldest - cooled.second) < 0;
+            });
+    for(auto it = settled; it != cooling.end(); ++it)
+        hot_counts::drop_bias(it->first);
+    cooling.erase(settled, cooling.end());
+}
+
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+static std::shared_ptr<dbstring_domain> no_domain;
+static thread_local std::shared_ptr<dbstring_domain> th_domain = no_domain;
+#endif
+
+// Iteration walks the shards in order, shard == shard_count is the end.
+// The strings are captured in chunks, holding the read section of the shard
+// while references are acquired, and the next chunk resumes after the last
+// string of the current chunk, which the reference keeps in the shard.
+dbstring_iterator::dbstring_iterator(unsigned shard_in):shard(shard_in),pos(0),count(0)
+{
+    fill();
+}
+
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+dbstring_iterator::dbstring_iterator(unsigned shard_in, std::shared_ptr<dbstring_domain> dom_in):
+    shard(shard_in),pos(0),count(0),dom(dom_in),member(0)
+{
+    fill();
+}
+#endif
+
+// Replace the chunk with the next strings, moving on to the next shard at the
+// end of a shard. The references of the previous chunk are released after
+// the read section is left, since releases may remove strings.
+void dbstring_iterator::fill()
+{
+    dbstring* captured[chunk_size];
+    unsigned n = 0;
+    unsigned held = count;
+    const dbstring* last = count ? chunk[count - 1].get() : nullptr;
+    while(0 == n && shard < shard_count)
+    {
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+        if (dom)
+        {
+            // Domain iteration walks the ids of the members of the domain,
+            // shard is 0 until the end.
+            benedias::read_lock_guard rdlockg(domain_lock);
+            for(; n < chunk_size && dom->members.next(member); ++member)
+            {
+                dbstring* dbs = domain_members.strings[member];
+                // The string may be being removed.
+                if (dbs && dbs->sharedobj_try_acquire())
+                    captured[n++] = dbs;
+            }
+            if (0 == n)
+                shard = shard_count;
+            continue;
+        }
+#endif
+        directory_shard& ds = string_directory[shard];
+        {
+            directory_shard::read_guard guard(ds);
+            directory_shard::cursor itr = last ? ds.after(last) : ds.first();
+            for(; n < chunk_size && ds.seek(itr); ds.next(itr))
+            {
+                // In the lock free directory the string may be removed
+                // concurrently.
+                dbstring* dbs = ds.get(itr);
+                if (dbs && dbs->sharedobj_try_acquire())
+                    captured[n++] = dbs;
+            }
+        }
+        if (0 == n)
+        {
+            ++shard;
+            last = nullptr;
+        }
+    }
+    for(unsigned ix = 0; ix < n; ++ix)
+        chunk[ix] = sharedobj_ptr<dbstring>::adopt(captured[ix]);
+    for(unsigned ix = n; ix < held; ++ix)
+        chunk[ix] = sharedobj_ptr<dbstring>();
+    pos = 0;
+    count = n;
+}
+
+bool dbstring_iterator::operator==(const dbstring_iterator& other) const
+{
+    if (shard != other.shard)
+        return false;
+    return shard >= shard_count || chunk[pos] == other.chunk[other.pos];
+}
+
+dbstring_iterator& dbstring_iterator::operator++()
+{
+    if (++pos == count)
+        fill();
+    return *this;
+}
+
+dbstring_iterator dbstring_range::begin() const
+{
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+    if (dom)
+        return dbstring::begin(dom);
+#endif
+    return dbstring::begin();
+}
+
+dbstring_iterator dbstring_range::end() const
+{
+    return dbstring::end();
+}
+
+// class static functions
+dbstring_iterator dbstring::begin()
+{
+    flush_releases();
+    return dbstring_iterator(0);
+}
+
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+dbstring_iterator dbstring::begin(std::shared_ptr<dbstring_domain> dom_in)
+{
+    flush_releases();
+    return dbstring_iterator(0, dom_in);
+}
+#endif
+
+
+dbstring_iterator dbstring::end()
+{
+    return dbstring_iterator(shard_count);
+}
+
+sharedobj_ptr<dbstring> dbstring::make_sharedobj(const char* chars_in)
+{
+    return dbstring::make_sharedobj(chars_in, strlen(chars_in));
+}
+
+sharedobj_ptr<dbstring> dbstring::make_hashed(const char* chars_in, std::size_t length, std::size_t hashv)
+{
+    directory_shard& shard = shard_for(hashv);
+    sharedobj_ptr<dbstring> rv = shard.find(chars_in, length, hashv);
+    if (!rv)
+    {
+        sharedobj_ptr<dbstring> dbs(dbstring::create(chars_in, length, hashv));
+        rv = shard.insert(dbs, hashv);
+        if (rv == dbs)
+        {
+            count_stat(stat_misses);
+#ifdef  DBSTRING_DEBUG_TRACE
+            trace_out << "benedias::memdb::dbstring CREATED " << dbs.get() << " " << dbs->c_str() << std::endl;
+#endif
+            return rv;
+        }
+    }
+    count_stat(stat_hits);
+    return rv;
+}
+
+sharedobj_ptr<dbstring> dbstring::make_sharedobj(const char* chars_in, std::size_t length)
+{
+    return make_hashed(chars_in, length, cstr_hash()(chars_in, length));
+}
+
+// Literals enlisted before the string directory is constructed, both are
+// constant initialised, see literal_interner.
+static dbstring_literal* pending_literals = nullptr;
+static bool literals_ready = false;
+
+dbstring& dbstring_literal::intern() const
+{
+    // Using a literal before the string directory is constructed is not
+    // supported, see dbstring_literal.
+    assert(literals_ready);
+    // Interned with the runtime hash, a literal_hash of the hash policy
+    // which does not match it would otherwise intern the literal at the
+    // wrong location in release builds. Each literal is interned once.
+    std::size_t h = cstr_hash()(chars, length);
+    assert(h == hashv);
+    sharedobj_ptr<dbstring> dbs = dbstring::make_hashed(chars, length, h);
+    dbstring::pin(dbs);
+    interned.store(dbs.get(), std::memory_order_release);
+    return *dbs.get();
+}
+
+void dbstring_literal::enlist()
+{
+    if (interned.load(std::memory_order_relaxed))
+        return;
+    if (literals_ready)
+        intern();
+    else
+    {
+        next = pending_literals;
+        pending_literals = this;
+    }
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY
+// Distance in inputs at which directory locations are prefetched.
+static const std::size_t prefetch_distance = 8;
+#endif
+
+namespace {
+struct bulk_entry
+{
+    const char* chars;
+    std::size_t length;
+    std::size_t hashv;
+};
+}
+
+std::vector<sharedobj_ptr<dbstring>> dbstring::make_sharedobjs(
+        const char* const* chars_in, const std::size_t* lengths, std::size_t count)
+{
+    std::vector<sharedobj_ptr<dbstring>> rv(count);
+    std::vector<bulk_entry> entries(count);
+    // Group the inputs by shard, order holds the input indices sorted by shard,
+    // the inputs for shard s are order[starts[s]] to order[starts[s+1] - 1].
+    std::vector<std::size_t> order(count);
+    std::size_t starts[shard_count + 1] = {};
+
+    std::vector<std::size_t> measured;
+    if (!lengths)
+    {
+        measured.resize(count);
+        for(std::size_t ix = 0; ix < count; ++ix)
+            measured[ix] = strlen(chars_in[ix]);
+        lengths = measured.data();
+    }
+    std::vector<std::size_t> hashes(count);
+    cstr_hash()(chars_in, lengths, count, hashes.data());
+    for(std::size_t ix = 0; ix < count; ++ix)
+    {
+        bulk_entry& entry = entries[ix];
+        entry.chars = chars_in[ix];
+        entry.length = lengths[ix];
+        entry.hashv = hashes[ix];
+        ++starts[shard_index(entry.hashv) + 1];
+    }
+    for(unsigned s = 0; s < shard_count; ++s)
+        starts[s + 1] += starts[s];
+    {
+        std::size_t next[shard_count];
+        std::copy(starts, starts + shard_count, next);
+        for(std::size_t ix = 0; ix < count; ++ix)
+            order[next[shard_index(entries[ix].hashv)]++] = ix;
+    }
+
+    bool single_writer = bulk_loaders.load(std::memory_order_relaxed) > 0;
+    std::vector<std::size_t> misses;
+    std::size_t created = 0;
+    for(unsigned s = 0; s < shard_count; ++s)
+    {
+        if (starts[s] == starts[s + 1])
+            continue;
+        directory_shard& ds = string_directory[s];
+        misses.clear();
+        if (single_writer)
+        {
+            misses.assign(order.begin() + starts[s], order.begin() + starts[s + 1]);
+        }
+        else
+        {
+            directory_shard::read_guard guard(ds);
+            for(std::size_t ox = starts[s]; ox < starts[s + 1]; ++ox)
+            {
+#ifdef  BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY
+                if (ox + prefetch_distance < starts[s + 1])
+                    ds.prefetch(entries[order[ox + prefetch_distance]].hashv);
+#endif
+                std::size_t ix = order[ox];
+                const bulk_entry& entry = entries[ix];
+                rv[ix] = ds.lookup(entry.chars, entry.length, entry.hashv);
+                if (!rv[ix])
+                    misses.push_back(ix);
+            }
+        }
+        if (misses.empty())
+            continue;
+
+        // Only empty sharedobj_ptrs are assigned to with the write guard
+        // held, releasing a string may require the shard lock.
+        directory_shard::write_guard guard(ds);
+        ds.reserve(misses.size());
+        for(std::size_t mx = 0; mx < misses.size(); ++mx)
+        {
+#ifdef  BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY
+            if (mx + prefetch_distance < misses.size())
+                ds.prefetch(entries[misses[mx + prefetch_distance]].hashv);
+#endif
+            std::size_t ix = misses[mx];
+            const bulk_entry& entry = entries[ix];
+            // Either added by another thread, or repeated in the inputs.
+            rv[ix] = ds.lookup(entry.chars, entry.length, entry.hashv);
+            if (!rv[ix])
+            {
+                dbstring* dbs = dbstring::create(entry.chars, entry.length, entry.hashv);
+                ds.add(dbs, entry.hashv);
+                rv[ix] = sharedobj_ptr<dbstring>(dbs);
+                ++created;
+#ifdef  DBSTRING_DEBUG_TRACE
+                trace_out << "benedias::memdb::dbstring CREATED " << dbs << " " << dbs->c_str() << std::endl;
+#endif
+            }
+        }
+    }
+    count_stat(stat_hits, count - created);
+    count_stat(stat_misses, created);
+    return rv;
+}
+
+std::vector<sharedobj_ptr<dbstring>> dbstring::make_sharedobjs(const std::string* stdstrs, std::size_t count)
+{
+    std::vector<const char*> chars(count);
+    std::vector<std::size_t> lengths(count);
+    for(std::size_t ix = 0; ix < count; ++ix)
+    {
+        chars[ix] = stdstrs[ix].data();
+        lengths[ix] = stdstrs[ix].size();
+    }
+    return dbstring::make_sharedobjs(chars.data(), lengths.data(), count);
+}
+
+sharedobj_ptr<dbstring> dbstring::find(const char* chars_in)
+{
+    return dbstring::find(chars_in, strlen(chars_in));
+}
+
+sharedobj_ptr<dbstring> dbstring::find(const char* chars_in, std::size_t length)
+{
+    std::size_t hashv = cstr_hash()(chars_in, length);
+    return shard_for(hashv).find(chars_in, length, hashv);
+}
+
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+sharedobj_ptr<dbstring> dbstring::make_sharedobj(const char* chars_in, std::shared_ptr<dbstring_domain>& dom)
+{
+    return dbstring::make_sharedobj(chars_in, strlen(chars_in), dom);
+}
+
+sharedobj_ptr<dbstring> dbstring::make_sharedobj(const char* chars_in, std::size_t length, std::shared_ptr<dbstring_domain>& dom)
+{
+    sharedobj_ptr<dbstring> rv = dbstring::make_sharedobj(chars_in, length);
+    if (dom)
+        dom->add(rv.get());
+    return rv;
+}
+#endif
+
+void dbstring::delay_reap(bool v)
+{
+    reap_immediately.store(!v);
+}
+
+bool dbstring::is_reap_delayed()
+{
+    return !reap_immediately.load();
+}
+
+dbstring_bulk_load::dbstring_bulk_load()
+{
+    std::lock_guard<std::mutex> guard(bulk_load_lock);
+    if (0 == bulk_loaders.load())
+    {
+        bulk_load_was_delayed = dbstring::is_reap_delayed();
+        dbstring::delay_reap(true);
+    }
+    ++bulk_loaders;
+}
+
+dbstring_bulk_load::~dbstring_bulk_load()
+{
+    bool reap = false;
+    {
+        std::lock_guard<std::mutex> guard(bulk_load_lock);
+        if (0 == --bulk_loaders)
+        {
+            dbstring::delay_reap(bulk_load_was_delayed);
+            reap = !bulk_load_was_delayed;
+        }
+    }
+    if (reap)
+        dbstring::reap();
+}
+
+// The background reaper sweeps the directory a few buckets at a time, when
+// woken by releases which left strings referenced only by the directory.
+// Each step collects candidates from buckets_per_step buckets under the read
+// lock, and removes them holding the write lock for at most max_write_hold_us
+// at a time.
+class background_reaper
+{
+    private:
+        std::mutex lock;
+        std::condition_variable wakeup;
+        std::thread thread;
+        std::atomic<bool> running;
+        dbstring_reaper_limits limits;
+        // limits.wake_after_releases, read without the lock.
+        std::atomic<unsigned> wake_after;
+
+        void sweep(const dbstring_reaper_limits& step_limits)
+        {
+            std::vector<dbstring*> candidates;
+            std::chrono::microseconds max_hold(step_limits.max_write_hold_us);
+            std::size_t step = std::max(1u, step_limits.buckets_per_step);
+            for(unsigned ix = 0; ix < shard_count && running; ++ix)
+            {
+                directory_shard& ds = string_directory[ix];
+                std::size_t pos = 0;
+                std::size_t bucket_count;
+                do
+                {
+                    {
+                        directory_shard::read_guard guard(ds);
+                        bucket_count = ds.bucket_count();
+                        pos = ds.collect(pos, step, candidates);
+                    }
+                    count_stat(stat_background_reaped,
+                            remove_released(ds, candidates.cbegin(), candidates.cend(), max_hold));
+                    candidates.clear();
+                } while(pos < bucket_count && running);
+            }
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lockg(lock);
+            while(running)
+            {
+                wakeup.wait_for(lockg, std::chrono::seconds(1), [this]()
+                        {
+                            return !running || reapable_releases.load() >= wake_after.load();
+                        });
+                if (!running)
+                    continue;
+                // Strings queued for release by threads which have since
+                // been idle.
+                lockg.unlock();
+                flush_stale_releases(std::chrono::steady_clock::now());
+                lockg.lock();
+                if (!running || reapable_releases.load() < wake_after.load())
+                    continue;
+                reapable_releases = 0;
+                dbstring_reaper_limits step_limits = limits;
+                lockg.unlock();
+                sweep(step_limits);
+                lockg.lock();
+            }
+        }
+
+    public:
+        background_reaper():running(false),wake_after(0) {}
+
+        ~background_reaper()
+        {
+            stop();
+        }
+
+        void start(const dbstring_reaper_limits& limits_in)
+        {
+            std::lock_guard<std::mutex> lockg(lock);
+            limits = limits_in;
+            wake_after = limits.wake_after_releases;
+            if (!running)
+            {
+                running = true;
+                thread = std::thread(&background_reaper::run, this);
+            }
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lockg(lock);
+                if (!running)
+                    return;
+                running = false;
+            }
+            wakeup.notify_one();
+            thread.join();
+        }
+
+        bool is_running() const
+        {
+            return running;
+        }
+
+        void wake(unsigned releases)
+        {
+            // Not synchronised with the wait, the reaper also wakes
+            // periodically.
+            if (running && releases >= wake_after.load(std::memory_order_relaxed))
+                wakeup.notify_one();
+        }
+};
+static background_reaper reaper;
+
+static void wake_reaper(unsigned releases)
+{
+    reaper.wake(releases);
+}
+
+void dbstring::background_reap(bool enable, const dbstring_reaper_limits& limits)
+{
+    if (enable)
+        reaper.start(limits);
+    else
+        reaper.stop();
+}
+
+bool dbstring::is_background_reaping()
+{
+    return reaper.is_running();
+}
+
+// Of the last call of dbstring::reap.
+static std::atomic<uint64_t> last_reap_ns(0);
+static std::atomic<uint64_t> last_reaped(0);
+
+void dbstring::reap()
+{
+    auto start = std::chrono::steady_clock::now();
+    flush_all_releases();
+    settle_cooling();
+    // Reap one shard at a time, so that the lock for a shard is held
+    // only for the removal of candidates from that shard.
+    std::vector<dbstring*> candidates;
+    std::size_t reaped = 0;
+    for(unsigned ix = 0; ix < shard_count; ++ix)
+    {
+        directory_shard& ds = string_directory[ix];
+        {
+            directory_shard::read_guard guard(ds);
+            ds.collect(0, ds.bucket_count(), candidates);
+        }
+        reaped += remove_released(ds, candidates.cbegin(), candidates.cend());
+        candidates.clear();
+    }
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    count_stat(stat_reaps);
+    count_stat(stat_reap_ns, elapsed);
+    count_stat(stat_reaped, reaped);
+    last_reap_ns.store(elapsed, std::memory_order_relaxed);
+    last_reaped.store(reaped, std::memory_order_relaxed);
+}
+
+static unsigned length_bucket(std::size_t length)
+{
+    unsigned bucket = 0;
+    while(length && bucket < dbstring_stats::length_buckets - 1)
+    {
+        length >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+dbstring_stats dbstring::stats()
+{
+    // Releases queued by this thread are counted as erased.
+    flush_releases();
+    dbstring_stats rv = {};
+    // The bytes allocated for a string, other than its characters.
+    auto overhead = [](const dbstring* dbs)
+    {
+        std::size_t length = dbs->length;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+        uint8_t tier = dbs->tier.load(std::memory_order_relaxed);
+        if (tier > tier_inline_idle)
+        {
+            std::size_t bytes = benedias::slab_usable_size(cold_size);
+            if (tier >= tier_thawed_exposed)
+                bytes += benedias::slab_usable_size(length + 1) - length;
+            return bytes;
+        }
+#endif
+#ifdef  BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR
+        return benedias::slab_usable_size(sizeof(dbstring) + length + 1) - length;
+#else
+        return sizeof(dbstring) + 1;
+#endif
+    };
+    std::size_t buckets = 0;
+    for(unsigned ix = 0; ix < shard_count; ++ix)
+    {
+        directory_shard& ds = string_directory[ix];
+        directory_shard::read_guard guard(ds);
+        std::size_t shard_buckets;
+        std::size_t longest;
+        ds.chains(shard_buckets, longest);
+        buckets += shard_buckets;
+        rv.longest_chain = std::max(rv.longest_chain, longest);
+        rv.overhead_bytes += ds.memory();
+        for(directory_shard::cursor itr = ds.first(); ds.seek(itr); ds.next(itr))
         {
-            std::lock_guard<std::mutex> lockg(domain_factory_mutex);
-            domain_master[bitnum] = false;
+            // In the lock free directory the string may be removed
+            // concurrently, it is not deleted within the read section.
+            const dbstring* dbs = ds.get(itr);
+            if (nullptr == dbs)
+                continue;
+            ++rv.strings;
+            rv.char_bytes += dbs->length;
+            rv.overhead_bytes += overhead(dbs);
+            ++rv.lengths[length_bucket(dbs->length)];
         }
-};
+    }
+    rv.load_factor = buckets ? double(rv.strings) / buckets : 0.0;
+
+    uint64_t counts[stat_counters] = {};
+    for(unsigned cx = 0; cx < stat_counters; ++cx)
+        counts[cx] = exited_stats.counts[cx].load(std::memory_order_relaxed);
+    for(stats_counts* sc = stats_blocks.load(); sc; sc = sc->next)
+    {
+        for(unsigned cx = 0; cx < stat_counters; ++cx)
+            counts[cx] += sc->counts[cx].load(std::memory_order_relaxed);
+    }
+    rv.hits = counts[stat_hits];
+    rv.misses = counts[stat_misses];
+    rv.release_erases = counts[stat_release_erases];
+    rv.reaps = counts[stat_reaps];
+    rv.reap_ns = counts[stat_reap_ns];
+    rv.reaped = counts[stat_reaped];
+    rv.last_reap_ns = last_reap_ns.load(std::memory_order_relaxed);
+    rv.last_reaped = last_reaped.load(std::memory_order_relaxed);
+    rv.background_reaped = counts[stat_background_reaped];
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+    rv.domain_reaped = counts[stat_domain_reaped];
+#endif
+    return rv;
+}
+
+// Name and value of the counters, in the order written.
+static std::vector<std::pair<const char*, uint64_t>> stats_fields(const dbstring_stats& stats)
+{
+    return {
+        {"strings", stats.strings},
+        {"char_bytes", stats.char_bytes},
+        {"overhead_bytes", stats.overhead_bytes},
+        {"longest_chain", stats.longest_chain},
+        {"hits", stats.hits},
+        {"misses", stats.misses},
+        {"release_erases", stats.release_erases},
+        {"reaps", stats.reaps},
+        {"reap_ns", stats.reap_ns},
+        {"reaped", stats.reaped},
+        {"last_reap_ns", stats.last_reap_ns},
+        {"last_reaped", stats.last_reaped},
+        {"background_reaped", stats.background_reaped},
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+        {"domain_reaped", stats.domain_reaped},
 #endif
+    };
+}
+
+void dbstring_stats::write_text(std::ostream& os) const
+{
+    for(const auto& field: stats_fields(*this))
+        os << field.first << " " << field.second << "\n";
+    os << "load_factor " << load_factor << "\n";
+    os << "lengths";
+    for(std::size_t count: lengths)
+        os << " " << count;
+    os << std::endl;
+}
 
-struct cstr_compare : public std::binary_function<const char*, const char*, bool>
+void dbstring_stats::write_json(std::ostream& os) const
 {
-    bool operator()(const char* lhs, const char* rhs)
+    os << "{";
+    for(const auto& field: stats_fields(*this))
+        os << "\"" << field.first << "\": " << field.second << ", ";
+    os << "\"load_factor\": " << load_factor << ", ";
+    os << "\"lengths\": [";
+    for(unsigned bx = 0; bx < length_buckets; ++bx)
+        os << (bx ? ", " : "") << lengths[bx];
+    os << "]}" << std::endl;
+}
+
+bool dbstring::make_hot(const sharedobj_ptr<dbstring>& dbs)
+{
+    unsigned int rc = dbs->refcount.load();
+    if (rc & immortal_flag)
+        return false;
+    while(0 == (rc & (hot_flag | hot_bias)))
     {
-        return strcmp(lhs,rhs) < 0;
+        if (dbs->refcount.compare_exchange_weak(rc, rc + hot_flag + hot_bias))
+            return true;
     }
-};
+    return 0 != (rc & hot_flag);
+}
 
-struct cstr_equal_to : public std::binary_function<const char*, const char*, bool>
+void dbstring::cool(const sharedobj_ptr<dbstring>& dbs)
 {
-    bool operator()(const char* lhs, const char* rhs) const
+    unsigned int rc = dbs->refcount.load();
+    while(rc & hot_flag)
     {
-        if (lhs == rhs)
-            return true;
-        if ((lhs == 0) || (rhs == 0))
-            return false; 
-        return strcmp(lhs,rhs) == 0;
+        if (dbs->refcount.compare_exchange_weak(rc, rc & ~hot_flag))
+        {
+            std::lock_guard<std::mutex> lockg(cooling_lock);
+            cooling.emplace_back(dbs.get(), hot_generation.fetch_add(1) + 1);
+            break;
+        }
     }
-};
+    settle_cooling();
+}
 
-struct cstr_hash
+void dbstring::flush_hot_counts()
 {
-    std::size_t operator()(const char* cs) const
+    if (th_hot)
     {
-//        return std::hash<std::string>()(std::string(cs));
-#ifndef LOOKUP3_H_INCLUDED
-        std::size_t h = 0;
-        const unsigned char* ucs = (const unsigned char*)cs;
+        th_hot->flush();
+        th_hot->generation.store(hot_generation.load());
+    }
+    settle_cooling();
+}
 
-        if (ucs)
+bool dbstring::is_hot() const
+{
+    return 0 != (refcount.load(std::memory_order_relaxed) & hot_flag);
+}
+
+void dbstring::pin(const sharedobj_ptr<dbstring>& dbs)
+{
+    // A hot string is cooled first, so its deferred counts are flushed to
+    // the use count, make_hot does not make immortal strings hot.
+    unsigned int rc = dbs->refcount.load();
+    while(0 == (rc & immortal_flag))
+    {
+        if (rc & hot_flag)
         {
-            while(*ucs)
-            {
-                h += *ucs;
-                h += (h << 10);
-                h ^= (h >> 6);
-                ++ucs;
-            }
-    
-            h += (h << 3);
-            h ^= (h >> 11);
-            h += (h << 15);
+            cool(dbs);
+            rc = dbs->refcount.load();
         }
-        return h;
-#else
-        std::size_t hashv = (std::size_t)47 + ((std::size_t)13 << 32);
-        if (sizeof(hashv) == 8)
+        else if (dbs->refcount.compare_exchange_weak(rc, rc | immortal_flag))
+            break;
+    }
+}
+
+std::size_t dbstring::pin_most_referenced(std::size_t count)
+{
+    if (0 == count)
+        return 0;
+    typedef std::pair<unsigned int, sharedobj_ptr<dbstring>> counted;
+    auto more_referenced = [](const counted& lhs, const counted& rhs)
+    {
+        return lhs.first > rhs.first;
+    };
+    // A min heap of the most referenced strings seen so far.
+    std::vector<counted> top;
+    top.reserve(count);
+    for(dbstring_iterator itr = dbstring::begin(); itr != dbstring::end(); ++itr)
+    {
+        if (itr->is_immortal())
+            continue;
+        sharedobj_ptr<dbstring> dbs = *itr;
+        unsigned int uses = dbs.use_count();
+        if (top.size() < count)
         {
-            uint32_t* p = (uint32_t *)&hashv;
-            lkp3_hash2(cs, strlen(cs), p, p+1);
+            top.emplace_back(uses, std::move(dbs));
+            std::push_heap(top.begin(), top.end(), more_referenced);
         }
-        else
+        else if (uses > top.front().first)
         {
-            hashv = lkp3_hash(cs, strlen(cs), 47);
+            std::pop_heap(top.begin(), top.end(), more_referenced);
+            top.back() = counted(uses, std::move(dbs));
+            std::push_heap(top.begin(), top.end(), more_referenced);
         }
-        return hashv;
-#endif
     }
-};
-
-//For 100% safety, the lifetime of C string instances used for keys must either 
-// 1) span the lifetime of the associated entry string_directory
-//or
-// 2) exceed the lifetime of string_directory
-// Therefore adding strings must be done with care.
-// Perversely for this use case, setting the "key" to char_seq in the db_string instance
-// is the solution. There isn't a circular dependency because the dbstring instance is
-// guaranteed to exist as long as ther is a single sharedobj_ptr instance, and one exists
-// within the unordered map, and "can" only be deleted after the entry in string_directory
-// is removed.
-typedef std::unordered_map<const char*, sharedobj_ptr<dbstring>, cstr_hash, cstr_equal_to> HASHTABLE;
-static HASHTABLE string_directory;
-#if 0
-typedef std::unordered_map<const char*, dbstring, cstr_hash, cstr_equal_to> HASHTABLE2;
-static HASHTABLE2 shadow;
-#endif
-benedias::FurwLock1 string_directory_lock;
+    for(auto& entry: top)
+        dbstring::pin(entry.second);
+    return top.size();
+}
 
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-static std::shared_ptr<dbstring_domain> no_domain;
-static thread_local std::shared_ptr<dbstring_domain> th_domain = no_domain;
-#endif
+bool dbstring::is_immortal() const
+{
+    return 0 != (refcount.load(std::memory_order_relaxed) & immortal_flag);
+}
 
-class dbstring_iterator_state
+dbstring_snapshot dbstring::snapshot()
 {
-    private:
-        HASHTABLE::const_iterator itr;
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-        std::shared_ptr<dbstring_domain> dom;
-#endif
-        friend dbstring_iterator;
-    public:
-        dbstring_iterator_state(HASHTABLE::const_iterator& itr_in)
-        {
-            itr = itr_in;
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-            seek_valid();
-            dom = no_domain;
-#endif
-        }
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-        dbstring_iterator_state(HASHTABLE::const_iterator& itr_in, std::shared_ptr<dbstring_domain>dom_in)
+    flush_releases();
+    dbstring_snapshot snap;
+    for(unsigned ix = 0; ix < shard_count; ++ix)
+    {
+        directory_shard& ds = string_directory[ix];
+        directory_shard::read_guard guard(ds);
+        snap.captured_version += ds.version.load();
+        snap.strings.reserve(snap.strings.size() + ds.size());
+        for(directory_shard::cursor itr = ds.first(); ds.seek(itr); ds.next(itr))
         {
-            itr = itr_in;
-            dom = dom_in;
-            seek_valid();
+            // In the lock free directory the string may be removed concurrently.
+            dbstring* dbs = ds.get(itr);
+            if (dbs && dbs->sharedobj_try_acquire())
+                snap.strings.push_back(sharedobj_ptr<dbstring>::adopt(dbs));
         }
+    }
+    return snap;
+}
 
-        void seek_valid()
+// Enable or disable an index, which has the members of order_index.
+// The index lock is held while enabled is changed. Disabling clears the index
+// in the same step, so no string is left in the index after it stops being
+// updated. Enabling then adds the strings of each shard in turn holding the
+// shard write lock, strings added concurrently to shards not yet visited are
+// added twice, and ignored by the index the second time.
+// @a before_enable is called with the index lock held before the index is
+// enabled. Returns false if the index was already in the requested state.
+template<typename Index, typename F> static bool toggle_index(Index& index, bool enable, F before_enable)
+{
+    std::lock_guard<std::mutex> lockg(index.toggle_lock);
+    if (enable == index.enabled.load())
+        return false;
+    {
+        benedias::write_lock_guard wrlockg(index.lock);
+        if (enable)
+            before_enable();
+        else
+            index.clear();
+        index.enabled.store(enable);
+    }
+    if (!enable)
+        return true;
+    for(unsigned ix = 0; ix < shard_count; ++ix)
+    {
+        directory_shard& ds = string_directory[ix];
+        directory_shard::write_guard guard(ds);
+        benedias::write_lock_guard wrlockg(index.lock);
+        for(directory_shard::cursor itr = ds.first(); ds.seek(itr); ds.next(itr))
         {
-            if (dom && dom->mask.any())
-            {
-                while(itr != string_directory.cend() && (itr->second->domains &= dom->mask).none())
-                {
-                    ++itr;
-                }
-            }
+            dbstring* dbs = ds.get(itr);
+            if (dbs)
+                index.insert(dbs);
         }
-#endif
-};
+    }
+    return true;
+}
 
-bool dbstring_iterator::operator==(const dbstring_iterator& other)
+template<typename Index> static bool toggle_index(Index& index, bool enable)
 {
-    return state->itr == other.state->itr;
+    return toggle_index(index, enable, []() {});
 }
 
-bool dbstring_iterator::operator!=(const dbstring_iterator& other)
+uint64_t dbstring::version()
 {
-    return state->itr != other.state->itr;
+    uint64_t rv = 0;
+    for(unsigned ix = 0; ix < shard_count; ++ix)
+        rv += string_directory[ix].version.load();
+    return rv;
 }
 
-sharedobj_ptr<dbstring> dbstring_iterator::operator*()
+void dbstring::ordered_index(bool enable)
 {
-    return state->itr->second;
+    toggle_index(string_index, enable);
 }
 
-dbstring_iterator& dbstring_iterator::operator++()
+bool dbstring::is_ordered_indexed()
 {
-    ++(state->itr);
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-    state->seek_valid();
-#endif
-    return *this;
+    return string_index.enabled.load();
 }
 
+std::size_t dbstring::ordered_size()
+{
+    benedias::read_lock_guard rdlockg(string_index.lock);
+    return string_index.tree.size();
+}
 
-// class static functions
-dbstring_iterator dbstring::begin()
+std::size_t dbstring::ordered_lower_bound(const char* chars, std::size_t length)
 {
-    HASHTABLE::const_iterator itr = string_directory.cbegin();
-    return dbstring_iterator(std::make_shared<dbstring_iterator_state>(itr));
+    benedias::read_lock_guard rdlockg(string_index.lock);
+    return string_index.tree.partition_point([=](const dbstring* dbs)
+            {
+                return 0 > compare(chars_of(dbs), dbs->size(), chars, length);
+            });
 }
 
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-dbstring_iterator dbstring::begin(std::shared_ptr<dbstring_domain> dom_in)
+// Positions in the ordered index of the strings starting with prefix, with the
+// index lock held.
+static std::pair<std::size_t, std::size_t> prefix_bounds(const char* prefix, std::size_t length)
 {
-    HASHTABLE::const_iterator itr = string_directory.cbegin();
-    return dbstring_iterator(std::make_shared<dbstring_iterator_state>(itr, dom_in));
+    std::size_t first = string_index.tree.partition_point([=](const dbstring* dbs)
+            {
+                return 0 > compare(chars_of(dbs), dbs->size(), prefix, length);
+            });
+    std::size_t last = string_index.tree.partition_point([=](const dbstring* dbs)
+            {
+                return 0 >= compare(chars_of(dbs), std::min<std::size_t>(dbs->size(), length), prefix, length);
+            });
+    return std::make_pair(first, last);
 }
-#endif
 
+std::pair<std::size_t, std::size_t> dbstring::ordered_prefix(const char* prefix, std::size_t length)
+{
+    benedias::read_lock_guard rdlockg(string_index.lock);
+    return prefix_bounds(prefix, length);
+}
 
-dbstring_iterator dbstring::end()
+std::vector<sharedobj_ptr<dbstring>> dbstring::ordered_range(std::size_t offset, std::size_t count)
 {
-    HASHTABLE::const_iterator itr = string_directory.end();
-    return dbstring_iterator(std::make_shared<dbstring_iterator_state>(itr));
+    std::vector<sharedobj_ptr<dbstring>> rv;
+    benedias::read_lock_guard rdlockg(string_index.lock);
+    string_index.acquire(offset, count, rv);
+    return rv;
 }
 
-sharedobj_ptr<dbstring> dbstring::make_sharedobj(const char* chars_in)
+std::vector<sharedobj_ptr<dbstring>> dbstring::ordered_prefix_range(const char* prefix, std::size_t length,
+        std::size_t offset, std::size_t count)
 {
-#ifdef  DBSTRING_DEBUG_TRACE
-    bool created = false;
-#endif
-    sharedobj_ptr<dbstring> rv;
-    // readlock 
+    std::vector<sharedobj_ptr<dbstring>> rv;
+    benedias::read_lock_guard rdlockg(string_index.lock);
+    std::pair<std::size_t, std::size_t> bounds = prefix_bounds(prefix, length);
+    if (bounds.first + offset < bounds.second)
+        string_index.acquire(bounds.first + offset,
+                std::min(count, bounds.second - bounds.first - offset), rv);
+    return rv;
+}
+
+void dbstring::trigram_index(bool enable)
+{
+    toggle_index(string_trigrams, enable);
+}
+
+bool dbstring::is_trigram_indexed()
+{
+    return string_trigrams.enabled.load();
+}
+
+static std::vector<sharedobj_ptr<dbstring>> search(const char* pattern, std::size_t length, bool ignore_case)
+{
+    std::vector<sharedobj_ptr<dbstring>> rv;
+    if (string_trigrams.enabled.load())
     {
-        benedias::read_lock_guard   rdlockg(string_directory_lock);
-        HASHTABLE::iterator find = string_directory.find(chars_in);
-        if (find != string_directory.end())
+        benedias::read_lock_guard rdlockg(string_trigrams.lock);
+        // The index may have been disabled since.
+        if (string_trigrams.enabled.load())
         {
-            rv = find->second;
+            string_trigrams.search(pattern, length, ignore_case, rv);
+            return rv;
         }
     }
-    // readlock
-    if (!rv)
-    {
-        sharedobj_ptr<dbstring> dbs(new dbstring(chars_in));
-        // writelock
-        {
-            benedias::write_lock_guard   wrlockg(string_directory_lock);
-            HASHTABLE::iterator find = string_directory.find(chars_in);
-            if (find == string_directory.end())
-            {
-                string_directory[dbs->char_seq] = dbs;
-                rv = string_directory[dbs->char_seq];
-#ifdef  DBSTRING_DEBUG_TRACE
-                created = true;
-#endif
-            }
-            else
-            {
-                rv = find->second;
-            }
-        }
-        // writelock
-#ifdef  DBSTRING_DEBUG_TRACE
-    if (created)
+    for(dbstring_iterator itr = dbstring::begin(); itr != dbstring::end(); ++itr)
     {
-        trace_out << "benedias::memdb::dbstring CREATED " << dbs.get() << " " << dbs->char_seq << std::endl;
-    }
-#endif
+        if (contains((*itr).get(), pattern, length, ignore_case))
+            rv.push_back(*itr);
     }
     return rv;
 }
 
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-sharedobj_ptr<dbstring> dbstring::make_sharedobj(const char* chars_in, std::shared_ptr<dbstring_domain>& dom)
+std::vector<sharedobj_ptr<dbstring>> dbstring::containing(const char* chars, std::size_t length)
 {
-    sharedobj_ptr<dbstring> rv = dbstring::make_sharedobj(chars_in);
-    if (dom)
+    return search(chars, length, false);
+}
+
+std::vector<sharedobj_ptr<dbstring>> dbstring::containing_ignore_case(const char* chars, std::size_t length)
+{
+    return search(chars, length, true);
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+void dbstring::collation(bool enable, const dbstring_collation& options)
+{
+    // The index is empty while disabled.
+    if (toggle_index(string_collation, enable, [&options]()
+                {
+                    string_collation.coll.options = options;
+                }) && enable)
     {
-        rv->domains |= dom->mask;
+        benedias::write_lock_guard wrlockg(string_collation.lock);
+        string_collation.freeze();
     }
-    return rv;
 }
-#endif
 
-void dbstring::delay_reap(bool v)
+bool dbstring::is_collated()
 {
-    reap_immediately = !v;
+    return string_collation.enabled.load();
 }
 
-bool dbstring::is_reap_delayed()
+void dbstring::freeze()
 {
-    return !reap_immediately;
+    benedias::write_lock_guard wrlockg(string_collation.lock);
+    string_collation.freeze();
 }
 
-void dbstring::reap()
+// Ordinals are read with the collation lock held, so that freeze or
+// toggling collation does not renumber them part way through a comparison
+// or a sort.
+int dbstring::collate(const dbstring& lhs, const dbstring& rhs)
+{
+    benedias::read_lock_guard rdlockg(string_collation.lock);
+    uint32_t lhs_ordinal = lhs.collation_ordinal();
+    uint32_t rhs_ordinal = rhs.collation_ordinal();
+    if (lhs_ordinal && rhs_ordinal)
+        return lhs_ordinal < rhs_ordinal ? -1 : (lhs_ordinal > rhs_ordinal ? 1 : 0);
+    return string_collation.coll.compare(&lhs, &rhs);
+}
+
+void dbstring::collation_sort(std::vector<sharedobj_ptr<dbstring>>& strings)
 {
-    std::stack<sharedobj_ptr<dbstring>> candidates;
+    benedias::read_lock_guard rdlockg(string_collation.lock);
+    bool ordinals = std::all_of(strings.begin(), strings.end(), [](const sharedobj_ptr<dbstring>& dbs)
+            {
+                return 0 != dbs->collation_ordinal();
+            });
+    if (ordinals)
     {
-        benedias::read_lock_guard rdlockg(string_directory_lock);
-        for(HASHTABLE::const_iterator it = string_directory.cbegin(); it != string_directory.cend(); ++it)
-        {
-            if (it->second.use_count() == 1)
+        ordinal_radix_sort(strings, [](const sharedobj_ptr<dbstring>& dbs)
+                {
+                    return dbs->collation_ordinal();
+                });
+        return;
+    }
+    std::stable_sort(strings.begin(), strings.end(),
+            [](const sharedobj_ptr<dbstring>& lhs, const sharedobj_ptr<dbstring>& rhs)
             {
-                candidates.push(it->second);
-            }
+                uint32_t lhs_ordinal = lhs->collation_ordinal();
+                uint32_t rhs_ordinal = rhs->collation_ordinal();
+                if (lhs_ordinal && rhs_ordinal)
+                    return lhs_ordinal < rhs_ordinal;
+                return 0 > string_collation.coll.compare(lhs.get(), rhs.get());
+            });
+}
+#endif
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+std::size_t dbstring::cold_sweep()
+{
+    std::size_t migrated = 0;
+    std::vector<dbstring*> strings;
+    for(unsigned s = 0; s < shard_count; ++s)
+    {
+        directory_shard& ds = string_directory[s];
+        directory_shard::write_guard guard(ds);
+        // Index code reads the characters of strings with the index lock
+        // held.
+        benedias::write_lock_guard index_lockg(string_index.lock);
+        benedias::write_lock_guard trigrams_lockg(string_trigrams.lock);
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+        benedias::write_lock_guard collation_lockg(string_collation.lock);
+#endif
+        strings.clear();
+        for(directory_shard::cursor itr = ds.first(); ds.seek(itr); ds.next(itr))
+        {
+            dbstring* dbs = ds.get(itr);
+            // Hot and immortal strings have flags in the use count.
+            if (0 == (dbs->refcount.load(std::memory_order_relaxed) & (hot_flag | immortal_flag)))
+                strings.push_back(dbs);
         }
+        migrated += cold_strings.sweep(strings);
+    }
+    return migrated;
+}
+
+dbstring_cold_stats dbstring::cold_stats()
+{
+    return cold_strings.stats();
+}
+#endif
+
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+std::shared_ptr<dbstring_domain> dbstring::get_domain()
+{
+    return std::make_shared<dbstring_domain>();
+}
+
+std::size_t dbstring::domain_size(const std::shared_ptr<dbstring_domain>& dom)
+{
+    benedias::read_lock_guard rdlockg(domain_lock);
+    return dom->size();
+}
+
+std::size_t dbstring::drop_domain(const std::shared_ptr<dbstring_domain>& dom)
+{
+    flush_releases();
+    // Ids are visited in batches, holding domain_lock for reading while
+    // the members referenced only by the directory are acquired. The
+    // dropped ids are not in any domain, so ids are not recycled until the
+    // drop is done, else a later batch could reap strings which were never
+    // members.
+    static const std::size_t drop_batch_size = 256;
+    benedias::roaring_bitmap dropped;
+    {
+        benedias::write_lock_guard wrlockg(domain_lock);
+        std::swap(dropped, dom->members);
+        ++domain_members.drops;
     }
+    std::size_t reaped = 0;
+    std::vector<dbstring*> candidates;
+    uint32_t id = 0;
+    bool more = true;
+    while(more)
     {
-        benedias::write_lock_guard rdlockg(string_directory_lock);
-        while(!candidates.empty())
         {
-            sharedobj_ptr<dbstring> dbs = candidates.top();
-            candidates.pop();
-            assert(dbs.use_count() >= 2);
-            // 2 => 
-            if (dbs.use_count() == 2)
+            benedias::read_lock_guard rdlockg(domain_lock);
+            while((more = dropped.next(id)) && candidates.size() < drop_batch_size)
             {
-                string_directory.erase(dbs->char_seq);
-#ifdef  DBSTRING_DEBUG_TRACE
-        trace_out << "benedias::memdb::dbstring.reaped " << dbs.get() << " " << dbs->char_seq << std::endl;
-#endif
+                dbstring* dbs = domain_members.strings[id++];
+                // Retired ids are nullptr. The string may be being removed
+                // from the directory, so only a use count of exactly the
+                // directory reference is acquired, which also excludes hot
+                // and immortal strings.
+                unsigned int rc = 1;
+                if (dbs && dbs->refcount.compare_exchange_strong(rc, 2))
+                    candidates.push_back(dbs);
             }
         }
+        reaped += remove_released(candidates);
+    }
+    {
+        benedias::write_lock_guard wrlockg(domain_lock);
+        --domain_members.drops;
     }
+    count_stat(stat_domain_reaped, reaped);
+    return reaped;
 }
 
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-std::shared_ptr<dbstring_domain> dbstring::get_domain()
+std::shared_ptr<dbstring_domain> dbstring::domain_intersection(
+        const std::shared_ptr<dbstring_domain>& lhs,
+        const std::shared_ptr<dbstring_domain>& rhs)
 {
-    return std::make_shared<dbstring_domain>();
+    std::shared_ptr<dbstring_domain> dom = std::make_shared<dbstring_domain>();
+    benedias::write_lock_guard wrlockg(domain_lock);
+    dom->members = lhs->members;
+    dom->members.intersect(rhs->members);
+    return dom;
+}
+
+std::shared_ptr<dbstring_domain> dbstring::domain_union(
+        const std::shared_ptr<dbstring_domain>& lhs,
+        const std::shared_ptr<dbstring_domain>& rhs)
+{
+    std::shared_ptr<dbstring_domain> dom = std::make_shared<dbstring_domain>();
+    benedias::write_lock_guard wrlockg(domain_lock);
+    dom->members = lhs->members;
+    dom->members.unite(rhs->members);
+    return dom;
+}
+
+std::shared_ptr<dbstring_domain> dbstring::domain_difference(
+        const std::shared_ptr<dbstring_domain>& lhs,
+        const std::shared_ptr<dbstring_domain>& rhs)
+{
+    std::shared_ptr<dbstring_domain> dom = std::make_shared<dbstring_domain>();
+    benedias::write_lock_guard wrlockg(domain_lock);
+    dom->members = lhs->members;
+    dom->members.subtract(rhs->members);
+    return dom;
 }
 #endif
 
 // member functions
+dbstring* dbstring::create(const char* chars_in, std::size_t length, std::size_t hashv)
+{
+    if (length > UINT32_MAX)
+        throw std::length_error("dbstring::create");
+    // One allocation for the instance and its characters.
+#ifdef  BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR
+    void* mem = benedias::slab_alloc(sizeof(dbstring) + length + 1);
+#else
+    void* mem = ::operator new(sizeof(dbstring) + length + 1);
+#endif
+    char* chars = static_cast<char*>(mem) + sizeof(dbstring);
+    memcpy(chars, chars_in, length);
+    chars[length] = '\0';
+    return new (mem) dbstring(length, hashv);
+}
+
+void sharedobj_delete(dbstring* dbs)
+{
+    // The allocation size is determined by the length.
+    std::size_t size = sizeof(dbstring) + dbs->length + 1;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+    if (dbs->tier.load(std::memory_order_relaxed) > dbstring::tier_inline_idle)
+    {
+        cold_strings.release(dbs);
+        size = cold_size;
+    }
+#endif
+    dbs->~dbstring();
+#ifdef  BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR
+    benedias::slab_free(dbs, size);
+#else
+    (void)size;
+    ::operator delete(dbs);
+#endif
+}
+
 // CTOR
-dbstring::dbstring(const char* chars_in):refcount(0)
+dbstring::dbstring(std::size_t length_in, std::size_t hashv_in):
+    refcount(0), length(uint32_t(length_in)), hashv(hashv_in)
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+    , ordinal(0)
+#endif
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+    , tier(tier_inline_touched)
+#endif
 {
-    char* chars = new char[strlen(chars_in) + 1];
-    strcpy(chars, chars_in);
-    char_seq = chars;
 #ifdef  DBSTRING_DEBUG_TRACE
-    trace_out << "benedias::memdb::dbstring CTOR " << this << " " << char_seq << std::endl;
+    trace_out << "benedias::memdb::dbstring CTOR " << this << " " << char_seq() << std::endl;
 #endif
 }
 
@@ -360,51 +3613,90 @@ dbstring::dbstring(const char* chars_in):refcount(0)
 dbstring::~dbstring()
 {
 #ifdef  DBSTRING_DEBUG_TRACE
-    trace_out << "benedias::memdb::dbstring DTOR " << this << " " << char_seq << std::endl;
+    trace_out << "benedias::memdb::dbstring DTOR " << this << " " << char_seq() << std::endl;
 #endif
 }
-// Comparators
-bool dbstring::operator==(const dbstring& other) const
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+const char* dbstring::cold_chars(access how) const
+{
+    while(true)
+    {
+        uint8_t state = tier.load(std::memory_order_acquire);
+        switch(state)
+        {
+            case tier_inline_exposed:
+            case tier_inline_touched:
+            case tier_inline_idle:
+                if (state - tier_inline_exposed <= how
+                        || tier.compare_exchange_weak(state, tier_inline_exposed + how))
+                    return reinterpret_cast<const char*>(this + 1);
+                break;
+            case tier_thawed_exposed:
+            case tier_thawed_touched:
+            case tier_thawed_idle:
+                if (state - tier_thawed_exposed <= how
+                        || tier.compare_exchange_weak(state, tier_thawed_exposed + how))
+                    return cold_store::thawed_chars(this);
+                break;
+            case tier_cold:
+                if (tier.compare_exchange_weak(state, tier_thawing))
+                {
+                    // Directory and index code, e.g. an index rebuild,
+                    // would otherwise thaw the whole cold tier.
+                    const char* chars = access_read == how ? cold_strings.peek(this) : nullptr;
+                    if (chars)
+                    {
+                        tier.store(tier_cold, std::memory_order_release);
+                        return chars;
+                    }
+                    cold_strings.thaw(this);
+                    tier.store(tier_thawed_exposed + how, std::memory_order_release);
+                    return cold_store::thawed_chars(this);
+                }
+                break;
+            default:
+                // Being migrated, or thawed by another thread.
+                std::this_thread::yield();
+                break;
+        }
+    }
+}
+
+bool dbstring::is_cold() const
 {
-    return 0 == strcmp(char_seq, other.char_seq);
+    return tier_cold == tier.load(std::memory_order_relaxed);
 }
+#endif
 
+// Comparators
 bool dbstring::operator==(const char* c_str) const
 {
-    return 0 == strcmp(char_seq, c_str);
+    std::size_t c_len = strlen(c_str);
+    return length == c_len && benedias::bytes_equal(chars(), c_str, c_len);
 }
 
 bool dbstring::operator==(const std::string& cpp_str) const
 {
-    return 0 == strcmp(char_seq, cpp_str.c_str());
+    return length == cpp_str.size() && benedias::bytes_equal(chars(), cpp_str.data(), length);
 }
 
 bool dbstring::operator<(const dbstring& other) const
 {
-    if (char_seq == other.char_seq)
+    if (this == &other)
         return false;
-    return 0 > strcmp(char_seq, other);
+    return 0 > compare(chars(), length, other.chars(), other.length);
 }
 
 bool dbstring::operator>(const dbstring& other) const
 {
-    return 0 < strcmp(char_seq, other);
+    if (this == &other)
+        return false;
+    return 0 < compare(chars(), length, other.chars(), other.length);
 }
 
 bool dbstring::operator<(const char* c_str) const
 {
-    return 0 > strcmp(char_seq, c_str);
-}
-
-//
-size_t dbstring::size() const
-{
-    return strlen(char_seq);
-}
-
-std::size_t dbstring::hash_value() const
-{
-    return cstr_hash()(char_seq);
+    return 0 > compare(chars(), length, c_str, strlen(c_str));
 }
 
 bool dbstring::sharedobj_release()
@@ -413,40 +3705,69 @@ bool dbstring::sharedobj_release()
     sharedobj_traceout << "sharedobj_release " << this << " " << (refcount) << std::endl;
 #endif
     // If we want immediate release of memory resources, then we have to be careful.
-    unsigned int rc = --refcount;
-    
-    if ((1 == rc) && (reap_immediately))
+    // Releases which do not drop the use count to the directory reference
+    // alone, do not require the lock.
+    unsigned int rc = refcount.load();
+    if (rc & (hot_flag | immortal_flag))
+    {
+        if ((rc & immortal_flag) || hot_update(this, -1))
+            return false;
+    }
+    while(rc > 2 || (2 == rc && !reap_immediately.load(std::memory_order_relaxed)))
+    {
+        if (refcount.compare_exchange_weak(rc, rc - 1))
+        {
+            if (2 == rc)
+                note_reapable_release();
+            return false;
+        }
+    }
+
+    if (2 == rc)
     {
 //trace_out << "sharedobj_release " << this << " " << (refcount) << " " << reap_immediately <<  std::endl;
-        // use count of 2 => string_directory shared_ptr and the caller,
+        // use count of 2 => string_directory reference and the caller,
         // which is relinquishing sharing pointing to this object,
         // so this is a candidate for deletion.
-        // Remove the string from the directory in a thread safe way.
-        benedias::write_lock_guard rdlockg(string_directory_lock);
-        // Have lock, check again remove only if this is still  a candidate
-        // for deletion.
-        if (1 == refcount.load())
-        {
-            string_directory.erase(char_seq);
-            // @here the instance will have been deleted, return false,
-            // to avoid double deletions.
-            return false;
-        }
+        // The caller's reference is queued, the string is removed from the
+        // directory in a batch, see queue_release.
+        queue_release(this);
+        return false;
     }
-    return 0 == rc;
+    return 0 == --refcount;
 }
 
 void dbstring::sharedobj_acquire()
 {
+    unsigned int rc = refcount.load(std::memory_order_relaxed);
+    if (rc & (hot_flag | immortal_flag))
+    {
+        if ((rc & immortal_flag) || hot_update(this, 1))
+            return;
+    }
     ++refcount;
 #ifdef  SHARED_OBJ_DEBUG_TRACE
     sharedobj_traceout << "sharedobj_acquire " << this << " " << refcount << std::endl;
 #endif    
 }
 
+// Deferred counts of hot strings are not included.
 unsigned int dbstring::sharedobj_use_count() const
 {
-    return refcount.load();
+    return refcount.load() & use_count_mask;
+}
+
+bool dbstring::sharedobj_try_acquire()
+{
+    unsigned int rc = refcount.load();
+    if (rc & immortal_flag)
+        return true;
+    while(rc)
+    {
+        if (refcount.compare_exchange_weak(rc, rc + 1))
+            return true;
+    }
+    return false;
 }
 
 
@@ -469,6 +3790,21 @@ sharedobj_ptr<benedias::memdb::dbstring> make_sharedobj(const char* chars)
     return benedias::memdb::dbstring::make_sharedobj(chars);
 #endif
 }
+
+// Interns the literals enlisted before the string directory was constructed,
+// defined last so that it is constructed after every other static of this
+// file.
+struct literal_interner
+{
+    literal_interner()
+    {
+        literals_ready = true;
+        for(dbstring_literal* lit = pending_literals; lit; lit = lit->next)
+            lit->intern();
+        pending_literals = nullptr;
+    }
+};
+static literal_interner interned_literals;
     } // namespace memdb
 
 } // namespace benedias
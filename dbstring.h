@@ -20,21 +20,82 @@ along with this file.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <memory>
 #include <ostream>
-#include <bitset>
+#include <string>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include <algorithm>
 #include <atomic>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
 
 #include "sharedobj.h"
+#include "bdhash.h"
+
+// Number of shards the string directory is split into, must be a power of 2.
+// Each shard has its own hash table and lock.
+#ifndef BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT
+#define BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT    16
+#endif
 
-#ifndef BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT
-#define BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT    32
+// The hash function of the string directory, a hash policy from bdhash.h,
+// or any type with the same interface, including the constexpr literal_hash
+// used for dbstring literals. benedias::lookup3_hash hashes bulk inputs in
+// SIMD lanes.
+// Hash values are not persistent, so changing the hash only requires a
+// rebuild.
+#ifndef BENEDIAS_MEMDB_DBSTRING_HASH
+#define BENEDIAS_MEMDB_DBSTRING_HASH    benedias::wyhash
 #endif
 
 //#define BENEDIAS_USE_DBSTRING_DOMAINS
 
+// Use a lock free hash table for the string directory, lookups of existing
+// strings do not lock. Requires 64 bit pointers.
+//#define BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY
+
+// Use an adaptive radix tree for the string directory, strings sharing
+// prefixes share tree nodes, which uses less memory than a hash table for
+// paths and titles. Lookups take the shard read lock.
+//#define BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY
+
+#if defined(BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY) && defined(BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY)
+#error "BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY and BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY are exclusive"
+#endif
+
+// Allocate dbstrings using the size classed slab allocator (bdslab.h),
+// instead of ::operator new.
+#define BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR
+
+// Support collation ordinals, see dbstring::collation, each dbstring
+// carries a 32 bit ordinal, which adds 8 bytes to a dbstring.
+#define BENEDIAS_MEMDB_DBSTRING_COLLATION
+
+// Support migrating strings which have not been accessed for a while to a
+// compressed cold tier, see dbstring::cold_sweep. Accessing the characters
+// then checks where they are. Requires the slab allocator, not supported by
+// the lock free directory, whose lookups read the characters of strings
+// without a lock, nor by the adaptive radix tree directory, whose lookups
+// read the characters of the strings along the path of the key.
+//#define BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+
+#if defined(BENEDIAS_MEMDB_DBSTRING_COLD_TIER) && !defined(BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR)
+#error "BENEDIAS_MEMDB_DBSTRING_COLD_TIER requires BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR"
+#endif
+#if defined(BENEDIAS_MEMDB_DBSTRING_COLD_TIER) && defined(BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY)
+#error "BENEDIAS_MEMDB_DBSTRING_COLD_TIER and BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY are exclusive"
+#endif
+#if defined(BENEDIAS_MEMDB_DBSTRING_COLD_TIER) && defined(BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY)
+#error "BENEDIAS_MEMDB_DBSTRING_COLD_TIER and BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY are exclusive"
+#endif
+
 namespace benedias {
     namespace memdb {
         // Domains are used "mark" strings as belonging to a set.
-        // A string can belong to multiple domains.
+        // A string can belong to multiple domains, and the number of
+        // domains is not limited.
         // Used for filtering during serialization,
         // domain values are not persistent across multiple runs,
         // and do not need to be serialised.
@@ -42,13 +103,164 @@ namespace benedias {
         class dbstring_domain;
 #endif
         class dbstring_iterator;
+        class dbstring_snapshot;
+        class dbstring_literal;
+        class dbstring;
+
+        //@brief    Limits for the background reaper, see dbstring::background_reap.
+        struct dbstring_reaper_limits
+        {
+            // Number of table buckets scanned per step.
+            unsigned buckets_per_step = 256;
+            // Maximum time a shard write lock is held, in microseconds.
+            unsigned max_write_hold_us = 200;
+            // The reaper is woken after this many releases which leave
+            // strings referenced only by the directory.
+            unsigned wake_after_releases = 4096;
+        };
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+        //@brief    Collation options, see dbstring::collation.
+        struct dbstring_collation
+        {
+            // Compare ASCII letters case insensitively.
+            bool fold_case = true;
+            // Ignore a leading article followed by a space, so that
+            // "The Beatles" collates as "Beatles".
+            bool strip_articles = false;
+            // Articles stripped, compared case insensitively.
+            std::vector<std::string> articles{"the", "a", "an"};
+            // Compare runs of digits by their numeric value, so that
+            // "Track 9" collates before "Track 10".
+            bool natural_numbers = false;
+        };
+#endif
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+        //@brief    Cold tier statistics, see dbstring::cold_stats.
+        struct dbstring_cold_stats
+        {
+            // Strings whose characters are only in the cold tier.
+            std::size_t cold;
+            // Strings in the cold tier which have been accessed since the
+            // last sweep, with their characters decompressed.
+            std::size_t thawed;
+            // Front coded blocks, and the bytes they use.
+            std::size_t blocks;
+            std::size_t block_bytes;
+        };
+#endif
+        //@brief    String pool statistics, see dbstring::stats.
+        struct dbstring_stats
+        {
+            // Histogram buckets of string lengths, bucket 0 counts the empty
+            // string, bucket b lengths from 2^(b-1) to 2^b - 1, and the last
+            // bucket all longer lengths.
+            static const unsigned length_buckets = 16;
+
+            // Strings in the directory, and the bytes of their characters.
+            std::size_t strings;
+            std::size_t char_bytes;
+            // Bytes used by the strings other than their characters,
+            // including allocation rounding, and by the directory tables.
+            // The cold tier and the optional indexes are not included.
+            std::size_t overhead_bytes;
+            // Strings per bucket, or per slot in the lock free directory,
+            // and the longest chain of buckets, or run of occupied slots,
+            // probed by a lookup. The adaptive radix tree has no buckets,
+            // its longest chain is the height of the tree.
+            double load_factor;
+            std::size_t longest_chain;
+            std::size_t lengths[length_buckets];
+
+            // Counts since the process started.
+            // Interning, by dbstring::make_sharedobj and make_sharedobjs,
+            // of strings found in the directory, and of new strings.
+            uint64_t hits;
+            uint64_t misses;
+            // Strings removed from the directory when they were released.
+            uint64_t release_erases;
+            // Calls of dbstring::reap, the time spent in them, and the
+            // strings they removed.
+            uint64_t reaps;
+            uint64_t reap_ns;
+            uint64_t reaped;
+            // Of the last call of dbstring::reap.
+            uint64_t last_reap_ns;
+            uint64_t last_reaped;
+            // Strings removed by the background reaper.
+            uint64_t background_reaped;
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+            // Strings removed by dbstring::drop_domain.
+            uint64_t domain_reaped;
+#endif
+
+            //@brief    Write the statistics as "name value" lines.
+            void write_text(std::ostream& os) const;
+            //@brief    Write the statistics as a JSON object.
+            void write_json(std::ostream& os) const;
+        };
+
+        // Destroys and frees a dbstring, used by sharedobj_ptr.
+        void sharedobj_delete(dbstring* dbs);
 
         //@brief    immutable string object for in memory database use.
+        // A dbstring is a single variable size allocation, the fixed size
+        // fields are followed immediately by the NUL terminated characters.
+        // Strings migrated to the cold tier are shrunk to the fixed size
+        // fields and a reference to their entry in a front coded block.
         //class dbstring:public benedias::sharedobj<dbstring>
         class dbstring
         {
             private:
                 std::atomic_uint refcount;
+                uint32_t length;
+                std::size_t hashv;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+                std::atomic<uint32_t> ordinal;
+#endif
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+                // Where the characters are, and whether they have been
+                // accessed since the last cold sweep, or a pointer to them
+                // returned while the string is referenced. The exposed,
+                // touched and idle states are in access order.
+                enum : uint8_t
+                {
+                    // Characters follow the fixed size fields.
+                    tier_inline_exposed,
+                    tier_inline_touched,
+                    tier_inline_idle,
+                    // Being migrated by a cold sweep.
+                    tier_converting,
+                    // Characters only in the cold tier.
+                    tier_cold,
+                    // Being decompressed, or read without thawing.
+                    tier_thawing,
+                    // Characters decompressed to an allocation, pointed to
+                    // by the pointer following the fixed size fields.
+                    tier_thawed_exposed,
+                    tier_thawed_touched,
+                    tier_thawed_idle,
+                };
+                // How the characters are accessed, the offset from the
+                // exposed state of the state the string is left in.
+                enum access : uint8_t
+                {
+                    // A pointer to the characters is returned, they are
+                    // not migrated while the string is referenced.
+                    access_expose,
+                    // Not migrated by the next cold sweep.
+                    access_touch,
+                    // Directory and index code, the string is not touched.
+                    access_read,
+                };
+                // Mutable, accessing the characters updates it.
+                mutable std::atomic<uint8_t> tier;
+                // Returns the characters, if the string is not inline and
+                // accessed at least as much as @a how, decompressing them if
+                // they are only in the cold tier. With access_read cold
+                // strings are not thawed, the characters are decompressed to
+                // a scratch buffer of the calling thread.
+                const char* cold_chars(access how) const;
+#endif
 
                 // To reduce the size impact, we explicitly implement sharedobj
                 // interface, instead of inheriting it.
@@ -56,11 +268,40 @@ namespace benedias {
                 void sharedobj_acquire();
                 bool sharedobj_release();
                 unsigned int sharedobj_use_count() const;
+                // Acquire only if the use count is not 0.
+                bool sharedobj_try_acquire();
 
-                const char* char_seq;
-#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
-                std::bitset<BENEDIAS_MEMDB_DBSTRING_MAX_DOMAIN_COUNT> domains;
+                // The characters, for use with a directory shard, or an
+                // index, lock held, which cold sweeps exclude.
+                inline const char* char_seq() const
+                {
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+                    if (tier.load(std::memory_order_acquire) > tier_inline_idle)
+                        return cold_chars(access_read);
+#endif
+                    return reinterpret_cast<const char*>(this + 1);
+                }
+                // The characters, for the accessors, marks the string as
+                // accessed so it is not migrated to the cold tier.
+                inline const char* chars() const
+                {
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+                    if (tier.load(std::memory_order_acquire) > tier_inline_touched)
+                        return cold_chars(access_touch);
 #endif
+                    return reinterpret_cast<const char*>(this + 1);
+                }
+                // The characters, for the accessors returning a pointer to
+                // them, which then remain where they are while the string
+                // is referenced.
+                inline const char* exposed_chars() const
+                {
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+                    if (tier.load(std::memory_order_acquire) != tier_inline_exposed)
+                        return cold_chars(access_expose);
+#endif
+                    return reinterpret_cast<const char*>(this + 1);
+                }
                 // Non copyable
                 dbstring& operator=(const dbstring&) = delete;
                 dbstring(dbstring const&) = delete;
@@ -68,40 +309,322 @@ namespace benedias {
                 // Non movable
                 dbstring& operator=(dbstring&&) = delete;
                 dbstring(dbstring&&) = delete;
-                friend class dbstring_iterator_state;
+                friend class dbstring_iterator;
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+                friend class dbstring_domain;
+#endif
+                friend struct directory_shard;
+                friend struct hot_counts;
+                friend struct order_index;
+                friend struct collation_index;
+                friend struct trigram_index;
+                friend struct dbstring_chars;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+                friend struct cold_store;
+#endif
+                friend void sharedobj_delete(dbstring* dbs);
+                ~dbstring();
 //                template <class... Args> friend sharedobj_ptr<benedias::memdb::dbstring> make_sharedobj(Args&&... args);
             protected:
-                dbstring(const char*);
+                dbstring(std::size_t length, std::size_t hashv);
+                //@brief    Allocate and construct a dbstring with a copy of
+                // the @a length characters at @a chars.
+                static dbstring* create(const char* chars, std::size_t length, std::size_t hashv);
+                //@brief    Find or intern the string with the hash @a hashv.
+                static sharedobj_ptr<dbstring> make_hashed(const char* chars, std::size_t length, std::size_t hashv);
+                friend class dbstring_literal;
                 friend sharedobj_ptr<benedias::memdb::dbstring> make_sharedobj(const char* args);
             public:
-                ~dbstring();
-
                 // CTOR factory methods.
+                // The (chars, length) forms are binary safe, the characters
+                // need not be NUL terminated and may include NULs.
+                static sharedobj_ptr<dbstring> make_sharedobj(const char* chars, std::size_t length);
                 static sharedobj_ptr<dbstring> make_sharedobj(const char* chars);
                 static sharedobj_ptr<dbstring> make_sharedobj(const std::string& stdstr)
                 {
-                    return dbstring::make_sharedobj(stdstr.c_str());
+                    return dbstring::make_sharedobj(stdstr.data(), stdstr.size());
+                }
+#if __cplusplus >= 201703L
+                static sharedobj_ptr<dbstring> make_sharedobj(std::string_view strv)
+                {
+                    return dbstring::make_sharedobj(strv.data(), strv.size());
                 }
+#endif
+
+                //@brief    Bulk interning, returns the strings for @a count
+                // inputs, in the same order.
+                // All hash values are computed up front, several strings at
+                // once if the hash policy supports it, the inputs are then
+                // grouped by directory shard, hits are resolved within one
+                // read section and misses inserted within one write section
+                // for each shard.
+                // If @a lengths is nullptr the inputs are NUL terminated.
+                static std::vector<sharedobj_ptr<dbstring>> make_sharedobjs(
+                        const char* const* chars, const std::size_t* lengths, std::size_t count);
+                static std::vector<sharedobj_ptr<dbstring>> make_sharedobjs(
+                        const std::string* stdstrs, std::size_t count);
+                static std::vector<sharedobj_ptr<dbstring>> make_sharedobjs(
+                        const std::vector<std::string>& stdstrs)
+                {
+                    return dbstring::make_sharedobjs(stdstrs.data(), stdstrs.size());
+                }
+#if __cplusplus >= 201703L
+                static std::vector<sharedobj_ptr<dbstring>> make_sharedobjs(
+                        const std::string_view* strvs, std::size_t count)
+                {
+                    std::vector<const char*> chars(count);
+                    std::vector<std::size_t> lengths(count);
+                    for(std::size_t ix = 0; ix < count; ++ix)
+                    {
+                        chars[ix] = strvs[ix].data();
+                        lengths[ix] = strvs[ix].size();
+                    }
+                    return dbstring::make_sharedobjs(chars.data(), lengths.data(), count);
+                }
+#endif
+
+                //@brief    Lookup only, returns the string if it exists,
+                // otherwise returns an empty sharedobj_ptr.
+                // Never allocates or takes a write lock.
+                static sharedobj_ptr<dbstring> find(const char* chars, std::size_t length);
+                static sharedobj_ptr<dbstring> find(const char* chars);
+                static sharedobj_ptr<dbstring> find(const std::string& stdstr)
+                {
+                    return dbstring::find(stdstr.data(), stdstr.size());
+                }
+#if __cplusplus >= 201703L
+                static sharedobj_ptr<dbstring> find(std::string_view strv)
+                {
+                    return dbstring::find(strv.data(), strv.size());
+                }
+#endif
 #ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+                static sharedobj_ptr<dbstring> make_sharedobj(const char* chars, std::size_t length, std::shared_ptr<dbstring_domain>& dom);
                 static sharedobj_ptr<dbstring> make_sharedobj(const char* chars, std::shared_ptr<dbstring_domain>& dom);
                 static sharedobj_ptr<dbstring> make_sharedobj(const std::string& stdstr, std::shared_ptr<dbstring_domain>& dom)
                 {
-                    return dbstring::make_sharedobj(stdstr.c_str(), dom);
+                    return dbstring::make_sharedobj(stdstr.data(), stdstr.size(), dom);
                 }
+#if __cplusplus >= 201703L
+                static sharedobj_ptr<dbstring> make_sharedobj(std::string_view strv, std::shared_ptr<dbstring_domain>& dom)
+                {
+                    return dbstring::make_sharedobj(strv.data(), strv.size(), dom);
+                }
+#endif
 
                 static std::shared_ptr<dbstring_domain> get_domain();
+                //@brief    Iterator over the members of a domain, which walks
+                // the member bitmap of the domain, so the cost is proportional
+                // to the number of members. The members are captured in
+                // chunks holding the domain read lock, see dbstring_iterator.
                 static dbstring_iterator begin(std::shared_ptr<dbstring_domain>);
+                //@brief    Remove all the strings from a domain, and reap the
+                // former members which are referenced only by the directory,
+                // in batches, without scanning the rest of the directory.
+                // Members referenced elsewhere are kept, as are their
+                // memberships of other domains. The domain remains usable.
+                // Returns the number of strings reaped.
+                static std::size_t drop_domain(const std::shared_ptr<dbstring_domain>& dom);
+                //@brief    Returns the number of strings in a domain.
+                static std::size_t domain_size(const std::shared_ptr<dbstring_domain>& dom);
+                //@brief    Returns a new domain of the strings in both domains.
+                static std::shared_ptr<dbstring_domain> domain_intersection(
+                        const std::shared_ptr<dbstring_domain>& lhs,
+                        const std::shared_ptr<dbstring_domain>& rhs);
+                //@brief    Returns a new domain of the strings in either domain.
+                static std::shared_ptr<dbstring_domain> domain_union(
+                        const std::shared_ptr<dbstring_domain>& lhs,
+                        const std::shared_ptr<dbstring_domain>& rhs);
+                //@brief    Returns a new domain of the strings in @a lhs which
+                // are not in @a rhs.
+                static std::shared_ptr<dbstring_domain> domain_difference(
+                        const std::shared_ptr<dbstring_domain>& lhs,
+                        const std::shared_ptr<dbstring_domain>& rhs);
 #endif
                 static void delay_reap(bool);
                 static bool is_reap_delayed();
+                //@brief    Start or stop the background reaper thread, which
+                // incrementally reaps strings referenced only by the
+                // directory, intended for use with delay_reap(true).
+                // If the reaper is running @a limits are updated.
+                static void background_reap(bool enable,
+                        const dbstring_reaper_limits& limits = dbstring_reaper_limits());
+                static bool is_background_reaping();
 
                 static dbstring_iterator begin();
                 static dbstring_iterator end();
 
+                //@brief    Capture the strings in the directory, see
+                // dbstring_snapshot.
+                static dbstring_snapshot snapshot();
+                //@brief    Returns the directory version, which changes
+                // whenever a string is added to or removed from the directory.
+                static uint64_t version();
+
+                //@brief    Enable or disable the ordered index, which holds
+                // the strings in the directory in lexicographic order, and is
+                // updated as strings are interned and reaped. Enabling builds
+                // the index from the directory.
+                // Positions in the index are those at the time of the call,
+                // they shift as strings are interned and reaped.
+                static void ordered_index(bool enable);
+                static bool is_ordered_indexed();
+                //@brief    Returns the number of strings in the ordered index.
+                static std::size_t ordered_size();
+                //@brief    Returns the position in the ordered index of the
+                // first string which is not less than @a chars.
+                static std::size_t ordered_lower_bound(const char* chars, std::size_t length);
+                static std::size_t ordered_lower_bound(const std::string& stdstr)
+                {
+                    return dbstring::ordered_lower_bound(stdstr.data(), stdstr.size());
+                }
+                //@brief    Returns the positions [first, second) in the
+                // ordered index of the strings starting with @a prefix.
+                static std::pair<std::size_t, std::size_t> ordered_prefix(const char* prefix, std::size_t length);
+                static std::pair<std::size_t, std::size_t> ordered_prefix(const std::string& prefix)
+                {
+                    return dbstring::ordered_prefix(prefix.data(), prefix.size());
+                }
+                //@brief    Returns up to @a count strings from the ordered
+                // index, starting at position @a offset.
+                static std::vector<sharedobj_ptr<dbstring>> ordered_range(std::size_t offset, std::size_t count);
+                //@brief    Returns up to @a count of the strings starting with
+                // @a prefix in order, skipping the first @a offset of them.
+                static std::vector<sharedobj_ptr<dbstring>> ordered_prefix_range(
+                        const char* prefix, std::size_t length,
+                        std::size_t offset = 0, std::size_t count = SIZE_MAX);
+                static std::vector<sharedobj_ptr<dbstring>> ordered_prefix_range(
+                        const std::string& prefix, std::size_t offset = 0, std::size_t count = SIZE_MAX)
+                {
+                    return dbstring::ordered_prefix_range(prefix.data(), prefix.size(), offset, count);
+                }
+
+                //@brief    Enable or disable the trigram index, an inverted
+                // index of the trigrams of the strings in the directory, with
+                // ASCII case folded, which is updated as strings are interned
+                // and reaped. Enabling builds the index from the directory.
+                static void trigram_index(bool enable);
+                static bool is_trigram_indexed();
+                //@brief    Returns the strings containing the @a length
+                // characters at @a chars, using the trigram index if enabled,
+                // otherwise scanning the directory.
+                // Single character patterns are checked against every
+                // string.
+                static std::vector<sharedobj_ptr<dbstring>> containing(const char* chars, std::size_t length);
+                static std::vector<sharedobj_ptr<dbstring>> containing(const std::string& stdstr)
+                {
+                    return dbstring::containing(stdstr.data(), stdstr.size());
+                }
+                //@brief    As containing, ignoring ASCII case.
+                static std::vector<sharedobj_ptr<dbstring>> containing_ignore_case(const char* chars, std::size_t length);
+                static std::vector<sharedobj_ptr<dbstring>> containing_ignore_case(const std::string& stdstr)
+                {
+                    return dbstring::containing_ignore_case(stdstr.data(), stdstr.size());
+                }
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+                //@brief    Enable or disable collation ordinals. When enabled
+                // every string in the directory is given a collation ordinal,
+                // such that the ordinals of two strings compare as the strings
+                // collate using @a options, so sorting by collation is sorting
+                // 32 bit integers, see ordinal_radix_sort.
+                // Ordinals are assigned by freeze, spread over the 32 bit
+                // range, strings interned later are given an ordinal between
+                // those of their neighbours, or 0 if there is no room, until
+                // the next freeze.
+                // Enabling assigns ordinals to the strings in the directory.
+                // To change @a options disable and enable again.
+                static void collation(bool enable, const dbstring_collation& options = dbstring_collation());
+                static bool is_collated();
+                //@brief    Reassign the collation ordinals of all strings in
+                // the directory. Interning blocks for the duration.
+                // Ordinals read before a freeze should not be compared with
+                // ordinals read after it.
+                static void freeze();
+                //@brief    Returns the collation ordinal, 0 if not assigned.
+                inline uint32_t collation_ordinal() const
+                {
+                    return ordinal.load(std::memory_order_relaxed);
+                }
+                //@brief    Compares @a lhs and @a rhs by collation, returns
+                // a value less than, equal to, or greater than 0.
+                // Strings with ordinals are compared by ordinal, otherwise
+                // their characters are compared. Holds the collation read
+                // lock, so ordinals are not reassigned during the comparison.
+                static int collate(const dbstring& lhs, const dbstring& rhs);
+                //@brief    Stable sort of @a strings by collation, a radix
+                // sort of their ordinals if all of them have one. Holds the
+                // collation read lock, so ordinals are not reassigned during
+                // the sort.
+                static void collation_sort(std::vector<sharedobj_ptr<dbstring>>& strings);
+#endif
+
                 static void reap();
 
+                //@brief    Returns the statistics of the string pool.
+                // The counters are kept per thread and summed, and the
+                // directory is scanned a shard at a time with the read
+                // section of the shard held, so the statistics are
+                // approximate while strings are interned and released.
+                static dbstring_stats stats();
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+                //@brief    Migrate strings to the cold tier.
+                // Strings in the directory which have not been accessed since
+                // the previous sweep have their characters moved to sorted,
+                // front coded blocks, and their allocation shrunk, if that
+                // saves memory. The characters are decompressed when next
+                // accessed, and migrated back by a later sweep.
+                // Pointers returned by c_str and the conversion to const
+                // char* remain valid while the string is referenced, strings
+                // whose characters have been returned so are only migrated
+                // once they are referenced only by the directory.
+                // Call this periodically, e.g. every few minutes.
+                // Interning and releasing strings in a shard blocks while the
+                // shard is swept.
+                // Hot and immortal strings are never migrated.
+                // Returns the number of strings migrated.
+                static std::size_t cold_sweep();
+                static dbstring_cold_stats cold_stats();
+                //@brief    Returns true if the characters are only in the
+                // cold tier.
+                bool is_cold() const;
+#endif
+
+                //@brief    Switch @a dbs to per thread deferred reference
+                // counting, for strings shared by very many rows and copied
+                // concurrently by many threads, e.g. "Unknown Artist".
+                // Each thread keeps the net change to the use count of hot
+                // strings in a small thread local table, copies and releases
+                // are then plain increments and decrements of thread local
+                // memory, instead of atomic operations on a shared cache line.
+                // Hot strings are never reaped.
+                // Returns false if @a dbs is being cooled, or is immortal.
+                static bool make_hot(const sharedobj_ptr<dbstring>& dbs);
+                //@brief    Switch @a dbs back to atomic reference counting.
+                // The string becomes reapable once every thread using hot
+                // strings has flushed its deferred counts, threads flush on
+                // their next use of a hot string, on flush_hot_counts and on
+                // exit.
+                static void cool(const sharedobj_ptr<dbstring>& dbs);
+                //@brief    Flush the deferred use counts of the calling thread.
+                static void flush_hot_counts();
+                bool is_hot() const;
+
+                //@brief    Pin @a dbs for the lifetime of the process, copies
+                // and releases of an immortal string do not update its use
+                // count, and it is never reaped. A hot string is cooled
+                // first.
+                static void pin(const sharedobj_ptr<dbstring>& dbs);
+                //@brief    Scan the directory and pin the @a count most
+                // referenced strings, returns the number of strings pinned.
+                static std::size_t pin_most_referenced(std::size_t count);
+                bool is_immortal() const;
+
                 // Comparators
-                bool operator==(const dbstring& dbstr) const;
+                //@brief    Strings are interned, so equal strings are the
+                // same instance.
+                bool operator==(const dbstring& dbstr) const { return this == &dbstr; }
                 bool operator==(const char* c_str) const;
                 bool operator==(const std::string& cpp_str) const;
 
@@ -110,38 +633,262 @@ namespace benedias {
                 bool operator>(const dbstring& dbstr) const;
 
                 //Conversions
-                inline operator const char*() const { return char_seq; }
-                inline operator std::string() const { return std::string(char_seq);}
-                inline const char* c_str() const { return char_seq; }
-                inline std::string std_str() const { return std::string(char_seq);}
+                inline operator const char*() const { return exposed_chars(); }
+                inline operator std::string() const { return std::string(chars(), length);}
+                inline const char* c_str() const { return exposed_chars(); }
+                inline std::string std_str() const { return std::string(chars(), length);}
 
                 friend std::ostream& operator<< (std::ostream& os, const dbstring& dbstr)
                 {
-                    os << dbstr.char_seq;
+                    os.write(dbstr.chars(), dbstr.length);
                     return os;
                 }
 
-                //Hashing support
-                std::size_t hash_value() const;
+                //Hashing support, the hash value is computed once on creation.
+                inline std::size_t hash_value() const { return hashv; }
 
                 //
-                size_t size() const;
+                inline size_t size() const { return length; }
         };
 
-        class dbstring_iterator_state;
+        //@brief    Iterator over the strings in the directory.
+        // Iteration does not allocate, the iterator holds references to a
+        // chunk of the strings of a shard, captured holding the read section
+        // of the shard, which is left before the strings are visited, so the
+        // iterating thread may intern, release and reap strings, and
+        // interning is only held up while a chunk is captured.
+        // Strings added or removed while iterating may or may not be
+        // visited, and if the hash table of a shard of the default or lock
+        // free directories is resized while it is walked its strings may be
+        // visited twice or missed, see dbstring_snapshot for a consistent
+        // view.
         class dbstring_iterator
         {
+            public:
+                // The number of strings captured at a time.
+                static const unsigned chunk_size = 32;
             private:
-                std::shared_ptr<dbstring_iterator_state> state;
+                // shard_count => end
+                unsigned shard;
+                // The current string is chunk[pos] of count.
+                unsigned pos;
+                unsigned count;
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+                std::shared_ptr<dbstring_domain> dom;
+                // The next member id of dom to capture.
+                uint32_t member;
+#endif
+                sharedobj_ptr<dbstring> chunk[chunk_size];
+                friend class dbstring;
+                explicit dbstring_iterator(unsigned shard_in);
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+                dbstring_iterator(unsigned shard_in, std::shared_ptr<dbstring_domain> dom_in);
+#endif
+                void fill();
             public:
-                dbstring_iterator(std::shared_ptr<dbstring_iterator_state> state_in) { state = state_in;}
-                ~dbstring_iterator() {}
-                bool operator==(const dbstring_iterator& other);
-                bool operator!=(const dbstring_iterator& other);
+                bool operator==(const dbstring_iterator& other) const;
+                bool operator!=(const dbstring_iterator& other) const
+                {
+                    return !(*this == other);
+                }
                 dbstring_iterator& operator++();
-                sharedobj_ptr<dbstring>operator*();
+                const sharedobj_ptr<dbstring>& operator*() const { return chunk[pos]; }
+                const dbstring* operator->() const { return chunk[pos].get(); }
+                //@brief    Returns a reference to the current string, which
+                // can be kept after the iterator is destroyed.
+                sharedobj_ptr<dbstring> share() const { return chunk[pos]; }
+        };
+
+        //@brief    The strings in the directory, for range based for loops.
+        //  for(const sharedobj_ptr<dbstring>& dbs: dbstring_range()) ...
+        class dbstring_range
+        {
+#ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+            private:
+                std::shared_ptr<dbstring_domain> dom;
+            public:
+                dbstring_range() {}
+                explicit dbstring_range(std::shared_ptr<dbstring_domain> dom_in):dom(dom_in) {}
+#endif
+            public:
+                dbstring_iterator begin() const;
+                dbstring_iterator end() const;
+        };
+
+        //@brief    A view of the strings in the directory at the time it was
+        // captured, which can be iterated at leisure while strings are
+        // interned and reaped.
+        // The directory is captured one shard at a time, holding the read
+        // section of a single shard while its strings are referenced, so
+        // interning is only held up in the shard being captured, and not
+        // at all in the lock free directory.
+        // The snapshot holds a reference to each string, strings which are
+        // released while the snapshot exists are reaped after it is destroyed.
+        class dbstring_snapshot
+        {
+            private:
+                std::vector<sharedobj_ptr<dbstring>> strings;
+                uint64_t captured_version;
+                friend class dbstring;
+                dbstring_snapshot():captured_version(0) {}
+            public:
+                typedef std::vector<sharedobj_ptr<dbstring>>::const_iterator const_iterator;
+
+                const_iterator begin() const { return strings.cbegin(); }
+                const_iterator end() const { return strings.cend(); }
+                std::size_t size() const { return strings.size(); }
+                //@brief    Returns the directory version at the capture.
+                uint64_t version() const { return captured_version; }
+                //@brief    Returns true if no strings have been added to or
+                // removed from the directory since the capture.
+                bool is_current() const { return captured_version == dbstring::version(); }
+        };
+
+        //@brief    Bulk load mode, for the lifetime of the instance reaping
+        // is delayed and dbstring::make_sharedobjs resolves hits and inserts
+        // misses within a single write section for each shard, skipping the
+        // read section.
+        // Intended for a single thread loading strings, for example a library
+        // scan, other threads may continue to use dbstrings.
+        // Instances may overlap, on destruction of the last instance the
+        // reaping mode at the creation of the first is restored, if reaping
+        // was immediate strings released during the load are reaped.
+        class dbstring_bulk_load
+        {
+            public:
+                dbstring_bulk_load();
+                ~dbstring_bulk_load();
+
+                // Non copyable
+                dbstring_bulk_load(const dbstring_bulk_load&) = delete;
+                dbstring_bulk_load& operator=(const dbstring_bulk_load&) = delete;
+        };
+
+        //@brief    A string literal interned as an immortal string, see the
+        // _dbs literal operator.
+        // Literals are constant initialised with their hash computed at
+        // compile time, and interned and pinned during static
+        // initialisation, so each use is a load of the interned string.
+        // Literals enlisted before the string directory is constructed are
+        // interned once it is, and a literal used by a later static
+        // initialiser before it is interned is interned on that use.
+        // Using a literal in a static initialiser which runs before the
+        // string directory is constructed, i.e. one in another translation
+        // unit without an ordering guarantee, is not supported.
+        class dbstring_literal
+        {
+            private:
+                const char* chars;
+                std::size_t length;
+                std::size_t hashv;
+                mutable std::atomic<dbstring*> interned;
+                // Literals waiting for the string directory to be
+                // constructed.
+                dbstring_literal* next;
+                friend struct literal_interner;
+                dbstring& intern() const;
+            public:
+                constexpr dbstring_literal(const char* chars_in, std::size_t length_in, std::size_t hashv_in)
+                    :chars(chars_in), length(length_in), hashv(hashv_in), interned(nullptr), next(nullptr) {}
+
+                // Non copyable
+                dbstring_literal(const dbstring_literal&) = delete;
+                dbstring_literal& operator=(const dbstring_literal&) = delete;
+
+                //@brief    Intern the literal, or queue it until the string
+                // directory is constructed, called from the static
+                // initialiser of each literal.
+                void enlist();
+
+                const dbstring& get() const
+                {
+                    dbstring* dbs = interned.load(std::memory_order_acquire);
+                    return dbs ? *dbs : intern();
+                }
+                const dbstring& operator*() const { return get(); }
+                const dbstring* operator->() const { return &get(); }
+                operator const dbstring&() const { return get(); }
+                //@brief    Returns a pointer to the immortal string, copies
+                // do not update its use count.
+                sharedobj_ptr<dbstring> ptr() const { return sharedobj_ptr<dbstring>(&const_cast<dbstring&>(get())); }
         };
 
+        namespace literal_detail {
+            template <typename C, C... cs> struct holder
+            {
+                static constexpr C chars[] = {cs..., C(0)};
+                // Constant initialised.
+                static dbstring_literal literal;
+
+                struct enlister
+                {
+                    enlister() { literal.enlist(); }
+                };
+                static enlister enlisted;
+            };
+
+            template <typename C, C... cs> constexpr C holder<C, cs...>::chars[];
+            template <typename C, C... cs> dbstring_literal holder<C, cs...>::literal{
+                holder<C, cs...>::chars, sizeof...(cs),
+                BENEDIAS_MEMDB_DBSTRING_HASH::literal_hash(holder<C, cs...>::chars, sizeof...(cs))};
+            template <typename C, C... cs> typename holder<C, cs...>::enlister holder<C, cs...>::enlisted;
+        } // namespace literal_detail
+
+        namespace literals {
+            //@brief    Returns the interned literal, e.g.
+            //  using namespace benedias::memdb::literals;
+            //  if (*artist == "Unknown Artist"_dbs) ...
+            // Uses the GNU string literal operator template extension.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+            template <typename C, C... cs> inline const dbstring_literal& operator"" _dbs()
+            {
+                static_assert(std::is_same<C, char>::value, "dbstring literals must be narrow string literals");
+                // Odr-use the enlister, so each literal is interned at
+                // static initialisation.
+                (void)&literal_detail::holder<C, cs...>::enlisted;
+                return literal_detail::holder<C, cs...>::literal;
+            }
+#pragma GCC diagnostic pop
+        } // namespace literals
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+        //@brief    Stable LSD radix sort of @a items by the 32 bit value
+        // returned by @a key, typically a collation ordinal.
+        // Rows are sorted by several columns by sorting by the least
+        // significant column first, e.g. by title, then album, then artist.
+        template <typename T, typename Key> void ordinal_radix_sort(std::vector<T>& items, Key key)
+        {
+            std::vector<uint32_t> keys;
+            keys.reserve(items.size());
+            for(const T& item: items)
+                keys.push_back(key(item));
+            std::vector<uint32_t> order(items.size());
+            std::vector<uint32_t> next(items.size());
+            for(std::size_t ix = 0; ix < order.size(); ++ix)
+                order[ix] = uint32_t(ix);
+            for(unsigned shift = 0; shift < 32; shift += 8)
+            {
+                std::size_t counts[257] = {};
+                for(uint32_t k: keys)
+                    ++counts[((k >> shift) & 0xff) + 1];
+                // Skip passes which do not reorder.
+                if (std::find(counts + 1, counts + 257, items.size()) != counts + 257)
+                    continue;
+                for(unsigned ix = 1; ix < 257; ++ix)
+                    counts[ix] += counts[ix - 1];
+                for(uint32_t ix: order)
+                    next[counts[(keys[ix] >> shift) & 0xff]++] = ix;
+                order.swap(next);
+            }
+            std::vector<T> sorted;
+            sorted.reserve(items.size());
+            for(uint32_t ix: order)
+                sorted.push_back(std::move(items[ix]));
+            items.swap(sorted);
+        }
+#endif
+
 //@brief    Allocates and constructs and object of type @a T and returns a
 //object of type @a sharedobj_ptr<T>.
 //template <class... Args> sharedobj_ptr<benedias::memdb::dbstring> make_sharedobj(Args&&... args);
@@ -0,0 +1,216 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is part of sqzbsrv.
+
+sqzbsrv is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+sqzbsrv is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
+
+Multi threaded benchmark of dbstring::make_sharedobj, preceded by a single
+threaded benchmark of loading new strings, singly and in bulk.
+Built three times, dirbench uses the std::unordered_map + FurwLock1 string
+directory, dirbench_lf uses the lock free string directory, and dirbench_art
+the adaptive radix tree string directory.
+The memory used by the directory is reported in bytes per string, excluding
+the strings themselves, which are allocated by the slab allocator.
+
+usage: dirbench [max threads [lookups per thread]]
+*/
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include <malloc.h>
+#include "dbstring.h"
+
+using benedias::memdb::dbstring;
+using benedias::sharedobj_ptr;
+
+static const unsigned corpus_size = 200000;
+
+// Strings resembling music library tags and paths.
+static std::vector<std::string> make_corpus(unsigned count, unsigned seed)
+{
+    std::vector<std::string> corpus;
+    char buf[256];
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned v = i * 2654435761u + seed;
+        switch(i % 4)
+        {
+            case 0:
+                snprintf(buf, sizeof(buf), "Artist %u", v % 100000);
+                break;
+            case 1:
+                snprintf(buf, sizeof(buf), "The Album Number %u (Remastered)", v);
+                break;
+            case 2:
+                snprintf(buf, sizeof(buf), "%02u - Track title %u", v % 20, v);
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "/srv/music/Artist %u/Album %u/%02u - Track %u.flac",
+                        v % 1000, v % 7919, v % 20, v);
+                break;
+        }
+        corpus.push_back(std::string(buf) + "#" + std::to_string(i));
+    }
+    return corpus;
+}
+
+static inline unsigned xorshift(unsigned& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Every latency_sample_every hit lookups the latency of a lookup is sampled.
+static const unsigned latency_sample_every = 16;
+
+// Returns lookups per second, and the 99th percentile latency of hit
+// lookups in @a p99_ns.
+// Every miss_every lookups one lookup is of a new string, which is released
+// immediately, (0 => only hits).
+static double run(const std::vector<std::string>& corpus, unsigned nthreads,
+        unsigned lookups, unsigned miss_every, double& p99_ns)
+{
+    std::vector<std::thread> threads;
+    std::vector<std::vector<double>> samples(nthreads);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < nthreads; t++)
+    {
+        threads.emplace_back([&corpus, &samples, lookups, miss_every, t]()
+            {
+                std::vector<double>& latencies = samples[t];
+                latencies.reserve(lookups / latency_sample_every + 1);
+                unsigned state = 2463534242u + t;
+                std::string miss = "miss " + std::to_string(t) + " ";
+                std::size_t total = 0;
+                for (unsigned i = 0; i < lookups; i++)
+                {
+                    if (miss_every && 0 == i % miss_every)
+                    {
+                        total += dbstring::make_sharedobj(miss + std::to_string(i))->size();
+                    }
+                    else if (0 == i % latency_sample_every)
+                    {
+                        const std::string& s = corpus[xorshift(state) % corpus.size()];
+                        auto lookup_start = std::chrono::steady_clock::now();
+                        total += dbstring::make_sharedobj(s.c_str())->size();
+                        std::chrono::duration<double, std::nano> latency =
+                            std::chrono::steady_clock::now() - lookup_start;
+                        latencies.push_back(latency.count());
+                    }
+                    else
+                    {
+                        const std::string& s = corpus[xorshift(state) % corpus.size()];
+                        total += dbstring::make_sharedobj(s.c_str())->size();
+                    }
+                }
+                if (0 == total)
+                    abort();
+            });
+    }
+    for (auto& th: threads)
+        th.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> latencies;
+    for (auto& v: samples)
+        latencies.insert(latencies.end(), v.begin(), v.end());
+    auto p99 = latencies.begin() + latencies.size() * 99 / 100;
+    std::nth_element(latencies.begin(), p99, latencies.end());
+    p99_ns = latencies.empty() ? 0 : *p99;
+    return (double(lookups) * nthreads) / elapsed.count();
+}
+
+// Returns strings interned per second, loading a corpus of new strings
+//  0: one at a time using make_sharedobj
+//  1: using make_sharedobjs
+//  2: using make_sharedobjs in bulk load mode
+static double load(unsigned mode, unsigned seed)
+{
+    std::vector<std::string> corpus = make_corpus(corpus_size, seed);
+    std::vector<sharedobj_ptr<dbstring>> loaded;
+    loaded.reserve(corpus.size());
+    auto start = std::chrono::steady_clock::now();
+    if (0 == mode)
+    {
+        for (auto& s: corpus)
+            loaded.push_back(dbstring::make_sharedobj(s));
+    }
+    else if (1 == mode)
+    {
+        loaded = dbstring::make_sharedobjs(corpus);
+    }
+    else
+    {
+        benedias::memdb::dbstring_bulk_load bulk_load;
+        loaded = dbstring::make_sharedobjs(corpus);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return double(corpus.size()) / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned max_threads = std::thread::hardware_concurrency();
+    unsigned lookups = 1000000;
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        lookups = atoi(argv[2]);
+    if (max_threads < 1)
+        max_threads = 1;
+
+#if defined(BENEDIAS_MEMDB_DBSTRING_LOCKFREE_DIRECTORY)
+    std::cout << "string directory: lock free hash table";
+#elif defined(BENEDIAS_MEMDB_DBSTRING_ART_DIRECTORY)
+    std::cout << "string directory: adaptive radix tree + FurwLock1";
+#else
+    std::cout << "string directory: std::unordered_map + FurwLock1";
+#endif
+    std::cout << ", " << BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT << " shards" << std::endl;
+
+    printf("load Mstrings/s, make_sharedobj %.2f, make_sharedobjs %.2f, bulk load %.2f\n",
+            load(0, 1) / 1e6, load(1, 2) / 1e6, load(2, 3) / 1e6);
+
+    std::vector<std::string> corpus = make_corpus(corpus_size, 17);
+    // Hold references so that lookups of the corpus are hits.
+    std::vector<sharedobj_ptr<dbstring>> held;
+    held.reserve(corpus.size());
+    std::size_t base = mallinfo2().uordblks;
+    for (auto& s: corpus)
+        held.push_back(dbstring::make_sharedobj(s));
+    printf("directory bytes per string %.1f\n", double(mallinfo2().uordblks - base) / corpus.size());
+
+    std::cout << "threads    hits Mlookups/s  p99 ns    1% misses Mlookups/s  p99 ns" << std::endl;
+    for (unsigned nthreads = 1;; nthreads = std::min(nthreads * 2, max_threads))
+    {
+        double hits_p99, mixed_p99;
+        double hits = run(corpus, nthreads, lookups, 0, hits_p99);
+        double mixed = run(corpus, nthreads, lookups, 100, mixed_p99);
+        printf("%7u    %15.2f  %6.0f    %20.2f  %6.0f\n", nthreads,
+                hits / 1e6, hits_p99, mixed / 1e6, mixed_p99);
+        if (nthreads == max_threads)
+            break;
+    }
+    return 0;
+}
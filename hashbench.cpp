@@ -0,0 +1,245 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is part of sqzbsrv.
+
+sqzbsrv is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+sqzbsrv is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Benchmark of the hash policies in bdhash.h, for choosing
+BENEDIAS_MEMDB_DBSTRING_HASH.
+For each corpus of music library tags, short artist names, track titles and
+long file paths, reports the hashing throughput, singly and in bulk with
+hash_many, the throughput of lookup3 in 1, 4 and 8 SIMD lanes, as limited
+by the CPU, checking the lanes agree with lookup3, and the distribution of the
+hash values over a power of 2 table indexed by the low bits, as by the lock
+free directory, and over the directory shards.
+The distribution is reported as the longest chain, and the chi squared
+statistic divided by the number of buckets, which is close to 1 for a
+uniform hash.
+
+usage: hashbench [number of strings]
+*/
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include "bdhash.h"
+#include "dbstring.h"
+
+static const char* first_names[] = {
+    "John", "Paul", "Ella", "Nina", "Miles", "Aretha", "Bob", "Joni",
+    "David", "Billie", "Ray", "Etta", "Frank", "Patti", "Leonard", "Kate",
+};
+static const char* last_names[] = {
+    "Smith", "Davis", "Simone", "Mitchell", "Bowie", "Holiday", "Charles",
+    "James", "Sinatra", "Smith", "Cohen", "Bush", "Franklin", "Fitzgerald",
+};
+static const char* words[] = {
+    "love", "night", "heart", "blue", "dream", "fire", "rain", "light",
+    "world", "time", "dance", "river", "summer", "shadow", "star", "road",
+};
+
+template <typename T, std::size_t N> static inline const char* pick(T (&arr)[N], unsigned& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return arr[(seed >> 16) % N];
+}
+
+// Short artist names, e.g. "Nina Bowie 12".
+static std::vector<std::string> make_artists(unsigned count)
+{
+    std::vector<std::string> corpus;
+    unsigned seed = 1;
+    for (unsigned i = 0; i < count; i++)
+    {
+        std::string s = pick(first_names, seed);
+        s += ' ';
+        s += pick(last_names, seed);
+        s += ' ' + std::to_string(i / 200);
+        corpus.push_back(s);
+    }
+    // Names are picked at random, so some are repeated.
+    std::sort(corpus.begin(), corpus.end());
+    corpus.erase(std::unique(corpus.begin(), corpus.end()), corpus.end());
+    return corpus;
+}
+
+// Track titles of 1 to 4 words.
+static std::vector<std::string> make_titles(unsigned count)
+{
+    std::vector<std::string> corpus;
+    unsigned seed = 2;
+    for (unsigned i = 0; i < count; i++)
+    {
+        std::string s;
+        for (unsigned w = 0; w <= i % 4; w++)
+        {
+            if (w)
+                s += ' ';
+            s += pick(words, seed);
+        }
+        s += " " + std::to_string(i);
+        corpus.push_back(s);
+    }
+    return corpus;
+}
+
+// Paths of tracks, which differ only near the end.
+static std::vector<std::string> make_paths(unsigned count)
+{
+    std::vector<std::string> corpus;
+    char buf[256];
+    unsigned seed = 3;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const char* first = pick(first_names, seed);
+        const char* last = pick(last_names, seed);
+        snprintf(buf, sizeof(buf), "/srv/music/library/%s %s/Album %u (Remastered)/%02u - %s %s.flac",
+                first, last, i / 12, i % 12 + 1, pick(words, seed), pick(words, seed));
+        corpus.push_back(buf);
+    }
+    return corpus;
+}
+
+static volatile std::size_t sink;
+
+// Returns nanoseconds per hash.
+template <typename H> static double throughput(const std::vector<std::string>& corpus)
+{
+    static const unsigned repeat = 20;
+    H hash;
+    std::size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        for (const std::string& s: corpus)
+            total += hash(s.data(), s.size());
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    sink = total;
+    return elapsed.count() / (double(repeat) * corpus.size());
+}
+
+// Returns nanoseconds per hash, of hashes of the whole corpus at once.
+template <typename H> static double bulk_throughput(const std::vector<const char*>& chars,
+        const std::vector<std::size_t>& lengths, std::vector<std::size_t>& hashes)
+{
+    static const unsigned repeat = 20;
+    hashes.resize(chars.size());
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < repeat; r++)
+        H::hash_many(chars.data(), lengths.data(), chars.size(), hashes.data());
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (double(repeat) * chars.size());
+}
+
+// Returns nanoseconds per hash of lookup3 in @a lanes lanes, and counts the
+// hashes which differ from lookup3_hash in @a wrong.
+static double lanes_throughput(const std::vector<const char*>& chars,
+        const std::vector<std::size_t>& lengths, unsigned lanes, std::size_t& wrong)
+{
+    static const unsigned repeat = 20;
+    std::vector<std::size_t> hashes(chars.size());
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < repeat; r++)
+        benedias::lookup3_hash::hash_lanes(chars.data(), lengths.data(), chars.size(), hashes.data(), lanes);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    wrong = 0;
+    for (std::size_t ix = 0; ix < chars.size(); ix++)
+        wrong += hashes[ix] != benedias::lookup3_hash()(chars[ix], lengths[ix]);
+    return elapsed.count() / (double(repeat) * chars.size());
+}
+
+struct distribution
+{
+    unsigned longest;
+    double chi2;
+    unsigned max_shard;
+};
+
+template <typename H> static distribution distribute(const std::vector<std::string>& corpus)
+{
+    H hash;
+    std::size_t buckets = 1;
+    while(buckets < corpus.size())
+        buckets <<= 1;
+    std::vector<unsigned> counts(buckets);
+    const unsigned shards = BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT;
+    std::vector<unsigned> shard_counts(shards);
+    for (const std::string& s: corpus)
+    {
+        std::size_t hashv = hash(s.data(), s.size());
+        ++counts[hashv & (buckets - 1)];
+        ++shard_counts[(hashv >> (sizeof(hashv) * 4)) & (shards - 1)];
+    }
+    distribution d;
+    d.longest = *std::max_element(counts.begin(), counts.end());
+    d.max_shard = *std::max_element(shard_counts.begin(), shard_counts.end());
+    double expected = double(corpus.size()) / buckets;
+    double chi2 = 0;
+    for (unsigned c: counts)
+        chi2 += (c - expected) * (c - expected) / expected;
+    d.chi2 = chi2 / buckets;
+    return d;
+}
+
+template <typename H> static void report(const char* name, const std::vector<std::string>& corpus,
+        const std::vector<const char*>& chars, const std::vector<std::size_t>& lengths, std::size_t bytes)
+{
+    double ns = throughput<H>(corpus);
+    std::vector<std::size_t> hashes;
+    double bulk_ns = bulk_throughput<H>(chars, lengths, hashes);
+    distribution d = distribute<H>(corpus);
+    printf("  %-10s %8.1f ns %8.0f MB/s  bulk %6.1f ns   longest %3u  chi2/n %6.3f  max shard %6.2f%%\n",
+            name, ns, bytes / (ns * corpus.size()) * 1000.0, bulk_ns, d.longest, d.chi2,
+            100.0 * d.max_shard / corpus.size());
+}
+
+static void run(const char* title, const std::vector<std::string>& corpus)
+{
+    std::size_t bytes = 0;
+    std::vector<const char*> chars;
+    std::vector<std::size_t> lengths;
+    for (const std::string& s: corpus)
+    {
+        bytes += s.size();
+        chars.push_back(s.data());
+        lengths.push_back(s.size());
+    }
+    printf("%s: %zu strings, %.1f bytes average\n", title, corpus.size(), double(bytes) / corpus.size());
+    report<benedias::lookup3_hash>("lookup3", corpus, chars, lengths, bytes);
+    report<benedias::wyhash>("wyhash", corpus, chars, lengths, bytes);
+    report<benedias::xxhash64>("xxhash64", corpus, chars, lengths, bytes);
+    for (unsigned lanes: {1, 4, 8})
+    {
+        std::size_t wrong;
+        double ns = lanes_throughput(chars, lengths, lanes, wrong);
+        printf("  lookup3 x%u %6.1f ns  %zu wrong\n", lanes, ns, wrong);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned count = argc > 1 ? atoi(argv[1]) : 200000;
+    printf("ideal shard %.2f%%\n", 100.0 / BENEDIAS_MEMDB_DBSTRING_SHARD_COUNT);
+    run("artists", make_artists(count));
+    run("titles", make_titles(count));
+    run("paths", make_paths(count));
+    return 0;
+}
@@ -0,0 +1,291 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This file is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this file.  If not, see <http://www.gnu.org/licenses/>.
+
+Open addressing (linear probing) hash table of pointers, with lock free lookups.
+
+Lookups do not write to shared memory, and must be made within an
+benedias::epoch_guard.
+Modifications (insert, erase) must be serialised by the caller.
+Replaced tables are retired using epoch based reclamation, retiring erased
+objects is the responsibility of the caller.
+
+Each slot holds a pointer and the top 16 bits of the hash value of the object
+pointed to, in the unused upper bits of the pointer, so that most mismatches
+are detected without dereferencing the pointer.
+*/
+#ifndef BENEDIAS_LF_HASHTABLE_H_INCLUDED
+#define BENEDIAS_LF_HASHTABLE_H_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <assert.h>
+#include <stdint.h>
+
+#include "bdepoch.h"
+
+namespace benedias {
+
+// @a Hash is a functor returning the hash value of an object pointed to by
+// a table entry, it is used when the table is resized.
+template <typename T, typename Hash> class lf_hashtable
+{
+    static_assert(sizeof(uintptr_t) == 8, "lf_hashtable requires 64 bit pointers");
+    private:
+        static const uintptr_t empty = 0;
+        static const uintptr_t tombstone = 1;
+        static const unsigned tag_shift = 48;
+        static const uintptr_t ptr_mask = (uintptr_t(1) << tag_shift) - 1;
+        static const std::size_t min_capacity = 16;
+    public:
+        struct table
+        {
+            std::size_t mask;
+            std::atomic<uintptr_t> slots[1];
+        };
+    private:
+        std::atomic<table*> current;
+        // Modified with the modification lock held.
+        std::size_t live = 0;
+        std::size_t used = 0;
+
+        static inline uintptr_t tag_of(std::size_t hashv)
+        {
+            return uintptr_t(hashv) & ~ptr_mask;
+        }
+
+        static inline T* ptr_of(uintptr_t slot)
+        {
+            return reinterpret_cast<T*>(slot & ptr_mask);
+        }
+
+        static table* new_table(std::size_t capacity)
+        {
+            void* mem = ::operator new(sizeof(table) + (capacity - 1) * sizeof(std::atomic<uintptr_t>));
+            table* tbl = static_cast<table*>(mem);
+            tbl->mask = capacity - 1;
+            for(std::size_t ix = 0; ix < capacity; ++ix)
+                new (&tbl->slots[ix]) std::atomic<uintptr_t>(empty);
+            return tbl;
+        }
+
+        static void delete_table(void* tbl)
+        {
+            ::operator delete(tbl);
+        }
+
+        static void put(table* tbl, uintptr_t entry, std::size_t hashv)
+        {
+            std::size_t ix = hashv & tbl->mask;
+            while(tbl->slots[ix].load(std::memory_order_relaxed) > tombstone)
+                ix = (ix + 1) & tbl->mask;
+            tbl->slots[ix].store(entry, std::memory_order_release);
+        }
+
+        // Replace the table with one sized for the live entries and
+        // @a extra additional entries, tombstones are discarded.
+        void rehash(std::size_t extra = 1)
+        {
+            table* old = current.load(std::memory_order_relaxed);
+            std::size_t capacity = min_capacity;
+            while(capacity < (live + extra) * 4)
+                capacity <<= 1;
+            table* tbl = new_table(capacity);
+            for(std::size_t ix = 0; ix <= old->mask; ++ix)
+            {
+                uintptr_t slot = old->slots[ix].load(std::memory_order_relaxed);
+                if (slot > tombstone)
+                    put(tbl, slot, Hash()(ptr_of(slot)));
+            }
+            used = live;
+            current.store(tbl, std::memory_order_release);
+            epoch_retire(old, delete_table);
+        }
+
+    public:
+        lf_hashtable():current(new_table(min_capacity)) {}
+
+        // Objects pointed to are not deleted.
+        ~lf_hashtable()
+        {
+            delete_table(current.load());
+        }
+
+        //@brief    Returns a pointer to the object with hash value @a hashv
+        // for which @a match returns true, or nullptr.
+        // Lock free, must be called within an epoch_guard.
+        template <typename Match> T* find(std::size_t hashv, Match match) const
+        {
+            const table* tbl = current.load(std::memory_order_acquire);
+            uintptr_t tag = tag_of(hashv);
+            for(std::size_t ix = hashv & tbl->mask;; ix = (ix + 1) & tbl->mask)
+            {
+                uintptr_t slot = tbl->slots[ix].load(std::memory_order_acquire);
+                if (empty == slot)
+                    return nullptr;
+                if (tombstone != slot && tag == (slot & ~ptr_mask))
+                {
+                    T* ptr = ptr_of(slot);
+                    if (match(ptr))
+                        return ptr;
+                }
+            }
+        }
+
+        //@brief    Adds @a ptr which must not be in the table.
+        // Caller must hold the modification lock.
+        void insert(T* ptr, std::size_t hashv)
+        {
+            assert(0 == (reinterpret_cast<uintptr_t>(ptr) & ~ptr_mask));
+            table* tbl = current.load(std::memory_order_relaxed);
+            if ((used + 1) * 2 > tbl->mask + 1)
+            {
+                rehash();
+                tbl = current.load(std::memory_order_relaxed);
+            }
+            uintptr_t entry = reinterpret_cast<uintptr_t>(ptr) | tag_of(hashv);
+            std::size_t ix = hashv & tbl->mask;
+            uintptr_t slot;
+            while((slot = tbl->slots[ix].load(std::memory_order_relaxed)) > tombstone)
+                ix = (ix + 1) & tbl->mask;
+            if (empty == slot)
+                ++used;
+            ++live;
+            tbl->slots[ix].store(entry, std::memory_order_release);
+        }
+
+        //@brief    Make room for @a count insertions without further resizing.
+        // Caller must hold the modification lock.
+        void reserve(std::size_t count)
+        {
+            table* tbl = current.load(std::memory_order_relaxed);
+            if ((used + count) * 2 > tbl->mask + 1)
+                rehash(count);
+        }
+
+        //@brief    Prefetch the first slot probed for @a hashv.
+        void prefetch(std::size_t hashv) const
+        {
+            const table* tbl = current.load(std::memory_order_acquire);
+            __builtin_prefetch(&tbl->slots[hashv & tbl->mask]);
+        }
+
+        //@brief    Removes @a ptr from the table.
+        // Caller must hold the modification lock.
+        bool erase(T* ptr, std::size_t hashv)
+        {
+            table* tbl = current.load(std::memory_order_relaxed);
+            uintptr_t entry = reinterpret_cast<uintptr_t>(ptr) | tag_of(hashv);
+            for(std::size_t ix = hashv & tbl->mask;; ix = (ix + 1) & tbl->mask)
+            {
+                uintptr_t slot = tbl->slots[ix].load(std::memory_order_relaxed);
+                if (empty == slot)
+                    return false;
+                if (entry == slot)
+                {
+                    tbl->slots[ix].store(tombstone, std::memory_order_release);
+                    --live;
+                    return true;
+                }
+            }
+        }
+
+        std::size_t size() const
+        {
+            return live;
+        }
+
+        // Positional access for iteration, must be used within an epoch_guard
+        // or with the modification lock held.
+        const table* get_table() const
+        {
+            return current.load(std::memory_order_acquire);
+        }
+
+        static std::size_t capacity(const table* tbl)
+        {
+            return tbl->mask + 1;
+        }
+
+        //@brief    Returns the object at slot @a ix of @a tbl, or nullptr.
+        static T* at(const table* tbl, std::size_t ix)
+        {
+            uintptr_t slot = tbl->slots[ix].load(std::memory_order_acquire);
+            return slot > tombstone ? ptr_of(slot) : nullptr;
+        }
+
+        //@brief    Returns the slot of @a ptr in @a tbl, or the capacity of
+        // @a tbl if it is not in @a tbl.
+        static std::size_t position(const table* tbl, const T* ptr, std::size_t hashv)
+        {
+            uintptr_t entry = reinterpret_cast<uintptr_t>(ptr) | tag_of(hashv);
+            for(std::size_t ix = hashv & tbl->mask;; ix = (ix + 1) & tbl->mask)
+            {
+                uintptr_t slot = tbl->slots[ix].load(std::memory_order_acquire);
+                if (empty == slot)
+                    return tbl->mask + 1;
+                if (entry == slot)
+                    return ix;
+            }
+        }
+
+        //@brief    Returns the longest run of occupied slots, live or
+        // tombstones, which is the most slots probed by a lookup.
+        // Must be used within an epoch_guard or with the modification lock
+        // held.
+        std::size_t longest_run() const
+        {
+            const table* tbl = get_table();
+            // Runs may wrap around the end of the table, the table always
+            // has an empty slot, so start counting after one.
+            std::size_t start = 0;
+            while(empty != tbl->slots[start].load(std::memory_order_relaxed))
+                ++start;
+            std::size_t longest = 0;
+            std::size_t run = 0;
+            for(std::size_t n = 1; n <= tbl->mask; ++n)
+            {
+                if (empty == tbl->slots[(start + n) & tbl->mask].load(std::memory_order_relaxed))
+                    run = 0;
+                else
+                    longest = std::max(longest, ++run);
+            }
+            return longest;
+        }
+
+        //@brief    Returns the bytes used by the current table.
+        std::size_t memory() const
+        {
+            return sizeof(table) + get_table()->mask * sizeof(std::atomic<uintptr_t>);
+        }
+
+        //@brief    Invoke @a func for every object in the table.
+        template <typename Func> void for_each(Func func) const
+        {
+            const table* tbl = get_table();
+            for(std::size_t ix = 0; ix <= tbl->mask; ++ix)
+            {
+                T* ptr = at(tbl, ix);
+                if (ptr)
+                    func(ptr);
+            }
+        }
+};
+
+} // namespace benedias
+
+#endif // BENEDIAS_LF_HASHTABLE_H_INCLUDED
@@ -0,0 +1,51 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is part of sqzbsrv.
+
+sqzbsrv is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+sqzbsrv is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Test of dbstring literals.
+Literals are interned and pinned during static initialisation for the whole
+program, so they are tested in their own program rather than in test1.
+*/
+#include <iostream>
+#include "sharedobj.h"
+#include "dbstring.h"
+
+using benedias::memdb::dbstring;
+using benedias::sharedobj_ptr;
+using namespace benedias::memdb::literals;
+
+int main()
+{
+    // Interned before main.
+    std::cout << "strings before main " << dbstring::stats().strings << std::endl;
+    const auto& unknown = "Unknown Artist"_dbs;
+    auto dbs = dbstring::make_sharedobj("Unknown Artist");
+    std::cout << unknown->c_str() << " same " << (dbs.get() == &unknown.get())
+        << " equal " << (*dbs.get() == unknown) << " immortal " << unknown->is_immortal() << std::endl;
+    // The hash is computed at compile time.
+    std::cout << "hash " << (unknown->hash_value() == dbs->hash_value()) << std::endl;
+    // Each use of a literal is the same string.
+    std::cout << "same " << (&"Compilation"_dbs.get() == &"Compilation"_dbs.get())
+        << " empty " << ""_dbs->size() << std::endl;
+    dbs = sharedobj_ptr<dbstring>();
+    dbstring::reap();
+    std::cout << "reaped " << (dbstring::make_sharedobj("Unknown Artist") == unknown.ptr()) << std::endl;
+    std::cout << "All Done. " << std::endl;
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is part of sqzbsrv.
+
+sqzbsrv is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+sqzbsrv is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Multi threaded benchmark of copying and releasing references to the same
+dbstring, with atomic reference counting, with the string hot, see
+dbstring::make_hot, and with the string immortal, see dbstring::pin.
+
+usage: refbench [max threads [copies per thread]]
+*/
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include "dbstring.h"
+
+using benedias::memdb::dbstring;
+using benedias::sharedobj_ptr;
+
+// Returns copies per second, each thread keeps a window of copies so that
+// releases are interleaved with copies.
+static double run(const sharedobj_ptr<dbstring>& shared, unsigned nthreads, unsigned copies)
+{
+    static const unsigned window = 64;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < nthreads; t++)
+    {
+        threads.emplace_back([&shared, copies]()
+            {
+                std::vector<sharedobj_ptr<dbstring>> held(window);
+                std::size_t total = 0;
+                for (unsigned i = 0; i < copies; i++)
+                {
+                    sharedobj_ptr<dbstring>& slot = held[i % window];
+                    slot = shared;
+                    total += slot->size();
+                }
+                if (0 == total)
+                    abort();
+            });
+    }
+    for (auto& th: threads)
+        th.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double(copies) * nthreads) / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned max_threads = std::thread::hardware_concurrency();
+    unsigned copies = 10000000;
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        copies = atoi(argv[2]);
+    if (max_threads < 1)
+        max_threads = 1;
+
+    auto shared = dbstring::make_sharedobj("Unknown Artist");
+    auto pinned = dbstring::make_sharedobj("Unknown Album");
+    dbstring::pin(pinned);
+    std::cout << "threads    atomic Mcopies/s    hot Mcopies/s    immortal Mcopies/s" << std::endl;
+    for (unsigned nthreads = 1;; nthreads = std::min(nthreads * 2, max_threads))
+    {
+        double atomic = run(shared, nthreads, copies);
+        dbstring::make_hot(shared);
+        double hot = run(shared, nthreads, copies);
+        dbstring::cool(shared);
+        double immortal = run(pinned, nthreads, copies);
+        printf("%7u    %17.2f    %13.2f    %18.2f\n", nthreads, atomic / 1e6, hot / 1e6, immortal / 1e6);
+        if (nthreads == max_threads)
+            break;
+    }
+    return 0;
+}
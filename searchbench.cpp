@@ -0,0 +1,118 @@
+/*
+
+Copyright (C) 2017,2018  Blaise Dias
+
+This file is part of sqzbsrv.
+
+sqzbsrv is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+sqzbsrv is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
+
+
+Benchmark of substring searches, dbstring::containing, over a library of
+titles, artists and albums, scanning the directory and using the trigram
+index, see dbstring::trigram_index.
+
+usage: searchbench [number of strings]
+*/
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <stdlib.h>
+#include <malloc.h>
+#include "dbstring.h"
+
+using benedias::memdb::dbstring;
+using benedias::sharedobj_ptr;
+
+static const char* words[] = {
+    "love", "night", "heart", "blue", "dream", "fire", "rain", "light",
+    "world", "time", "dance", "river", "summer", "shadow", "star", "road",
+    "home", "gold", "moon", "wild", "sweet", "broken", "little", "angel",
+};
+static const unsigned word_count = sizeof(words)/sizeof(words[0]);
+
+// Strings resembling track titles, artist and album names.
+static std::vector<std::string> make_corpus(unsigned count)
+{
+    std::vector<std::string> corpus;
+    unsigned seed = 1;
+    for (unsigned i = 0; i < count; i++)
+    {
+        std::string s;
+        unsigned nwords = 1 + i % 4;
+        for (unsigned w = 0; w < nwords; w++)
+        {
+            seed = seed * 1103515245 + 12345;
+            if (w)
+                s += ' ';
+            s += words[(seed >> 16) % word_count];
+        }
+        s += " " + std::to_string(i);
+        corpus.push_back(s);
+    }
+    return corpus;
+}
+
+// Returns the average time of a search in milliseconds, and the number of
+// strings found.
+static double run(const char* pattern, bool ignore_case, std::size_t& found)
+{
+    static const unsigned repeat = 5;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        std::string p(pattern);
+        found = ignore_case ? dbstring::containing_ignore_case(p).size() : dbstring::containing(p).size();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repeat;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned count = 500000;
+    if (argc > 1)
+        count = atoi(argv[1]);
+    std::vector<sharedobj_ptr<dbstring>> strings;
+    {
+        std::vector<std::string> corpus = make_corpus(count);
+        strings = dbstring::make_sharedobjs(corpus.data(), corpus.size());
+    }
+
+    std::size_t base = mallinfo2().uordblks;
+    auto start = std::chrono::steady_clock::now();
+    dbstring::trigram_index(true);
+    std::chrono::duration<double, std::milli> build = std::chrono::steady_clock::now() - start;
+    std::cout << count << " strings, trigram index built in " << build.count() << " ms, "
+        << double(mallinfo2().uordblks - base) / count << " bytes per string" << std::endl;
+
+    const char* patterns[] = {"eart", "Shadow", "dream sweet", "ld go", "river 1234", "12345", "ov", "zz"};
+    std::cout << "pattern           found    scan ms    index ms    index ms ignoring case" << std::endl;
+    for (auto pattern: patterns)
+    {
+        std::size_t found;
+        std::size_t found_indexed;
+        std::size_t found_folded;
+        dbstring::trigram_index(false);
+        double scan = run(pattern, false, found);
+        dbstring::trigram_index(true);
+        double indexed = run(pattern, false, found_indexed);
+        double folded = run(pattern, true, found_folded);
+        if (found != found_indexed)
+            abort();
+        printf("%-16s %6zu %10.2f %11.3f %11.3f\n", pattern, found, scan, indexed, folded);
+    }
+    return 0;
+}
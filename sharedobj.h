@@ -46,6 +46,14 @@ namespace benedias {
 //is used?
 
 
+//  @brief  Deletes an object which is no longer referenced by any sharedobj_ptr.
+//  Classes which are not allocated using new, can provide an overload of
+//  sharedobj_delete for their type, in their namespace.
+template <typename T> void sharedobj_delete(T* ptr)
+{
+    delete ptr;
+}
+
 //  @brief  A smart pointer to classes derived from sharedobj or implementing
 //  the sharedobj interface, with reference-counted copy semantics.
 //
@@ -73,7 +81,7 @@ template <typename T> class sharedobj_ptr
 #ifdef  SHARED_OBJ_DEBUG_TRACE
                     sharedobj_traceout << "deleting  " << real_ptr << " @release" << std::endl;
 #endif
-                    delete real_ptr;
+                    sharedobj_delete(real_ptr);
                 }
                 real_ptr = nullptr;
             }
@@ -123,6 +131,15 @@ template <typename T> class sharedobj_ptr
             }
         }
 
+        // @brief   Returns an sharedobj_ptr instance that points to @a ptr, taking
+        // over a use count already acquired by the caller.
+        static sharedobj_ptr<T> adopt(T* ptr)
+        {
+            sharedobj_ptr<T> sp;
+            sp.real_ptr = ptr;
+            return sp;
+        }
+
         //(destructor)
 
         //@brief    If this instance owns an object and it is the last sharedobj_ptr owning it,
@@ -294,7 +311,7 @@ namespace std
     template <typename T>
     struct hash<benedias::sharedobj_ptr<T>>
     {
-        size_t operator()(benedias::sharedobj_ptr<T>& rcp) const
+        size_t operator()(const benedias::sharedobj_ptr<T>& rcp) const
         {
             return std::hash<T>()(*rcp.get());
         }
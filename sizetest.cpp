@@ -24,13 +24,118 @@ along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
 #include <unordered_map>
 #include <vector>
 #include <stdlib.h>
+#include <malloc.h>
 #include <memory>
 #include "dbstring.h"
+#include "bdslab.h"
 
 using benedias::memdb::dbstring;
 using benedias::memdb::dbstring_iterator;
 using benedias::sharedobj_ptr;
 
+static const unsigned string_count = 100000;
+
+// Strings resembling music library tags and path components.
+static std::vector<std::string> make_corpus(unsigned count)
+{
+    std::vector<std::string> corpus;
+    char buf[256];
+    for (unsigned i = 0; i < count; i++)
+    {
+        switch(i % 4)
+        {
+            case 0: snprintf(buf, sizeof(buf), "Artist %u", i); break;
+            case 1: snprintf(buf, sizeof(buf), "Album title %u (Deluxe)", i); break;
+            case 2: snprintf(buf, sizeof(buf), "%02u - Track %u", i % 20, i); break;
+            default: snprintf(buf, sizeof(buf), "%02u - Track %u.flac", i % 20, i); break;
+        }
+        corpus.push_back(buf);
+    }
+    return corpus;
+}
+
+// Bytes per string for dbstring storage, the string directory is not included.
+//  before: an object and a separate character array, allocated using malloc
+//  malloc: a single allocation, using malloc
+//  slab:   a single allocation, using the slab allocator
+static void bytes_per_string()
+{
+    std::vector<std::string> corpus = make_corpus(string_count);
+    std::vector<void*> ptrs;
+    ptrs.reserve(string_count * 2);
+
+    std::size_t base = mallinfo2().uordblks;
+    for (auto& s: corpus)
+    {
+        ptrs.push_back(malloc(16));
+        ptrs.push_back(malloc(s.size() + 1));
+    }
+    double before = double(mallinfo2().uordblks - base) / string_count;
+    for (auto p: ptrs)
+        free(p);
+    ptrs.clear();
+
+    base = mallinfo2().uordblks;
+    for (auto& s: corpus)
+        ptrs.push_back(malloc(sizeof(dbstring) + s.size() + 1));
+    double single = double(mallinfo2().uordblks - base) / string_count;
+    for (auto p: ptrs)
+        free(p);
+    ptrs.clear();
+
+    std::size_t chars = 0;
+    for (auto& s: corpus)
+        chars += s.size();
+
+    benedias::slab_stats slab_base = benedias::slab_get_stats();
+    std::vector<sharedobj_ptr<dbstring>> strings;
+    strings.reserve(string_count);
+    for (auto& s: corpus)
+        strings.push_back(dbstring::make_sharedobj(s));
+    benedias::slab_stats slab = benedias::slab_get_stats();
+
+    std::cout << " " << string_count << " strings, average length " << double(chars) / string_count << std::endl;
+    std::cout << " bytes per string, before (object + characters, malloc)= " << before << std::endl;
+    std::cout << " bytes per string, single allocation, malloc= " << single << std::endl;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_SLAB_ALLOCATOR
+    std::cout << " bytes per string, single allocation, slab= "
+        << double(slab.bytes - slab_base.bytes) / string_count << std::endl;
+#else
+    (void)slab_base;
+    (void)slab;
+#endif
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+// Bytes per string for paths, inline and in the cold tier, including the
+// front coded blocks.
+static void cold_bytes_per_string()
+{
+    std::vector<sharedobj_ptr<dbstring>> strings;
+    strings.reserve(string_count);
+    std::size_t chars = 0;
+    char buf[256];
+    benedias::slab_stats slab_base = benedias::slab_get_stats();
+    for (unsigned i = 0; i < string_count; i++)
+    {
+        snprintf(buf, sizeof(buf), "/music/Artist %u/Album title %u (Deluxe)/%02u - Track %u.flac",
+                i / 100, i / 12, i % 12, i);
+        strings.push_back(dbstring::make_sharedobj(buf));
+        chars += strings.back()->size();
+    }
+    benedias::slab_stats slab = benedias::slab_get_stats();
+    std::cout << " " << string_count << " paths, average length " << double(chars) / string_count << std::endl;
+    std::cout << " bytes per path, inline= "
+        << double(slab.bytes - slab_base.bytes) / string_count << std::endl;
+    dbstring::cold_sweep();
+    std::size_t migrated = dbstring::cold_sweep();
+    slab = benedias::slab_get_stats();
+    benedias::memdb::dbstring_cold_stats cold = dbstring::cold_stats();
+    std::cout << " paths migrated= " << migrated << ", bytes per path, cold tier= "
+        << double(slab.bytes - slab_base.bytes + cold.block_bytes) / string_count << std::endl;
+}
+#endif
+
 int main(int argc, char* argv[] )
 {
     std::shared_ptr<std::string> spstds = std::make_shared<std::string>("abc");
@@ -38,7 +143,7 @@ int main(int argc, char* argv[] )
     std::cout << " sizeof(shared_ptr<std::string>)= " << sizeof(spstds) << std::endl;
     std::cout << " sizeof(sharedobj_ptr<dbstring>)= " << sizeof(spdbs) << std::endl;
     std::cout << " sizeof(std::string)= " << sizeof(*spstds) << std::endl;
-    std::cout << " sizeof(dbstring)= " << sizeof(*spdbs) << std::endl;
+    std::cout << " sizeof(dbstring)= " << sizeof(dbstring) << std::endl;
 
 #ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
     auto dom = dbstring::get_domain();
@@ -46,6 +151,11 @@ int main(int argc, char* argv[] )
 #endif
 
 
+    bytes_per_string();
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+    cold_bytes_per_string();
+#endif
+
     std::cout << "All Done. " << std::endl;
 }
 
@@ -17,19 +17,28 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with sqzbsrv.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <clocale>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
+#include <sstream>
 #include <stdlib.h>
+#include <thread>
+#include <chrono>
 #include "sharedobj.h"
 #include "dbstring.h"
 
 using benedias::memdb::dbstring;
 using benedias::memdb::dbstring_iterator;
+using benedias::memdb::dbstring_stats;
 using benedias::sharedobj_ptr;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+using benedias::memdb::dbstring_collation;
+using benedias::memdb::ordinal_radix_sort;
+#endif
 
 const char* teststrs[] = {
     "abc",
@@ -143,6 +152,409 @@ void test5()
     std::cout << "} test5()" << std::endl;
 }
 
+// Lookup only and length aware interning.
+void test6()
+{
+    std::cout << "test6() {" << std::endl;
+    std::cout << "dbstring::find(\"xyz\") " << (dbstring::find("xyz") ? "found" : "not found") << std::endl;
+    auto dbs = dbstring::make_sharedobj("xyz");
+    std::cout << "dbstring::find(\"xyz\") " << (dbstring::find("xyz") == dbs ? "found" : "not found") << std::endl;
+
+    // A slice of a buffer, not NUL terminated.
+    const char buf[] = {'x', 'y', 'z', 'z', 'y'};
+    std::cout << "make_sharedobj(buf, 3) " << (dbstring::make_sharedobj(buf, 3) == dbs ? "same" : "different") << std::endl;
+    std::cout << "find(buf, 4) " << (dbstring::find(buf, 4) ? "found" : "not found") << std::endl;
+
+    // Binary safe, strings with embedded NULs are distinct.
+    auto dbs0 = dbstring::make_sharedobj(std::string("xyz\0a", 5));
+    std::cout << "make_sharedobj(\"xyz\\0a\") " << (dbs0 == dbs ? "same" : "different")
+        << " size " << dbs0->size() << std::endl;
+    std::cout << "find(\"xyz\\0a\") " << (dbstring::find(std::string("xyz\0a", 5)) == dbs0 ? "found" : "not found") << std::endl;
+    std::cout << "} test6()" << std::endl;
+}
+
+// Bulk interning, with and without bulk load mode.
+void test7()
+{
+    std::cout << "test7() {" << std::endl;
+    std::vector<std::string> strs;
+    for (unsigned i = 0; i < 1000; i++)
+        strs.push_back("bulk " + std::to_string(i % 400));
+    auto single = dbstring::make_sharedobj("bulk 7");
+    std::vector<sharedobj_ptr<dbstring>> v = dbstring::make_sharedobjs(strs);
+    unsigned errors = 0;
+    for (unsigned i = 0; i < strs.size(); i++)
+    {
+        if (v[i]->std_str() != strs[i] || v[i] != v[i % 400])
+            ++errors;
+    }
+    std::cout << "make_sharedobjs " << v.size() << " strings, " << errors << " errors, "
+        << (v[7] == single ? "interned" : "not interned") << std::endl;
+    {
+        benedias::memdb::dbstring_bulk_load bulk_load;
+        std::cout << "bulk load, reap delayed " << dbstring::is_reap_delayed() << std::endl;
+        std::vector<sharedobj_ptr<dbstring>> v2 = dbstring::make_sharedobjs(strs);
+        std::cout << "make_sharedobjs " << (v2 == v ? "same" : "different") << std::endl;
+    }
+    std::cout << "after bulk load, reap delayed " << dbstring::is_reap_delayed() << std::endl;
+    // Overlapping loads, reaping is restored when the last one ends.
+    auto first = new benedias::memdb::dbstring_bulk_load();
+    auto second = new benedias::memdb::dbstring_bulk_load();
+    delete first;
+    std::cout << "overlapping bulk loads, reap delayed " << dbstring::is_reap_delayed();
+    delete second;
+    std::cout << " " << dbstring::is_reap_delayed() << std::endl;
+    std::cout << "} test7()" << std::endl;
+}
+
+// Background reaper, with reaping delayed.
+void test8()
+{
+    std::cout << "test8() {" << std::endl;
+    dbstring::delay_reap(true);
+    benedias::memdb::dbstring_reaper_limits limits;
+    limits.buckets_per_step = 16;
+    limits.max_write_hold_us = 50;
+    limits.wake_after_releases = 256;
+    dbstring::background_reap(true, limits);
+    std::cout << "background reaping " << dbstring::is_background_reaping() << std::endl;
+    for (unsigned i = 0; i < 10000; i++)
+        dbstring::make_sharedobj("reap " + std::to_string(i));
+    unsigned count = 10000;
+    for (unsigned tries = 0; count > 1000 && tries < 50; tries++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        count = 0;
+        for(const sharedobj_ptr<dbstring>& dbs: benedias::memdb::dbstring_range())
+        {
+            (void)dbs;
+            ++count;
+        }
+    }
+    std::cout << "after background reaping " << (count <= 1000 ? "reaped" : "not reaped") << std::endl;
+    dbstring::background_reap(false);
+    std::cout << "background reaping " << dbstring::is_background_reaping() << std::endl;
+    dbstring::delay_reap(false);
+    std::cout << "} test8()" << std::endl;
+}
+
+void test9()
+{
+    std::cout << "test9() {" << std::endl;
+    {
+        auto hot = dbstring::make_sharedobj("Unknown Artist");
+        std::cout << "make_hot " << dbstring::make_hot(hot) << " is_hot " << hot->is_hot() << std::endl;
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&hot]()
+                {
+                    std::vector<sharedobj_ptr<dbstring>> copies(1000, hot);
+                    for (unsigned i = 0; i < 100000; i++)
+                        copies[i % copies.size()] = hot;
+                });
+        }
+        for (auto& th: threads)
+            th.join();
+        dbstring::cool(hot);
+        std::cout << "is_hot " << hot->is_hot() << " use_count " << hot.use_count() << std::endl;
+    }
+    dbstring::reap();
+    std::cout << "found after reap " << bool(dbstring::find("Unknown Artist")) << std::endl;
+    std::cout << "} test9()" << std::endl;
+}
+
+void test10()
+{
+    std::cout << "test10() {" << std::endl;
+    {
+        auto empty = dbstring::make_sharedobj("");
+        dbstring::pin(empty);
+        std::vector<sharedobj_ptr<dbstring>> genres;
+        for (unsigned i = 0; i < 100; i++)
+            genres.push_back(dbstring::make_sharedobj("Genre " + std::to_string(i % 4)));
+        auto once = dbstring::make_sharedobj("referenced once");
+        std::cout << "pinned " << dbstring::pin_most_referenced(4) << std::endl;
+        std::cout << "empty " << empty->is_immortal() << " genre " << genres[0]->is_immortal()
+            << " once " << once->is_immortal() << std::endl;
+        // Pinning a hot string cools it.
+        auto hot = dbstring::make_sharedobj("pinned while hot");
+        dbstring::make_hot(hot);
+        {
+            std::vector<sharedobj_ptr<dbstring>> copies(10, hot);
+        }
+        dbstring::pin(hot);
+        std::cout << "pinned hot " << hot->is_hot() << " " << hot->is_immortal() << std::endl;
+    }
+    dbstring::reap();
+    std::cout << "found after reap " << bool(dbstring::find("Genre 3"))
+        << " " << bool(dbstring::find("referenced once")) << std::endl;
+    std::cout << "} test10()" << std::endl;
+}
+
+void test11()
+{
+    std::cout << "test11() {" << std::endl;
+    std::vector<sharedobj_ptr<dbstring>> v;
+    for (unsigned i = 0; i < 100; i++)
+        v.push_back(dbstring::make_sharedobj("snapshot " + std::to_string(i)));
+    {
+        benedias::memdb::dbstring_snapshot snap = dbstring::snapshot();
+        std::size_t size = snap.size();
+        std::cout << "current " << snap.is_current() << std::endl;
+        for (unsigned i = 100; i < 200; i++)
+            v.push_back(dbstring::make_sharedobj("snapshot " + std::to_string(i)));
+        v.erase(v.begin(), v.begin() + 50);
+        dbstring::reap();
+        std::cout << "current " << snap.is_current() << " unchanged " << (snap.size() == size) << std::endl;
+        std::size_t chars = 0;
+        for (auto& dbs: snap)
+            chars += dbs->size();
+        std::cout << "found released " << bool(dbstring::find("snapshot 0")) << " chars " << chars << std::endl;
+    }
+    dbstring::reap();
+    std::cout << "found released " << bool(dbstring::find("snapshot 0"))
+        << " snapshot size " << dbstring::snapshot().size() << std::endl;
+    std::cout << "} test11()" << std::endl;
+}
+
+void test12()
+{
+    std::cout << "test12() {" << std::endl;
+    std::vector<sharedobj_ptr<dbstring>> v;
+    const char* artists[] = {"The Beatles", "Abba", "The Who", "Blur", "Theatre of Tragedy", "Them", "Zappa"};
+    for (auto a: artists)
+        v.push_back(dbstring::make_sharedobj(a));
+    dbstring::ordered_index(true);
+    v.push_back(dbstring::make_sharedobj("The Band"));
+    std::cout << "indexed " << dbstring::is_ordered_indexed() << " size " << dbstring::ordered_size() << std::endl;
+    for (auto& dbs: dbstring::ordered_range(0, 3))
+        std::cout << " " << dbs->c_str();
+    std::cout << std::endl;
+    std::cout << "lower_bound(\"T\") " << dbstring::ordered_lower_bound(std::string("T")) << std::endl;
+    auto prefix = dbstring::ordered_prefix(std::string("The "));
+    std::cout << "prefix \"The \" " << prefix.first << " " << prefix.second << std::endl;
+    for (auto& dbs: dbstring::ordered_prefix_range(std::string("The "), 1, 2))
+        std::cout << " " << dbs->c_str();
+    std::cout << std::endl;
+    v.erase(v.begin());
+    dbstring::reap();
+    for (auto& dbs: dbstring::ordered_prefix_range(std::string("The")))
+        std::cout << " " << dbs->c_str();
+    std::cout << std::endl;
+    dbstring::ordered_index(false);
+    std::cout << "indexed " << dbstring::is_ordered_indexed() << " size " << dbstring::ordered_size() << std::endl;
+    std::cout << "} test12()" << std::endl;
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+void test13()
+{
+    std::cout << "test13() {" << std::endl;
+    std::vector<sharedobj_ptr<dbstring>> v;
+    const char* titles[] = {"Track 10", "the Beatles", "track 9", "Abba", "The Who", "Track 009", "blur", "Track 1"};
+    for (auto t: titles)
+        v.push_back(dbstring::make_sharedobj(t));
+    dbstring_collation options;
+    options.strip_articles = true;
+    options.natural_numbers = true;
+    dbstring::collation(true, options);
+    v.push_back(dbstring::make_sharedobj("Track 2"));
+    std::cout << "collated " << dbstring::is_collated()
+        << " \"Track 2\" has ordinal " << (0 != v.back()->collation_ordinal()) << std::endl;
+    dbstring::collation_sort(v);
+    for (auto& dbs: v)
+        std::cout << " [" << dbs->c_str() << "]";
+    std::cout << std::endl;
+    std::cout << "collate(track 9, Track 009) " << dbstring::collate(*v[5].get(), *v[6].get())
+        << " collate(Abba, the Beatles) " << dbstring::collate(*v[0].get(), *v[1].get()) << std::endl;
+    dbstring::freeze();
+    std::vector<std::pair<sharedobj_ptr<dbstring>, sharedobj_ptr<dbstring>>> rows;
+    rows.push_back(std::make_pair(v[1], v[5]));
+    rows.push_back(std::make_pair(v[0], v[6]));
+    rows.push_back(std::make_pair(v[1], v[4]));
+    ordinal_radix_sort(rows, [](const std::pair<sharedobj_ptr<dbstring>, sharedobj_ptr<dbstring>>& row)
+            {
+                return row.second->collation_ordinal();
+            });
+    ordinal_radix_sort(rows, [](const std::pair<sharedobj_ptr<dbstring>, sharedobj_ptr<dbstring>>& row)
+            {
+                return row.first->collation_ordinal();
+            });
+    for (auto& row: rows)
+        std::cout << " [" << row.first->c_str() << ", " << row.second->c_str() << "]";
+    std::cout << std::endl;
+    dbstring::collation(false);
+    std::cout << "collated " << dbstring::is_collated() << " ordinal " << v[0]->collation_ordinal() << std::endl;
+    std::cout << "} test13()" << std::endl;
+}
+#endif
+
+void test14()
+{
+    std::cout << "test14() {" << std::endl;
+    std::vector<sharedobj_ptr<dbstring>> v;
+    const char* titles[] = {"The Beatles", "Beat It", "Heartbeat", "Abba", "Theatre of Tragedy", "Eat the Rich"};
+    for (auto t: titles)
+        v.push_back(dbstring::make_sharedobj(t));
+    dbstring::trigram_index(true);
+    v.push_back(dbstring::make_sharedobj("Beatbox"));
+    auto show = [](const char* label, std::vector<sharedobj_ptr<dbstring>> found)
+    {
+        std::sort(found.begin(), found.end(),
+                [](const sharedobj_ptr<dbstring>& lhs, const sharedobj_ptr<dbstring>& rhs) { return *lhs.get() < *rhs.get(); });
+        std::cout << label << ":";
+        for (auto& dbs: found)
+            std::cout << " [" << dbs->c_str() << "]";
+        std::cout << std::endl;
+    };
+    std::cout << "indexed " << dbstring::is_trigram_indexed() << std::endl;
+    show("eat", dbstring::containing(std::string("eat")));
+    show("BEAT ignoring case", dbstring::containing_ignore_case(std::string("BEAT")));
+    show("Ab", dbstring::containing(std::string("Ab")));
+    show("xyz", dbstring::containing(std::string("xyz")));
+    v.erase(v.begin());
+    dbstring::reap();
+    show("the ignoring case", dbstring::containing_ignore_case(std::string("the")));
+    dbstring::trigram_index(false);
+    std::cout << "indexed " << dbstring::is_trigram_indexed() << std::endl;
+    show("the ignoring case", dbstring::containing_ignore_case(std::string("the")));
+    std::cout << "} test14()" << std::endl;
+}
+
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+void test15()
+{
+    std::cout << "test15() {" << std::endl;
+    std::vector<sharedobj_ptr<dbstring>> v;
+    const char* paths[] = {
+        "/music/Pink Floyd/The Dark Side of the Moon/01 - Speak to Me.flac",
+        "/music/Pink Floyd/The Dark Side of the Moon/02 - Breathe.flac",
+        "/music/Pink Floyd/The Dark Side of the Moon/03 - On the Run.flac",
+        "/music/Pink Floyd/Wish You Were Here/01 - Shine On You Crazy Diamond.flac",
+        "Abba"};
+    for (auto p: paths)
+        v.push_back(dbstring::make_sharedobj(p));
+    // The first sweep finds the strings accessed, the second migrates them.
+    std::cout << "migrated " << dbstring::cold_sweep() << std::endl;
+    std::cout << "migrated " << dbstring::cold_sweep() << std::endl;
+    // Strings are only migrated if that saves memory.
+    for (auto& dbs: v)
+        std::cout << dbs->is_cold();
+    std::cout << std::endl;
+    // Indexing and lookups read the characters without decompressing them.
+    dbstring::ordered_index(true);
+    std::cout << "indexed " << dbstring::ordered_size() << " cold " << v[1]->is_cold()
+        << " found " << (dbstring::make_sharedobj(paths[1]) == v[1]) << " cold " << v[1]->is_cold() << std::endl;
+    dbstring::ordered_index(false);
+    // Accessing the characters decompresses them.
+    std::cout << v[1]->c_str() << " " << v[1]->size() << " " << v[1]->is_cold() << std::endl;
+    std::cout << "same " << (dbstring::make_sharedobj(paths[2]) == v[2]) << " " << (*v[3].get() == paths[3]) << std::endl;
+    auto stats = dbstring::cold_stats();
+    std::cout << "cold " << stats.cold << " thawed " << stats.thawed << std::endl;
+    // Thawed strings not accessed since the previous sweep are migrated
+    // again, unless c_str returned a pointer to the characters, while the
+    // string is referenced.
+    dbstring::cold_sweep();
+    std::cout << "migrated " << dbstring::cold_sweep() << " cold " << v[1]->is_cold() << v[3]->is_cold() << std::endl;
+    v.erase(v.begin());
+    dbstring::reap();
+    stats = dbstring::cold_stats();
+    std::cout << "cold " << stats.cold << " thawed " << stats.thawed << std::endl;
+    for (auto& dbs: v)
+        std::cout << *dbs.get() << std::endl;
+    // Once only the directory references it, it is migrated again.
+    dbstring::delay_reap(true);
+    v.erase(v.begin());
+    for (unsigned i = 0; i < 3; i++)
+        dbstring::cold_sweep();
+    std::cout << "unreferenced cold " << dbstring::find(paths[1])->is_cold() << std::endl;
+    dbstring::delay_reap(false);
+    std::cout << "} test15()" << std::endl;
+}
+#endif
+
+void test17()
+{
+    std::cout << "test17() {" << std::endl;
+    // Long strings differing only near the end, and in bytes above 127.
+    std::string prefix("/srv/music/library/Nina Simone/Little Girl Blue (Remastered)/");
+    auto a = dbstring::make_sharedobj(prefix + "01 - Mood Indigo.flac");
+    auto b = dbstring::make_sharedobj(prefix + "01 - Mood Indigo.flaC");
+    auto c = dbstring::make_sharedobj(prefix + "01 - Mood Indigo.fl\xe4" "c");
+    std::cout << "== " << (*a.get() == *b.get()) << (*a.get() == *a.get())
+        << (*a.get() == prefix + "01 - Mood Indigo.flac") << (*b.get() == (prefix + "01 - Mood Indigo.flac").c_str()) << std::endl;
+    std::cout << "< " << (*b.get() < *a.get()) << (*a.get() < *c.get()) << (*c.get() < *a.get())
+        << (*a.get() < (prefix + "01 - Mood Indigo.flac!").c_str()) << (*a.get() < prefix.c_str()) << std::endl;
+    auto d = dbstring::make_sharedobj("Nina");
+    auto e = dbstring::make_sharedobj("Nin\xe4");
+    std::cout << "short " << (*d.get() < *e.get()) << (*d.get() == "Nina") << (*d.get() == "Nin") << std::endl;
+    std::cout << "} test17()" << std::endl;
+}
+
+void test18()
+{
+    std::cout << "test18() {" << std::endl;
+    dbstring::delay_reap(true);
+    dbstring_stats before = dbstring::stats();
+    {
+        auto a = dbstring::make_sharedobj("Etta James");
+        auto b = dbstring::make_sharedobj("Etta James");
+        std::vector<std::string> names = {"Etta James", "Ray Charles", "Billie Holiday"};
+        auto v = dbstring::make_sharedobjs(names);
+        dbstring_stats after = dbstring::stats();
+        std::cout << "strings " << after.strings - before.strings
+            << " hits " << after.hits - before.hits
+            << " misses " << after.misses - before.misses
+            << " chars " << after.char_bytes - before.char_bytes << std::endl;
+    }
+    dbstring::reap();
+    dbstring_stats after = dbstring::stats();
+    std::cout << "reaps " << after.reaps - before.reaps << " reaped " << after.reaped - before.reaped
+        << " last " << after.last_reaped << " strings " << after.strings << std::endl;
+    dbstring::delay_reap(false);
+    {
+        auto a = dbstring::make_sharedobj("Patti Smith");
+    }
+    dbstring_stats erased = dbstring::stats();
+    std::cout << "release erases " << erased.release_erases - after.release_erases << std::endl;
+    std::ostringstream text;
+    erased.write_text(text);
+    std::string strings = std::to_string(erased.strings);
+    std::cout << "text " << (text.str().find("strings " + strings + "\n") == 0) << std::endl;
+    std::ostringstream json;
+    erased.write_json(json);
+    std::cout << "json " << (json.str().find("{\"strings\": " + strings + ", ") == 0)
+        << (json.str().find("\"lengths\": [") != std::string::npos) << std::endl;
+    std::cout << "} test18()" << std::endl;
+}
+
+// Strings released by a thread which then idles are removed by releases on
+// other threads.
+void test19()
+{
+    std::cout << "test19() {" << std::endl;
+    std::atomic<int> step(0);
+    std::thread idler([&step]()
+            {
+                dbstring::make_sharedobj("released by idle thread");
+                step = 1;
+                while(step != 2)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            });
+    while(step != 1)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    dbstring::make_sharedobj("released by this thread");
+    dbstring_stats before = dbstring::stats();
+    auto dbs = dbstring::make_sharedobj("released by idle thread");
+    dbstring_stats after = dbstring::stats();
+    std::cout << "removed while idle " << (after.misses - before.misses) << std::endl;
+    step = 2;
+    idler.join();
+    std::cout << "} test19()" << std::endl;
+}
+
 int main(int argc, char* argv[] )
 {
     int loopcount = 3;
@@ -165,6 +577,49 @@ int main(int argc, char* argv[] )
             case '5':
                 loopcount = 1;
                 tf = test5; break;
+            case '6':
+                loopcount = 1;
+                tf = test6; break;
+            case '7':
+                loopcount = 1;
+                tf = test7; break;
+            case '8':
+                loopcount = 1;
+                tf = test8; break;
+            case '9':
+                loopcount = 1;
+                tf = test9; break;
+            case 'a':
+                loopcount = 1;
+                tf = test10; break;
+            case 'b':
+                loopcount = 1;
+                tf = test11; break;
+            case 'c':
+                loopcount = 1;
+                tf = test12; break;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLLATION
+            case 'd':
+                loopcount = 1;
+                tf = test13; break;
+#endif
+            case 'e':
+                loopcount = 1;
+                tf = test14; break;
+#ifdef  BENEDIAS_MEMDB_DBSTRING_COLD_TIER
+            case 'f':
+                loopcount = 1;
+                tf = test15; break;
+#endif
+            case 'h':
+                loopcount = 1;
+                tf = test17; break;
+            case 'i':
+                loopcount = 1;
+                tf = test18; break;
+            case 'j':
+                loopcount = 1;
+                tf = test19; break;
 
         }
     }
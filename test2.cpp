@@ -64,6 +64,9 @@ const char* strs3[] = {
 
 
 #ifdef  BENEDIAS_USE_DBSTRING_DOMAINS
+// Domain membership does not keep strings.
+std::vector<sharedobj_ptr<dbstring>> held;
+
 void populate_domain(const char** teststrs, unsigned num, std::shared_ptr<dbstring_domain>dom)
 {
     std::cout  << std::endl << "populate_domain {" << std::endl;
@@ -71,6 +74,7 @@ void populate_domain(const char** teststrs, unsigned num, std::shared_ptr<dbstri
     for (unsigned i = 0; i < num; i++)
     {
         v.push_back(dbstring::make_sharedobj(teststrs[i], dom));
+        held.push_back(v.back());
     }
 
     for(auto it = v.cbegin(); it != v.end(); ++it)
@@ -84,14 +88,93 @@ void iterate_domain(std::shared_ptr<dbstring_domain>dom)
 {
     {
         std::cout  << std::endl << "iterate_domain {" << std::endl;
+        // Members are visited in no particular order.
+        std::vector<std::string> members;
         for(dbstring_iterator itr = dbstring::begin(dom);
                 itr != dbstring::end(); ++itr)
         {
-            std::cout << (*itr)->c_str() << std::endl;
+            members.push_back((*itr)->std_str());
         }
+        std::sort(members.begin(), members.end());
+        for(auto& member: members)
+            std::cout << member << std::endl;
         std::cout << "} iterate_domain" << std::endl << std::endl;
     }
 }
+
+// More domains than there are bits in a word, domain n holds the strings
+// whose number is a multiple of n.
+void many_domains(unsigned count)
+{
+    std::cout  << std::endl << "many_domains {" << std::endl;
+    std::vector<std::shared_ptr<dbstring_domain>> doms;
+    for (unsigned n = 1; n <= count; n++)
+        doms.push_back(dbstring::get_domain());
+    for (unsigned num = 1; num <= 1000; num++)
+    {
+        std::string str = "num" + std::to_string(num);
+        for (unsigned n = 1; n <= count; n++)
+        {
+            if (0 == num % n)
+                held.push_back(dbstring::make_sharedobj(str, doms[n - 1]));
+        }
+    }
+    for (unsigned n: {1, 2, 7, 33, 100})
+        std::cout << "domain " << n << " " << dbstring::domain_size(doms[n - 1]) << std::endl;
+    auto odd = dbstring::domain_difference(doms[0], doms[1]);
+    auto by6 = dbstring::domain_intersection(doms[1], doms[2]);
+    auto by2or3 = dbstring::domain_union(doms[1], doms[2]);
+    std::cout << "odd " << dbstring::domain_size(odd) << std::endl;
+    std::cout << "by 6 " << dbstring::domain_size(by6) << std::endl;
+    std::cout << "by 2 or 3 " << dbstring::domain_size(by2or3) << std::endl;
+    std::cout << "} many_domains" << std::endl;
+}
+
+// Dropping a domain reaps the former members which are not referenced.
+void drop_folder()
+{
+    std::cout  << std::endl << "drop_folder {" << std::endl;
+    auto folder = dbstring::get_domain();
+    std::vector<sharedobj_ptr<dbstring>> kept;
+    dbstring::delay_reap(true);
+    for (unsigned num = 1; num <= 10; num++)
+    {
+        auto dbs = dbstring::make_sharedobj("track" + std::to_string(num), folder);
+        if (num <= 3)
+            kept.push_back(dbs);
+    }
+    dbstring::delay_reap(false);
+    std::cout << "reaped " << dbstring::drop_domain(folder) << std::endl;
+    std::cout << "domain size " << dbstring::domain_size(folder) << std::endl;
+    std::cout << "track1 " << bool(dbstring::find("track1")) << std::endl;
+    std::cout << "track4 " << bool(dbstring::find("track4")) << std::endl;
+    std::cout << "} drop_folder" << std::endl;
+}
+
+// While a domain is iterated its members can be added to other domains, and
+// strings released and reaped, on the iterating thread.
+void copy_folder()
+{
+    std::cout  << std::endl << "copy_folder {" << std::endl;
+    auto folder = dbstring::get_domain();
+    auto copy = dbstring::get_domain();
+    std::vector<sharedobj_ptr<dbstring>> kept;
+    for (unsigned num = 1; num <= 200; num++)
+        kept.push_back(dbstring::make_sharedobj("song" + std::to_string(num), folder));
+    unsigned visited = 0;
+    for(dbstring_iterator itr = dbstring::begin(folder);
+            itr != dbstring::end(); ++itr)
+    {
+        ++visited;
+        held.push_back(dbstring::make_sharedobj((*itr)->std_str(), copy));
+        dbstring::make_sharedobj("copy of " + (*itr)->std_str(), copy);
+    }
+    std::cout << "visited " << visited << std::endl;
+    // The released copies are removed by reap.
+    dbstring::reap();
+    std::cout << "domain size " << dbstring::domain_size(copy) << std::endl;
+    std::cout << "} copy_folder" << std::endl;
+}
 #else
 void populate0(const char** teststrs, unsigned num)
 {
@@ -136,6 +219,17 @@ int main(int argc, char* argv[] )
     iterate_domain(dom2);
     populate_domain(strs3, sizeof(strs3)/sizeof(*strs3), dom3);
     iterate_domain(dom3);
+    iterate_domain(dbstring::domain_intersection(dom1, dom2));
+    iterate_domain(dbstring::domain_union(dom2, dom3));
+    iterate_domain(dbstring::domain_difference(dom1, dom3));
+    many_domains(100);
+    drop_folder();
+    copy_folder();
+    // Reaped strings are removed from their domains.
+    held.clear();
+    dbstring::reap();
+    iterate_domain(dom1);
+    std::cout << "domain size " << dbstring::domain_size(dom1) << std::endl;
 #else
     populate0(strs1, sizeof(strs1)/sizeof(*strs1));
     populate0(strs2, sizeof(strs2)/sizeof(*strs2));